@@ -0,0 +1,362 @@
+/*  Blah, blah, blah.. all this pedantic nonsense to say that this
+    source code is made available under the terms and conditions
+    of the accompanying GNU General Public License */
+
+// Microbenchmarks of the host hashing paths. Results are printed in the google-benchmark JSON
+// layout so release builds can be compared with the usual tooling (compare.py etc).
+//
+// miner-bench [--benchmark_filter=<regex>] [--benchmark_min_time=<seconds>] [--benchmark_out=<file>]
+// miner-bench --check    compare every host kernel the CPU supports with the scalar one, exit 1 on a mismatch
+
+#include <chrono>
+#include <cstring>
+#include <ctime>
+#include <fstream>
+#include <functional>
+#include <iostream>
+#include <regex>
+#include <string>
+#include <thread>
+#include <vector>
+#include <unistd.h>
+#include <limits.h>
+#include <json/json.h>
+#include <libdevcore/FixedHash.h>
+#include <libdevcore/SHA3.h>
+#include <libethash/internal.h>
+#include <libethash/sha3.h>
+#include <libethcore/Difficulty.h>
+#include <libproto/StratumCodec.h>
+
+using namespace std;
+using namespace dev;
+using namespace dev::eth;
+
+namespace
+{
+
+/// Keep the compiler from discarding a result.
+template <class T> inline void keep(T const& _value)
+{
+	asm volatile("" : : "g"(&_value) : "memory");
+}
+
+struct Benchmark {
+	string name;
+	function<void(uint64_t)> run;   ///< runs the body the given number of times
+};
+
+vector<Benchmark>& benchmarks()
+{
+	static vector<Benchmark> s_benchmarks;
+	return s_benchmarks;
+}
+
+void add(string const& _name, function<void(uint64_t)> _run)
+{
+	benchmarks().push_back(Benchmark{_name, _run});
+}
+
+struct Measurement {
+	uint64_t iterations;
+	double realNs;
+	double cpuNs;
+};
+
+double cpuNow()
+{
+	timespec ts;
+	clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &ts);
+	return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+Measurement measure(Benchmark const& _b, double _minTime)
+{
+	// The first call builds any lazily created fixture and is not timed.
+	_b.run(1);
+	uint64_t iterations = 1;
+	while (true) {
+		auto start = chrono::steady_clock::now();
+		double cpuStart = cpuNow();
+		_b.run(iterations);
+		double cpu = cpuNow() - cpuStart;
+		double real = chrono::duration<double, nano>(chrono::steady_clock::now() - start).count();
+		if (real >= _minTime * 1e9 || iterations >= 1000000000)
+			return Measurement{iterations, real, cpu};
+		// Aim 40% past the minimum, growing at most tenfold per round like google-benchmark.
+		double scale = real > 0 ? _minTime * 1e9 * 1.4 / real : 10;
+		iterations = max<uint64_t>(iterations + 1, (uint64_t)(iterations * min(scale, 10.0)));
+	}
+}
+
+// Fixtures, built on first use.
+
+ethash_light_t epoch0Light()
+{
+	static ethash_light_t s_light = ethash_light_new(0);
+	return s_light;
+}
+
+void registerBenchmarks()
+{
+	add("SHA3_256/32", [](uint64_t n) {
+		ethash_h256_t h = {};
+		for (uint64_t i = 0; i < n; ++i)
+			SHA3_256(&h, h.b, sizeof(h));
+		keep(h);
+	});
+	add("SHA3_512/64", [](uint64_t n) {
+		uint8_t h[64] = {};
+		for (uint64_t i = 0; i < n; ++i)
+			SHA3_512(h, h, sizeof(h));
+		keep(h);
+	});
+	add("dev_sha3/h256", [](uint64_t n) {
+		h256 h;
+		for (uint64_t i = 0; i < n; ++i)
+			h = sha3(h);
+		keep(h);
+	});
+
+	for (unsigned k = ETHASH_KERNEL_SCALAR; k <= ETHASH_KERNEL_AVX512; ++k) {
+		ethash_kernel_t kernel = (ethash_kernel_t)k;
+		ethash_kernel_t best = ethash_get_kernel();
+		if (!ethash_set_kernel(kernel))
+			continue;
+		ethash_set_kernel(best);
+		string suffix = string("/") + ethash_kernel_name(kernel);
+		add("ethash_calculate_dag_item" + suffix, [kernel](uint64_t n) {
+			ethash_kernel_t best = ethash_get_kernel();
+			ethash_set_kernel(kernel);
+			ethash_light_t light = epoch0Light();
+			node item;
+			for (uint64_t i = 0; i < n; ++i)
+				ethash_calculate_dag_item(&item, (uint32_t)i, light);
+			keep(item);
+			ethash_set_kernel(best);
+		});
+		add("ethash_calculate_dag_items/64" + suffix, [kernel](uint64_t n) {
+			ethash_kernel_t best = ethash_get_kernel();
+			ethash_set_kernel(kernel);
+			ethash_light_t light = epoch0Light();
+			node items[64];
+			for (uint64_t i = 0; i < n; ++i)
+				ethash_calculate_dag_items(items, (uint32_t)i * 64, 64, light);
+			keep(items);
+			ethash_set_kernel(best);
+		});
+		add("ethash_light_compute" + suffix, [kernel](uint64_t n) {
+			ethash_kernel_t best = ethash_get_kernel();
+			ethash_set_kernel(kernel);
+			ethash_light_t light = epoch0Light();
+			ethash_h256_t header = {};
+			ethash_return_value_t r;
+			for (uint64_t i = 0; i < n; ++i)
+				r = ethash_light_compute(light, header, i);
+			keep(r);
+			ethash_set_kernel(best);
+		});
+	}
+
+	add("ethash_light_new/epoch0", [](uint64_t n) {
+		for (uint64_t i = 0; i < n; ++i) {
+			ethash_light_t light = ethash_light_new(0);
+			keep(light);
+			ethash_light_delete(light);
+		}
+	});
+
+	add("FixedHash/h256_from_hex", [](uint64_t n) {
+		string const hex = "0x5eed5eed5eed5eed5eed5eed5eed5eed5eed5eed5eed5eed5eed5eed5eed5eed";
+		h256 h;
+		for (uint64_t i = 0; i < n; ++i)
+			h = h256(hex);
+		keep(h);
+	});
+	add("diffToTarget", [](uint64_t n) {
+		h256 target;
+		for (uint64_t i = 0; i < n; ++i)
+			diffToTarget((uint32_t*)target.data(), 1.0 + (double)(i & 0xffff));
+		keep(target);
+	});
+
+	// A nicehash job notification, parsed the old way and with the stratum codec.
+	static string const notify = "{\"id\":null,\"method\":\"mining.notify\",\"params\":[\"bf0488\","
+	                             "\"5eed5eed5eed5eed5eed5eed5eed5eed5eed5eed5eed5eed5eed5eed5eed5eed\","
+	                             "\"4ead4ead4ead4ead4ead4ead4ead4ead4ead4ead4ead4ead4ead4ead4ead4ead\",true]}";
+	add("stratum_notify/Json::Reader", [](uint64_t n) {
+		h256 header;
+		for (uint64_t i = 0; i < n; ++i) {
+			Json::Value v;
+			Json::Reader reader;
+			reader.parse(notify, v);
+			header = h256(v["params"][2].asString());
+		}
+		keep(header);
+	});
+	add("stratum_notify/StratumMessage", [](uint64_t n) {
+		h256 header;
+		StratumMessage msg;
+		for (uint64_t i = 0; i < n; ++i) {
+			msg.parse(notify.data(), notify.size());
+			hexToHash(msg.paramItems[2], header);
+		}
+		keep(header);
+	});
+	add("stratum_submit/StratumWriter", [](uint64_t n) {
+		vector<char> buf;
+		buf.reserve(512);
+		h256 mix(7);
+		for (uint64_t i = 0; i < n; ++i) {
+			buf.clear();
+			StratumWriter json(buf);
+			json << "{\"id\": 4, \"method\": \"eth_submitWork\", \"params\": [\"0x";
+			json.hex(i) << "\",\"0x";
+			json.hex(mix.data(), h256::size) << "\"]}\n";
+		}
+		keep(buf);
+	});
+}
+
+// Checks of the host kernels against the scalar path.
+
+struct KernelOutput {
+	vector<node> items;
+	vector<ethash_return_value_t> hashes;
+};
+
+KernelOutput kernelOutput(ethash_kernel_t _kernel)
+{
+	ethash_set_kernel(_kernel);
+	ethash_light_t light = epoch0Light();
+	uint32_t items = (uint32_t)(ethash_get_datasize(0) / sizeof(node));
+	KernelOutput out;
+
+	// Single items spread over the whole DAG, including its last one.
+	for (uint32_t i = 0; i < 256; ++i) {
+		node item;
+		ethash_calculate_dag_item(&item, i == 255 ? items - 1 : i * (items / 255), light);
+		out.items.push_back(item);
+	}
+	// Interleaved runs, the odd count leaves a remainder after the groups of four.
+	for (uint32_t first : {0u, 4093u, items - 67}) {
+		node run[67];
+		ethash_calculate_dag_items(run, first, 67, light);
+		out.items.insert(out.items.end(), run, run + 67);
+	}
+	for (uint64_t i = 0; i < 64; ++i) {
+		ethash_h256_t header;
+		SHA3_256(&header, (uint8_t const*)&i, sizeof(i));
+		out.hashes.push_back(ethash_light_compute(light, header, i * 0x9e3779b97f4a7c15ULL));
+	}
+	return out;
+}
+
+int checkKernels()
+{
+	ethash_kernel_t best = ethash_get_kernel();
+	KernelOutput reference = kernelOutput(ETHASH_KERNEL_SCALAR);
+	int failed = 0;
+	for (unsigned k = ETHASH_KERNEL_SCALAR + 1; k <= ETHASH_KERNEL_AVX512; ++k) {
+		ethash_kernel_t kernel = (ethash_kernel_t)k;
+		if (!ethash_set_kernel(kernel)) {
+			cerr << ethash_kernel_name(kernel) << ": not supported, skipped" << endl;
+			continue;
+		}
+		KernelOutput out = kernelOutput(kernel);
+		size_t items = 0;
+		for (size_t i = 0; i < out.items.size(); ++i)
+			if (memcmp(&out.items[i], &reference.items[i], sizeof(node)) != 0)
+				items++;
+		size_t hashes = 0;
+		for (size_t i = 0; i < out.hashes.size(); ++i)
+			if (memcmp(&out.hashes[i].result, &reference.hashes[i].result, sizeof(ethash_h256_t)) != 0 ||
+			        memcmp(&out.hashes[i].mix_hash, &reference.hashes[i].mix_hash, sizeof(ethash_h256_t)) != 0)
+				hashes++;
+		cerr << ethash_kernel_name(kernel) << ": " << (items || hashes ? "MISMATCH " : "ok ") << items << '/' <<
+		     out.items.size() << " DAG items, " << hashes << '/' << out.hashes.size() << " light hashes differ" << endl;
+		if (items || hashes)
+			failed = 1;
+	}
+	ethash_set_kernel(best);
+	return failed;
+}
+
+Json::Value context()
+{
+	Json::Value c;
+	char date[64];
+	time_t now = time(nullptr);
+	strftime(date, sizeof(date), "%Y-%m-%d %H:%M:%S", localtime(&now));
+	char hostName[HOST_NAME_MAX + 1];
+	gethostname(hostName, sizeof(hostName));
+	c["date"] = date;
+	c["host_name"] = hostName;
+	c["executable"] = "miner-bench";
+	c["num_cpus"] = thread::hardware_concurrency();
+	c["ethash_kernel"] = ethash_kernel_name(ethash_get_kernel());
+#ifdef NDEBUG
+	c["library_build_type"] = "release";
+#else
+	c["library_build_type"] = "debug";
+#endif
+	return c;
+}
+
+}
+
+int main(int argc, char** argv)
+{
+	string filter = ".*";
+	string out;
+	double minTime = 0.5;
+	for (int i = 1; i < argc; ++i) {
+		string arg = argv[i];
+		auto value = [&](char const* _opt) {
+			return arg.compare(0, strlen(_opt), _opt) == 0 ? arg.substr(strlen(_opt)) : string();
+		};
+		if (!value("--benchmark_filter=").empty())
+			filter = value("--benchmark_filter=");
+		else if (!value("--benchmark_min_time=").empty())
+			minTime = stod(value("--benchmark_min_time="));
+		else if (!value("--benchmark_out=").empty())
+			out = value("--benchmark_out=");
+		else if (arg == "--check")
+			return checkKernels();
+		else {
+			cerr << "usage: " << argv[0] <<
+			     " [--benchmark_filter=<regex>] [--benchmark_min_time=<seconds>] [--benchmark_out=<file>] | --check\n";
+			return 1;
+		}
+	}
+
+	registerBenchmarks();
+	regex re(filter);
+	Json::Value results(Json::arrayValue);
+	for (auto const& b : benchmarks()) {
+		if (!regex_search(b.name, re))
+			continue;
+		Measurement m = measure(b, minTime);
+		Json::Value r;
+		r["name"] = b.name;
+		r["run_name"] = b.name;
+		r["run_type"] = "iteration";
+		r["iterations"] = Json::UInt64(m.iterations);
+		r["real_time"] = m.realNs / m.iterations;
+		r["cpu_time"] = m.cpuNs / m.iterations;
+		r["time_unit"] = "ns";
+		results.append(r);
+		cerr << b.name << ": " << m.realNs / m.iterations << " ns" << endl;
+	}
+
+	Json::Value report;
+	report["context"] = context();
+	report["benchmarks"] = results;
+	if (out.empty())
+		cout << report << endl;
+	else {
+		ofstream f(out);
+		f << report << endl;
+	}
+	return 0;
+}
@@ -0,0 +1,53 @@
+/*  Blah, blah, blah.. all this pedantic nonsense to say that this
+    source code is made available under the terms and conditions
+    of the accompanying GNU General Public License */
+
+#include "ApiJson.h"
+
+using namespace dev;
+using namespace dev::eth;
+
+namespace
+{
+
+Json::Value rateJson(HashrateSampler::Rate const& _r)
+{
+    Json::Value v;
+    v["ewma"] = Json::UInt64(_r.ewma);
+    v["p5"] = Json::UInt64(_r.p5);
+    v["p50"] = Json::UInt64(_r.p50);
+    v["p95"] = Json::UInt64(_r.p95);
+    return v;
+}
+
+}
+
+Json::Value dev::eth::toJson(LightCacheStats const& _stats)
+{
+    Json::Value v;
+    v["entries"] = _stats.entries;
+    v["residentbytes"] = Json::UInt64(_stats.residentBytes);
+    v["hits"] = Json::UInt64(_stats.hits);
+    v["misses"] = Json::UInt64(_stats.misses);
+    v["evictions"] = Json::UInt64(_stats.evictions);
+    v["buildms"] = Json::UInt64(_stats.buildMs);
+    return v;
+}
+
+Json::Value dev::eth::toJson(HashrateSampler const& _hashrates)
+{
+    Json::Value response;
+    for (unsigned r = 0; r < HashrateSampler::Resolutions; r++) {
+        auto res = HashrateSampler::Resolution(r);
+        HashrateSampler::Stats s = _hashrates.stats(res);
+        Json::Value v;
+        v["period"] = HashrateSampler::period(res);
+        v["samples"] = Json::UInt64(s.samples);
+        v["total"] = rateJson(s.total);
+        v["gpus"] = Json::Value(Json::arrayValue);
+        for (auto const& m : s.miners)
+            v["gpus"].append(rateJson(m));
+        response[HashrateSampler::name(res)] = v;
+    }
+    return response;
+}
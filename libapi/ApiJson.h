@@ -0,0 +1,23 @@
+/*  Blah, blah, blah.. all this pedantic nonsense to say that this
+    source code is made available under the terms and conditions
+    of the accompanying GNU General Public License */
+
+#pragma once
+
+#include <json/json.h>
+#include <libethcore/EthashAux.h>
+#include <libethcore/HashrateSampler.h>
+
+namespace dev
+{
+namespace eth
+{
+
+/// Light cache LRU counters, as served by the API and REST servers.
+Json::Value toJson(LightCacheStats const& _stats);
+
+/// In H/s, the EWMA as of the last sample and percentiles over each resolution's history.
+Json::Value toJson(HashrateSampler const& _hashrates);
+
+}
+}
@@ -3,6 +3,7 @@
     of the accompanying GNU General Public License */
 
 #include "ApiServer.h"
+#include "../ApiJson.h"
 
 #include <miner-buildinfo.h>
 #include <libdevcore/Log.h>
@@ -12,6 +13,10 @@ ApiServer::ApiServer(AbstractServerConnector* conn, serverVersion_t type, Farm&
 {
     this->bindAndAddMethod(Procedure("miner_getstat1", PARAMS_BY_NAME, JSON_OBJECT, NULL), &ApiServer::getMinerStat1);
     this->bindAndAddMethod(Procedure("miner_getstathr", PARAMS_BY_NAME, JSON_OBJECT, NULL), &ApiServer::getMinerStatHR);
+    this->bindAndAddMethod(Procedure("miner_getlightcache", PARAMS_BY_NAME, JSON_OBJECT, NULL),
+                           &ApiServer::getLightCache);
+    this->bindAndAddMethod(Procedure("miner_gethashrates", PARAMS_BY_NAME, JSON_OBJECT, NULL),
+                           &ApiServer::getHashrates);
     if (!readonly) {
         this->bindAndAddMethod(Procedure("miner_restart", PARAMS_BY_NAME, JSON_OBJECT, NULL), &ApiServer::doMinerRestart);
         this->bindAndAddMethod(Procedure("miner_reboot", PARAMS_BY_NAME, JSON_OBJECT, NULL), &ApiServer::doMinerReboot);
@@ -136,6 +141,20 @@ void ApiServer::getMinerStatHR(const Json::Value& request, Json::Value& response
     response["pooladdrs"] = poolAddresses.str();        // current mining pool. For dual mode, there will be two pools here.
 }
 
+void ApiServer::getLightCache(const Json::Value& request, Json::Value& response)
+{
+    (void) request; // unused
+
+    response = toJson(EthashAux::lightStats());
+}
+
+void ApiServer::getHashrates(const Json::Value& request, Json::Value& response)
+{
+    (void) request; // unused
+
+    response = toJson(m_farm.hashrates());
+}
+
 void ApiServer::doMinerRestart(const Json::Value& request, Json::Value& response)
 {
     (void) request; // unused
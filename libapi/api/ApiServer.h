@@ -21,6 +21,8 @@ private:
     Farm& m_farm;
     void getMinerStat1(const Json::Value& request, Json::Value& response);
     void getMinerStatHR(const Json::Value& request, Json::Value& response);
+    void getLightCache(const Json::Value& request, Json::Value& response);
+    void getHashrates(const Json::Value& request, Json::Value& response);
     void doMinerRestart(const Json::Value& request, Json::Value& response);
     void doMinerReboot(const Json::Value& request, Json::Value& response);
 };
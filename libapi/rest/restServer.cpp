@@ -8,6 +8,7 @@
 #include <unistd.h>
 #include <limits.h>
 #include "restServer.h"
+#include "../ApiJson.h"
 #include "libdevcore/Log.h"
 #include "libdevcore/Common.h"
 #include "miner-buildinfo.h"
@@ -73,6 +74,16 @@ bool restServer::restgpu(stringstream& ss, unsigned index)
     return true;
 }
 
+void restServer::restcache(stringstream& ss)
+{
+    ss << toJson(EthashAux::lightStats());
+}
+
+void restServer::resthashrates(stringstream& ss)
+{
+    ss << toJson(m_farm->hashrates());
+}
+
 static void ev_handler(struct mg_connection* c, int ev, void* p)
 {
 
@@ -85,6 +96,16 @@ static void ev_handler(struct mg_connection* c, int ev, void* p)
             mg_send_head(c, 200, content.str().length(), "Content-Type: application/json; charset=utf-8");
             mg_printf(c, "%s", content.str().c_str());
         }
+        else if (mg_vcmp(&hm->uri, "/cache") == 0) {
+            rest_server.restcache(content);
+            mg_send_head(c, 200, content.str().length(), "Content-Type: application/json; charset=utf-8");
+            mg_printf(c, "%s", content.str().c_str());
+        }
+        else if (mg_vcmp(&hm->uri, "/hashrates") == 0) {
+            rest_server.resthashrates(content);
+            mg_send_head(c, 200, content.str().length(), "Content-Type: application/json; charset=utf-8");
+            mg_printf(c, "%s", content.str().c_str());
+        }
         else if ((hm->uri.len > strlen(gpu)) && (memcmp(hm->uri.p, gpu, strlen(gpu)) == 0)) {
             using boost::lexical_cast;
             using boost::bad_lexical_cast;
@@ -17,6 +17,8 @@ public:
     void run_thread();
     void reststats(stringstream& ss);
     bool restgpu(stringstream& ss, unsigned index);
+    void restcache(stringstream& ss);
+    void resthashrates(stringstream& ss);
 
     dev::eth::Farm* m_farm;
     dev::eth::PoolManager* m_pool;
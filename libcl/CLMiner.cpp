@@ -100,56 +100,58 @@ void CLMiner::workLoop()
 
 	uint64_t startNonce = 0;
 
-	// The work package currently processed by GPU.
-	WorkPackage current;
-	current.header = h256{1u};
-	current.seed = h256{1u};
+	// The work package currently processed by GPU, and the nonce its last kernel started at.
+	// Empty until the first work, the seed can't match any real one.
+	std::shared_ptr<WorkPackage const> current = std::make_shared<WorkPackage>();
+	uint64_t currentNonce = 0;
+	h256 seed{1u};
+
+	// Shared and immutable, only taken again when the farm has new work.
+	std::shared_ptr<WorkPackage const> w = current;
 
 	unsigned Run = 0;
 
 	try {
 		while (true) {
-			const WorkPackage w = work();
+			if (newWork())
+				w = work();
 			uint64_t target = 0;
 
-			if (current.header != w.header) {
+			if (current->header != w->header) {
 				// New work received. Update GPU data.
-				if (!w) {
+				if (!*w) {
 					logwarn(workerName() << " - No work. Pause for 3 s.");
 					std::this_thread::sleep_for(std::chrono::seconds(3));
 					continue;
 				}
 
-				if (current.seed != w.seed) {
+				if (seed != w->seed) {
 					if (s_dagLoadMode == DAG_LOAD_MODE_SEQUENTIAL) {
 						while (s_dagLoadIndex < index)
 							this_thread::sleep_for(chrono::seconds(1));
 						++s_dagLoadIndex;
 					}
 
-					loginfo(workerName() << " - New seed " << w.seed);
-					init(w.seed);
+					loginfo(workerName() << " - New seed " << w->seed);
+					init(w->seed);
+					seed = w->seed;
 					Run = m_workIntensity * m_computeUnits * m_workgroupSize;
 				}
 
 				// Upper 64 bits of the boundary.
-				target = (uint64_t)(u64)((u256)w.boundary >> 192);
+				target = (uint64_t)(u64)((u256)w->boundary >> 192);
 
 				// Update header constant buffer.
-				m_queue.enqueueWriteBuffer(m_header, CL_FALSE, 0, w.header.size, w.header.data());
+				m_queue.enqueueWriteBuffer(m_header, CL_FALSE, 0, w->header.size, w->header.data());
 				m_queue.enqueueWriteBuffer(m_searchBuffer, CL_FALSE, MAX_OUTPUTS * sizeof(c_zero), sizeof(c_zero), &c_zero);
 
-				if (w.exSizeBits >= 0) {
+				if (w->exSizeBits >= 0) {
 					// This can support up to 2^c_log2MaxMiners devices.
-					startNonce = w.startNonce | ((uint64_t)index << (64 - LOG2_MAX_MINERS - w.exSizeBits));
+					startNonce = w->startNonce | ((uint64_t)index << (64 - LOG2_MAX_MINERS - w->exSizeBits));
 				} else
 					startNonce = get_start_nonce();
 
-				if (g_logSwitchTime) {
-					loginfo(workerName() << " - switch time "
-					        << std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::high_resolution_clock::now() -
-					                workSwitchStart).count() << " ms.");
-				}
+				workSwitched();
 				m_searchKernel.setArg(0, m_searchBuffer);  // Supply output buffer to kernel.
 				m_searchKernel.setArg(1, m_header);  // Supply header buffer to kernel.
 				m_searchKernel.setArg(2, m_dag);  // Supply DAG buffer to kernel.
@@ -159,6 +161,12 @@ void CLMiner::workLoop()
 				m_searchKernel.setArg(7, 1);
 			}
 
+			if (!*w) {
+				// Nothing published yet.
+				std::this_thread::sleep_for(std::chrono::milliseconds(100));
+				continue;
+			}
+
 			// Read results.
 			// TODO: could use pinned host pointer instead.
 			uint32_t count, gid[255];
@@ -176,11 +184,16 @@ void CLMiner::workLoop()
 
 			// Report results while the kernel is running.
 			if (count) {
+				uint64_t nonces[255];
+				for (uint32_t i = 0; i < count; i++)
+					nonces[i] = currentNonce + gid[i];
+				vector<Result> results = EthashAux::evalBatch(current->seed, current->header,
+				                         vector_ref<uint64_t const>(nonces, count));
 				for (uint32_t i = 0; i < count; i++) {
-					uint64_t nonce = current.startNonce + gid[i];
-					Result r = EthashAux::eval(current.seed, current.header, nonce);
-					if (r.value <= current.boundary)
-						farm.submitProof(Solution{workerName().c_str(), nonce, r.mixHash, current, current.header != w.header});
+					uint64_t nonce = nonces[i];
+					Result const& r = results[i];
+					if (r.value <= current->boundary)
+						farm.submitProof(Solution{workerName().c_str(), nonce, r.mixHash, *current, current->header != w->header});
 					else {
 						farm.failedSolution();
 						logerror(workerName() << " - discarded incorrect result!");
@@ -189,7 +202,7 @@ void CLMiner::workLoop()
 			}
 
 			current = w;        // kernel now processing newest work
-			current.startNonce = startNonce;
+			currentNonce = startNonce;
 			// Increase start nonce for following kernel execution.
 			startNonce += Run;
 
@@ -204,8 +217,6 @@ void CLMiner::workLoop()
 	}
 }
 
-void CLMiner::kick_miner() {}
-
 unsigned CLMiner::getNumDevices()
 {
 	vector<cl::Platform> platforms = getPlatforms();
@@ -268,12 +279,10 @@ void CLMiner::listDevices()
 bool CLMiner::configureGPU(
     unsigned _platformId,
     unsigned _dagLoadMode,
-    unsigned _dagCreateDevice,
     bool _eval
 )
 {
 	s_dagLoadMode = _dagLoadMode;
-	s_dagCreateDevice = _dagCreateDevice;
 	s_eval = _eval;
 
 	s_platformId = _platformId;
@@ -537,10 +546,18 @@ bool CLMiner::init(const h256& seed)
 		m_dagKernel.setArg(3, lightSize64);
 		m_dagKernel.setArg(4, 0xffffffff);
 		auto startDAG = std::chrono::steady_clock::now();
-		for (uint32_t i = 0; i < work; i += Run) {
-			m_dagKernel.setArg(0, i);
-			m_queue.enqueueNDRangeKernel(m_dagKernel, cl::NullRange, Run, m_workgroupSize);
-			m_queue.finish();
+		if (s_dagLoadMode == DAG_LOAD_MODE_SINGLE) {
+			// Built once by the host cores (or mapped from the DAG store) and uploaded to every device.
+			EthashAux::FullType hostDAG = EthashAux::full(seed);
+			m_queue.enqueueWriteBuffer(m_dag, CL_TRUE, 0, dagSize, hostDAG->data().data());
+			if (EthashAux::fullLoaded(seed))
+				loginfo(workerName() << " - Freeing DAG from host");
+		} else {
+			for (uint32_t i = 0; i < work; i += Run) {
+				m_dagKernel.setArg(0, i);
+				m_queue.enqueueNDRangeKernel(m_dagKernel, cl::NullRange, Run, m_workgroupSize);
+				m_queue.finish();
+			}
 		}
 		auto endDAG = std::chrono::steady_clock::now();
 
@@ -555,6 +572,7 @@ bool CLMiner::init(const h256& seed)
 		}
 
 		auto dagTime = std::chrono::duration_cast<std::chrono::milliseconds>(endDAG - startDAG);
+		dagLoaded(dagTime.count());
 		float gb = (float)dagSize / (1024 * 1024 * 1024);
 		loginfo(workerName() << " - " << gb << " GB of DAG data generated in " << dagTime.count() << " ms.");
 	} catch (std::exception const& err) {
@@ -58,7 +58,6 @@ public:
 	static bool configureGPU(
 	    unsigned _platformId,
 	    unsigned _dagLoadMode,
-	    unsigned _dagCreateDevice,
 	    bool _eval
 	);
 	static void setNumInstances(unsigned _instances)
@@ -74,9 +73,6 @@ public:
 	{
 		s_clKernelName = (CLKernelName)_clKernel;
 	}
-protected:
-	void kick_miner() override;
-
 private:
 	void workLoop() override;
 
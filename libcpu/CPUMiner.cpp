@@ -0,0 +1,109 @@
+/*  Blah, blah, blah.. all this pedantic nonsense to say that this
+    source code is made available under the terms and conditions
+    of the accompanying GNU General Public License */
+
+#include "CPUMiner.h"
+#include "libdevcore/Log.h"
+#include "libethash/internal.h"
+
+using namespace std;
+using namespace dev;
+using namespace eth;
+
+// Nonces hashed between two checks for new work.
+static const unsigned c_batchSize = 1024;
+
+unsigned CPUMiner::s_numInstances = 0;
+
+CPUMiner::CPUMiner(FarmFace& _farm, unsigned _index):
+	Miner("cpu-", _farm, _index)
+{
+}
+
+CPUMiner::~CPUMiner()
+{
+}
+
+unsigned CPUMiner::getNumDevices()
+{
+	unsigned cores = std::thread::hardware_concurrency();
+	return cores ? cores : 1;
+}
+
+bool CPUMiner::init(const h256& seed)
+{
+	try {
+		// Every thread shares the same host DAG, only the first one to get here builds it.
+		auto startDAG = std::chrono::steady_clock::now();
+		loginfo(workerName() << " - Loading DAG for seed " << seed << " (" << ethash_kernel_name(ethash_get_kernel()) <<
+		        " kernel)");
+		m_dag.reset();
+		m_dag = EthashAux::full(seed);
+		auto dagTime = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - startDAG);
+		dagLoaded(dagTime.count());
+		loginfo(workerName() << " - " << m_dag->size / (1024 * 1024) << " MB of DAG data ready in " << dagTime.count() <<
+		        " ms.");
+		return true;
+	}
+	catch (std::exception const& _e) {
+		logerror(workerName() << " - Error CPU mining: " << _e.what());
+		throw;
+	}
+}
+
+void CPUMiner::workLoop()
+{
+	// Empty until the first work, the seed can't match any real one.
+	WorkPackage current;
+	current.seed = h256{1u};
+
+	uint64_t nonce = 0;
+
+	try {
+		while (true) {
+			if (newWork()) {
+				auto w = work();
+				if (current.header != w->header || current.seed != w->seed) {
+					if (!*w) {
+						logwarn(workerName() << " - No work. Pause for 3 s.");
+						std::this_thread::sleep_for(std::chrono::seconds(3));
+						continue;
+					}
+					if (current.seed != w->seed)
+						if (!init(w->seed))
+							break;
+					current = *w;
+
+					if (current.exSizeBits >= 0) {
+						// This can support up to 2^c_log2MaxMiners devices.
+						nonce = current.startNonce | ((uint64_t)index << (64 - LOG2_MAX_MINERS - current.exSizeBits));
+					} else
+						nonce = get_start_nonce();
+
+					workSwitched();
+				}
+			}
+			if (!current) {
+				// Nothing published yet.
+				std::this_thread::sleep_for(std::chrono::milliseconds(100));
+				continue;
+			}
+
+			unsigned hashes = 0;
+			while (hashes < c_batchSize && !newWork()) {
+				Result r = m_dag->compute(current.header, nonce);
+				if (r.value <= current.boundary)
+					farm.submitProof(Solution{workerName().c_str(), nonce, r.mixHash, current, newWork()});
+				++nonce;
+				++hashes;
+			}
+
+			// Report hash count
+			addHashCount(hashes);
+		}
+	}
+	catch (std::exception const& _e) {
+		logerror(workerName() << " - " << _e.what());
+		throw;
+	}
+}
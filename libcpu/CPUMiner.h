@@ -0,0 +1,44 @@
+/*  Blah, blah, blah.. all this pedantic nonsense to say that this
+    source code is made available under the terms and conditions
+    of the accompanying GNU General Public License */
+
+#pragma once
+
+#include <libdevcore/Worker.h>
+#include <libethcore/EthashAux.h>
+#include <libethcore/Miner.h>
+
+namespace dev
+{
+namespace eth
+{
+
+class CPUMiner: public Miner
+{
+public:
+
+	CPUMiner(FarmFace& _farm, unsigned _index);
+	~CPUMiner() override;
+
+	static unsigned instances()
+	{
+		return s_numInstances > 0 ? s_numInstances : 1;
+	}
+	static unsigned getNumDevices();
+	static void setNumInstances(unsigned _instances)
+	{
+		s_numInstances = std::min<unsigned>(std::min<unsigned>(_instances, getNumDevices()), MAX_MINERS);
+	}
+
+private:
+	void workLoop() override;
+
+	bool init(const h256& seed);
+
+	EthashAux::FullType m_dag;
+
+	static unsigned s_numInstances;
+};
+
+}
+}
@@ -35,18 +35,21 @@ bool CUDAMiner::init(const h256& seed)
 		light = EthashAux::light(seed);
 		bytesConstRef lightData = light->data();
 
+		auto startDAG = std::chrono::steady_clock::now();
+
+		// In single mode the DAG is built once by the host cores and uploaded to every device.
+		EthashAux::FullType hostDAG;
+		if (s_dagLoadMode == DAG_LOAD_MODE_SINGLE)
+			hostDAG = EthashAux::full(seed);
+
 		cuda_init(getNumDevices(), light->light, lightData.data(), lightData.size(),
-		          device, (s_dagLoadMode == DAG_LOAD_MODE_SINGLE), s_dagInHostMemory, s_dagCreateDevice);
+		          device, hostDAG ? hostDAG->data().data() : nullptr);
+		dagLoaded(std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() -
+		          startDAG).count());
 		s_dagLoadIndex++;
 
-		if (s_dagLoadMode == DAG_LOAD_MODE_SINGLE) {
-			if (s_dagLoadIndex >= s_numInstances && s_dagInHostMemory) {
-				// all devices have loaded DAG, we can free now
-				delete[] s_dagInHostMemory;
-				s_dagInHostMemory = NULL;
-				loginfo(workerName() << " - Freeing DAG from host");
-			}
-		}
+		if (hostDAG && EthashAux::fullLoaded(seed))
+			loginfo(workerName() << " - Freeing DAG from host");
 		return true;
 	}
 	catch (std::exception const& _e) {
@@ -57,33 +60,40 @@ bool CUDAMiner::init(const h256& seed)
 
 void CUDAMiner::workLoop()
 {
-	WorkPackage current;
-	current.header = h256{1u};
-	current.seed = h256{1u};
+	// Empty until the first work, the seed can't match any real one.
+	std::shared_ptr<WorkPackage const> current = std::make_shared<WorkPackage>();
+	h256 seed{1u};
 
 	try {
 		while (true) {
-			// take local copy of work since it may end up being overwritten.
-			const WorkPackage w = work();
+			// The package is shared and immutable, holding on to it is enough.
+			auto w = newWork() ? work() : current;
 
-			if (current.header != w.header || current.seed != w.seed) {
-				if (!w || w.header == h256()) {
+			if (current->header != w->header || seed != w->seed) {
+				if (!*w) {
 					logwarn(workerName() << " - No work. Pause for 3 s.");
 					std::this_thread::sleep_for(std::chrono::seconds(3));
 					continue;
 				}
-				if (current.seed != w.seed)
-					if (!init(w.seed))
+				if (seed != w->seed) {
+					if (!init(w->seed))
 						break;
+					seed = w->seed;
+				}
 				current = w;
 			}
-			uint64_t upper64OfBoundary = (uint64_t)(u64)((u256)current.boundary >> 192);
-			uint64_t startN = current.startNonce;
-			if (current.exSizeBits >= 0) {
+			if (!*current) {
+				// Nothing published yet.
+				std::this_thread::sleep_for(std::chrono::milliseconds(100));
+				continue;
+			}
+			uint64_t upper64OfBoundary = (uint64_t)(u64)((u256)current->boundary >> 192);
+			uint64_t startN = current->startNonce;
+			if (current->exSizeBits >= 0) {
 				// this can support up to 2^MAX_GPU devices
-				startN = current.startNonce | ((uint64_t)index << (64 - LOG2_MAX_MINERS - current.exSizeBits));
+				startN = current->startNonce | ((uint64_t)index << (64 - LOG2_MAX_MINERS - current->exSizeBits));
 			}
-			search(current.header.data(), upper64OfBoundary, (current.exSizeBits >= 0), startN, w);
+			search(current->header.data(), upper64OfBoundary, (current->exSizeBits >= 0), startN, *current);
 		}
 
 		// Reset miner and stop working
@@ -95,11 +105,6 @@ void CUDAMiner::workLoop()
 	}
 }
 
-void CUDAMiner::kick_miner()
-{
-	m_new_work.store(true, memory_order_relaxed);
-}
-
 void CUDAMiner::setNumInstances(unsigned _instances)
 {
 	s_numInstances = std::min<unsigned>(_instances, getNumDevices());
@@ -156,12 +161,10 @@ bool CUDAMiner::configureGPU(
     unsigned _scheduleFlag,
     uint64_t _currentBlock,
     unsigned _dagLoadMode,
-    unsigned _dagCreateDevice,
     bool _eval
 )
 {
 	s_dagLoadMode = _dagLoadMode;
-	s_dagCreateDevice = _dagCreateDevice;
 
 	if (!cuda_configureGPU(
 	        getNumDevices(),
@@ -246,9 +249,7 @@ bool CUDAMiner::cuda_init(
     uint8_t const* _lightData,
     uint64_t _lightSize,
     unsigned _deviceId,
-    bool _cpyToHost,
-    uint8_t*& hostDAG,
-    unsigned dagCreateDevice)
+    uint8_t const* _hostDAG)
 {
 	try {
 		if (numDevices == 0)
@@ -323,31 +324,13 @@ bool CUDAMiner::cuda_init(
 				CUDA_SAFE_CALL(cudaStreamCreate(&m_streams[i]));
 			}
 
-			if (!hostDAG) {
-				if ((m_device_num == dagCreateDevice) || !_cpyToHost) { //if !cpyToHost -> All devices shall generate their DAG
-					loginfo(workerName() << " - Generating DAG, size: " << dagSize / (1024 * 1024) << " MB");
-
-					ethash_generate_dag(dagSize, s_gridSize, s_blockSize, m_streams[0]);
-
-					if (_cpyToHost) {
-						uint8_t* memoryDAG = new uint8_t[dagSize];
-						loginfo(workerName() << " - Copying DAG from GPU" << m_device_num << " to host");
-						CUDA_SAFE_CALL(cudaMemcpy(reinterpret_cast<void*>(memoryDAG), dag, dagSize, cudaMemcpyDeviceToHost));
-
-						hostDAG = memoryDAG;
-					}
-				}
-				else {
-					while (!hostDAG)
-						this_thread::sleep_for(chrono::milliseconds(100));
-					goto cpyDag;
-				}
+			if (_hostDAG) {
+				loginfo(workerName() << " - Copying DAG from host to GPU" << m_device_num);
+				CUDA_SAFE_CALL(cudaMemcpy(reinterpret_cast<void*>(dag), _hostDAG, dagSize, cudaMemcpyHostToDevice));
 			}
 			else {
-			cpyDag:
-				loginfo(workerName() << " - Copying DAG from host to GPU" << m_device_num);
-				const void* hdag = (const void*)hostDAG;
-				CUDA_SAFE_CALL(cudaMemcpy(reinterpret_cast<void*>(dag), hdag, dagSize, cudaMemcpyHostToDevice));
+				loginfo(workerName() << " - Generating DAG, size: " << dagSize / (1024 * 1024) << " MB");
+				ethash_generate_dag(dagSize, s_gridSize, s_blockSize, m_streams[0]);
 			}
 		}
 
@@ -387,8 +370,7 @@ void CUDAMiner::search(
 	bool done = false;
 	while (!done) {
 
-		bool t = true;
-		if (m_new_work.compare_exchange_strong(t, false, memory_order_relaxed))
+		if (newWork())
 			done = true;
 
 		for (current_index = 0; current_index < s_numStreams; current_index++, current_nonce += batch_size) {
@@ -410,7 +392,7 @@ void CUDAMiner::search(
 				if (s_eval) {
 					Result r = EthashAux::eval(w.seed, w.header, nonce);
 					if (r.value < w.boundary)
-						farm.submitProof(Solution{workerName().c_str(), nonce, r.mixHash, w, m_new_work});
+						farm.submitProof(Solution{workerName().c_str(), nonce, r.mixHash, w, newWork()});
 					else {
 						farm.failedSolution();
 						logwarn(workerName() << " - Incorrect result discarded!");
@@ -419,16 +401,13 @@ void CUDAMiner::search(
 				else {
 					h256 mix;
 					memcpy(mix.data(), r.mix, sizeof(r.mix));
-					farm.submitProof(Solution{workerName().c_str(), nonce, mix, w, m_new_work});
+					farm.submitProof(Solution{workerName().c_str(), nonce, mix, w, newWork()});
 				}
 			}
 
 			addHashCount(batch_size);
 		}
 	}
-	if (g_logSwitchTime) {
-		loginfo(workerName() << " - switch time " << std::chrono::duration_cast<std::chrono::milliseconds>
-		        (std::chrono::high_resolution_clock::now() - workSwitchStart).count() << " ms.");
-	}
+	workSwitched();
 }
 
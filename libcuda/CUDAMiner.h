@@ -39,7 +39,6 @@ public:
 	    unsigned _scheduleFlag,
 	    uint64_t _currentBlock,
 	    unsigned _dagLoadMode,
-	    unsigned _dagCreateDevice,
 	    bool _eval
 	);
 	static void setNumInstances(unsigned _instances);
@@ -63,9 +62,7 @@ public:
 	    uint8_t const* _lightData,
 	    uint64_t _lightSize,
 	    unsigned _deviceId,
-	    bool _cpyToHost,
-	    uint8_t*& hostDAG,
-	    unsigned dagCreateDevice);
+	    uint8_t const* _hostDAG);
 
 	void search(
 	    uint8_t const* header,
@@ -74,12 +71,7 @@ public:
 	    uint64_t _startN,
 	    const dev::eth::WorkPackage& w);
 
-protected:
-	void kick_miner() override;
-
 private:
-	atomic<bool> m_new_work = {false};
-
 	void workLoop() override;
 
 	bool init(const h256& seed);
@@ -9,6 +9,7 @@
 #pragma warning(disable:4244)
 #endif
 
+#include <algorithm>
 #include <map>
 #include <unordered_map>
 #include <vector>
@@ -140,4 +141,15 @@ std::string toString(_T const& _t)
 	return o.str();
 }
 
+/// The sample that a fraction @a _p of @a _samples lie below, 0 without samples.
+template <class _T>
+_T percentile(std::vector<_T> _samples, double _p)
+{
+	if (_samples.empty())
+		return 0;
+	size_t n = std::min(_samples.size() - 1, (size_t)(_p * _samples.size()));
+	std::nth_element(_samples.begin(), _samples.begin() + n, _samples.end());
+	return _samples[n];
+}
+
 }
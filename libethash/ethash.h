@@ -33,6 +33,9 @@ typedef struct ethash_h256 {
 
 struct ethash_light;
 typedef struct ethash_light* ethash_light_t;
+struct ethash_full;
+typedef struct ethash_full* ethash_full_t;
+typedef int(*ethash_callback_t)(unsigned);
 
 typedef struct ethash_return_value {
 	ethash_h256_t result;
@@ -48,6 +51,15 @@ typedef struct ethash_return_value {
                          ERRNOMEM or invalid parameters used for @ref ethash_compute_cache_nodes()
 */
 ethash_light_t ethash_light_new(uint64_t block_number);
+/**
+        Wrap an already computed light cache, e.g. one loaded from disk.
+        The memory is neither copied nor freed and must outlive the handler.
+
+        @param block_number   The block number the cache belongs to
+        @param cache          ethash_get_cachesize(block_number) bytes of cache
+        @return               Newly allocated ethash_light handler or NULL on ERRNOMEM
+*/
+ethash_light_t ethash_light_new_external(uint64_t block_number, void* cache);
 /**
         Frees a previously allocated ethash_light handler
         @param light        The light handler to free
@@ -67,6 +79,57 @@ ethash_return_value_t ethash_light_compute(
     uint64_t nonce
 );
 
+/**
+        Allocate and initialize a new ethash_full handler
+
+        @param light          The light handler containing the cache.
+        @param num_threads    Number of host threads building the DAG, 0 uses every online core.
+        @param callback       A callback function with signature of @ref ethash_callback_t
+                         It accepts an unsigned with which a progress of DAG calculation
+                         can be displayed. If all goes well the callback should return 0.
+                         If a non-zero value is returned then DAG generation will stop.
+                         The callback is only ever invoked from the calling thread.
+                         May be NULL.
+        @return               Newly allocated ethash_full handler or NULL in case of
+                         ERRNOMEM, thread creation failure or abort from the callback
+*/
+ethash_full_t ethash_full_new(ethash_light_t light, unsigned num_threads, ethash_callback_t callback);
+/**
+        Wrap an already computed full DAG, e.g. one loaded from disk.
+        The memory is neither copied nor freed and must outlive the handler.
+
+        @param full_size      Size of the DAG in bytes, see ethash_get_datasize()
+        @param dag            The DAG data
+        @return               Newly allocated ethash_full handler or NULL on ERRNOMEM
+*/
+ethash_full_t ethash_full_new_external(uint64_t full_size, void* dag);
+/**
+        Frees a previously allocated ethash_full handler
+        @param full    The full handler to free
+*/
+void ethash_full_delete(ethash_full_t full);
+/**
+        Calculate the full client data
+
+        @param full           The full client handler
+        @param header_hash    The header hash to pack into the mix
+        @param nonce          The nonce to pack into the mix
+        @return               An object of ethash_return_value to hold the return value
+*/
+ethash_return_value_t ethash_full_compute(
+    ethash_full_t full,
+    ethash_h256_t const header_hash,
+    uint64_t nonce
+);
+/**
+        Get a pointer to the full DAG data
+*/
+void const* ethash_full_dag(ethash_full_t full);
+/**
+        Get the size of the DAG data
+*/
+uint64_t ethash_full_dag_size(ethash_full_t full);
+
 /**
         Calculate the seedhash for a given block number
 */
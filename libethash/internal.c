@@ -3,6 +3,8 @@
 #include <assert.h>
 #include <inttypes.h>
 #include <stddef.h>
+#include <pthread.h>
+#include <unistd.h>
 #include "ethash.h"
 #include "fnv.h"
 #include "endian.h"
@@ -56,57 +58,6 @@ bool static ethash_compute_cache_nodes(
 	return true;
 }
 
-void ethash_calculate_dag_item(
-    node* const ret,
-    uint32_t node_index,
-    ethash_light_t const light
-)
-{
-	uint32_t num_parent_nodes = (uint32_t)(light->cache_size / sizeof(node));
-	node const* cache_nodes = (node const*) light->cache;
-	node const* init = &cache_nodes[node_index % num_parent_nodes];
-	memcpy(ret, init, sizeof(node));
-	ret->words[0] ^= node_index;
-	SHA3_512(ret->bytes, ret->bytes, sizeof(node));
-#if defined(_M_X64) && ENABLE_SSE
-	__m128i const fnv_prime = _mm_set1_epi32(FNV_PRIME);
-	__m128i xmm0 = ret->xmm[0];
-	__m128i xmm1 = ret->xmm[1];
-	__m128i xmm2 = ret->xmm[2];
-	__m128i xmm3 = ret->xmm[3];
-#endif
-
-	for (uint32_t i = 0; i != ETHASH_DATASET_PARENTS; ++i) {
-		uint32_t parent_index = fnv_hash(node_index ^ i, ret->words[i % NODE_WORDS]) % num_parent_nodes;
-		node const* parent = &cache_nodes[parent_index];
-
-#if defined(_M_X64) && ENABLE_SSE
-		{
-			xmm0 = _mm_mullo_epi32(xmm0, fnv_prime);
-			xmm1 = _mm_mullo_epi32(xmm1, fnv_prime);
-			xmm2 = _mm_mullo_epi32(xmm2, fnv_prime);
-			xmm3 = _mm_mullo_epi32(xmm3, fnv_prime);
-			xmm0 = _mm_xor_si128(xmm0, parent->xmm[0]);
-			xmm1 = _mm_xor_si128(xmm1, parent->xmm[1]);
-			xmm2 = _mm_xor_si128(xmm2, parent->xmm[2]);
-			xmm3 = _mm_xor_si128(xmm3, parent->xmm[3]);
-
-			// have to write to ret as values are used to compute index
-			ret->xmm[0] = xmm0;
-			ret->xmm[1] = xmm1;
-			ret->xmm[2] = xmm2;
-			ret->xmm[3] = xmm3;
-		}
-#else
-		{
-			for (unsigned w = 0; w != NODE_WORDS; ++w)
-				ret->words[w] = fnv_hash(ret->words[w], parent->words[w]);
-		}
-#endif
-	}
-	SHA3_512(ret->bytes, ret->bytes, sizeof(node));
-}
-
 static bool ethash_hash(
     ethash_return_value_t* ret,
     node const* full_nodes,
@@ -141,32 +92,15 @@ static bool ethash_hash(
 
 		for (unsigned n = 0; n != MIX_NODES; ++n) {
 			node const* dag_node;
+			node tmp_node;
 			if (full_nodes)
 				dag_node = &full_nodes[MIX_NODES * index + n];
 			else {
-				node tmp_node;
 				ethash_calculate_dag_item(&tmp_node, index * MIX_NODES + n, light);
 				dag_node = &tmp_node;
 			}
 
-#if defined(_M_X64) && ENABLE_SSE
-			{
-				__m128i fnv_prime = _mm_set1_epi32(FNV_PRIME);
-				__m128i xmm0 = _mm_mullo_epi32(fnv_prime, mix[n].xmm[0]);
-				__m128i xmm1 = _mm_mullo_epi32(fnv_prime, mix[n].xmm[1]);
-				__m128i xmm2 = _mm_mullo_epi32(fnv_prime, mix[n].xmm[2]);
-				__m128i xmm3 = _mm_mullo_epi32(fnv_prime, mix[n].xmm[3]);
-				mix[n].xmm[0] = _mm_xor_si128(xmm0, dag_node->xmm[0]);
-				mix[n].xmm[1] = _mm_xor_si128(xmm1, dag_node->xmm[1]);
-				mix[n].xmm[2] = _mm_xor_si128(xmm2, dag_node->xmm[2]);
-				mix[n].xmm[3] = _mm_xor_si128(xmm3, dag_node->xmm[3]);
-			}
-#else
-			{
-				for (unsigned w = 0; w != NODE_WORDS; ++w)
-					mix[n].words[w] = fnv_hash(mix[n].words[w], dag_node->words[w]);
-			}
-#endif
+			ethash_fnv_node(&mix[n], dag_node);
 		}
 
 	}
@@ -224,13 +158,27 @@ ethash_light_t ethash_light_new(uint64_t block_number)
 	ethash_h256_t seedhash = ethash_get_seedhash(block_number);
 	ethash_light_t ret;
 	ret = ethash_light_new_internal(ethash_get_cachesize(block_number), &seedhash);
+	if (ret)
+		ret->block_number = block_number;
+	return ret;
+}
+
+ethash_light_t ethash_light_new_external(uint64_t block_number, void* cache)
+{
+	struct ethash_light* ret;
+	ret = calloc(sizeof(*ret), 1);
+	if (!ret)
+		return NULL;
+	ret->cache = cache;
+	ret->cache_size = ethash_get_cachesize(block_number);
 	ret->block_number = block_number;
+	ret->external = true;
 	return ret;
 }
 
 void ethash_light_delete(ethash_light_t light)
 {
-	if (light->cache)
+	if (light->cache && !light->external)
 		free(light->cache);
 	free(light);
 }
@@ -258,3 +206,166 @@ ethash_return_value_t ethash_light_compute(
 	uint64_t full_size = ethash_get_datasize(light->block_number);
 	return ethash_light_compute_internal(light, full_size, header_hash, nonce);
 }
+
+ethash_return_value_t ethash_full_compute_internal(
+    node const* full_nodes,
+    uint64_t full_size,
+    ethash_h256_t const header_hash,
+    uint64_t nonce
+)
+{
+	ethash_return_value_t ret;
+	ret.success = true;
+	if (!ethash_hash(&ret, full_nodes, NULL, full_size, header_hash, nonce))
+		ret.success = false;
+	return ret;
+}
+
+// Items handed out to a DAG builder thread at a time.
+#define FULL_CHUNK_NODES 4096
+
+typedef struct full_builder {
+	node* nodes;
+	ethash_light_t light;
+	uint32_t num_nodes;
+	uint32_t next;      // next unclaimed item, advanced atomically
+	uint32_t done;      // items completed, advanced atomically
+	int abort;
+} full_builder_t;
+
+// Claims and computes the next chunk of items, returns the number of items done so far
+// or 0 once there is nothing left to claim.
+static uint32_t ethash_build_full_chunk(full_builder_t* b)
+{
+	if (__atomic_load_n(&b->abort, __ATOMIC_RELAXED))
+		return 0;
+	uint32_t const first = __atomic_fetch_add(&b->next, FULL_CHUNK_NODES, __ATOMIC_RELAXED);
+	if (first >= b->num_nodes)
+		return 0;
+	uint32_t const last = first + FULL_CHUNK_NODES < b->num_nodes ? first + FULL_CHUNK_NODES : b->num_nodes;
+	ethash_calculate_dag_items(&b->nodes[first], first, last - first, b->light);
+	return __atomic_add_fetch(&b->done, last - first, __ATOMIC_RELEASE);
+}
+
+static void* ethash_build_full_thread(void* arg)
+{
+	while (ethash_build_full_chunk((full_builder_t*)arg)) {}
+	return NULL;
+}
+
+static bool ethash_compute_full_data(
+    node* mem,
+    uint64_t full_size,
+    ethash_light_t const light,
+    unsigned num_threads,
+    ethash_callback_t callback
+)
+{
+	if (full_size % (sizeof(uint32_t) * MIX_WORDS) != 0 ||
+	    (full_size % sizeof(node)) != 0)
+		return false;
+
+	full_builder_t b;
+	b.nodes = mem;
+	b.light = light;
+	b.num_nodes = (uint32_t)(full_size / sizeof(node));
+	b.next = 0;
+	b.done = 0;
+	b.abort = 0;
+
+	if (num_threads == 0) {
+		long online = sysconf(_SC_NPROCESSORS_ONLN);
+		num_threads = online > 0 ? (unsigned)online : 1;
+	}
+
+	// The calling thread is worker 0, it is also the one reporting progress.
+	pthread_t* threads = NULL;
+	unsigned started = 0;
+	if (num_threads > 1) {
+		threads = malloc(sizeof(pthread_t) * (num_threads - 1));
+		if (!threads)
+			return false;
+		for (; started != num_threads - 1; ++started)
+			if (pthread_create(&threads[started], NULL, ethash_build_full_thread, &b) != 0)
+				break;
+	}
+
+	unsigned progress = 0;
+	uint32_t done;
+	while ((done = ethash_build_full_chunk(&b)) != 0) {
+		unsigned const now = (unsigned)((uint64_t)done * 100 / b.num_nodes);
+		if (callback && now != progress) {
+			progress = now;
+			if (callback(progress) != 0)
+				__atomic_store_n(&b.abort, 1, __ATOMIC_RELAXED);
+		}
+	}
+
+	for (unsigned i = 0; i != started; ++i)
+		pthread_join(threads[i], NULL);
+	free(threads);
+	if (callback && !b.abort && progress != 100)
+		callback(100);
+
+	// A failed pthread_create() leaves fewer helpers, the work still gets done.
+	return !b.abort && __atomic_load_n(&b.done, __ATOMIC_ACQUIRE) == b.num_nodes;
+}
+
+ethash_full_t ethash_full_new(ethash_light_t light, unsigned num_threads, ethash_callback_t callback)
+{
+	struct ethash_full* ret;
+	ret = calloc(sizeof(*ret), 1);
+	if (!ret)
+		return NULL;
+	ret->file_size = ethash_get_datasize(light->block_number);
+	ret->data = malloc((size_t)ret->file_size);
+	if (!ret->data)
+		goto fail_free_full;
+	if (!ethash_compute_full_data(ret->data, ret->file_size, light, num_threads, callback))
+		goto fail_free_full_data;
+	return ret;
+
+fail_free_full_data:
+	free(ret->data);
+fail_free_full:
+	free(ret);
+	return NULL;
+}
+
+ethash_full_t ethash_full_new_external(uint64_t full_size, void* dag)
+{
+	struct ethash_full* ret;
+	ret = calloc(sizeof(*ret), 1);
+	if (!ret)
+		return NULL;
+	ret->data = (node*)dag;
+	ret->file_size = full_size;
+	ret->external = true;
+	return ret;
+}
+
+void ethash_full_delete(ethash_full_t full)
+{
+	if (full->data && !full->external)
+		free(full->data);
+	free(full);
+}
+
+ethash_return_value_t ethash_full_compute(
+    ethash_full_t full,
+    ethash_h256_t const header_hash,
+    uint64_t nonce
+)
+{
+	return ethash_full_compute_internal(full->data, full->file_size, header_hash, nonce);
+}
+
+void const* ethash_full_dag(ethash_full_t full)
+{
+	return full->data;
+}
+
+uint64_t ethash_full_dag_size(ethash_full_t full)
+{
+	return full->file_size;
+}
@@ -9,12 +9,6 @@
 #include "ethash.h"
 #include <stdio.h>
 
-#define ENABLE_SSE 0
-
-#if defined(_M_X64) && ENABLE_SSE
-#include <smmintrin.h>
-#endif
-
 #ifdef __cplusplus
 extern "C" {
 #endif
@@ -29,13 +23,15 @@ typedef union node {
 	uint8_t bytes[NODE_WORDS * 4];
 	uint32_t words[NODE_WORDS];
 	uint64_t double_words[NODE_WORDS / 2];
-
-#if defined(_M_X64) && ENABLE_SSE
-	__m128i xmm[NODE_WORDS / 4];
-#endif
-
 } node;
 
+typedef enum ethash_kernel {
+	ETHASH_KERNEL_SCALAR = 0,
+	ETHASH_KERNEL_SSE41,
+	ETHASH_KERNEL_AVX2,
+	ETHASH_KERNEL_AVX512
+} ethash_kernel_t;
+
 static inline void ethash_h256_reset(ethash_h256_t* hash)
 {
 	memset(hash, 0, 32);
@@ -45,6 +41,13 @@ struct ethash_light {
 	void* cache;
 	uint64_t cache_size;
 	uint64_t block_number;
+	bool external;   ///< cache is owned by the caller and not freed
+};
+
+struct ethash_full {
+	node* data;
+	uint64_t file_size;
+	bool external;   ///< data is owned by the caller and not freed
 };
 
 /**
@@ -74,11 +77,55 @@ ethash_return_value_t ethash_light_compute_internal(
     uint64_t nonce
 );
 
+/**
+        Calculate the full client data. Internal version.
+
+        @param full_nodes     The full DAG, ethash_get_datasize() bytes of precomputed items
+        @param full_size      The size of the full data in bytes.
+        @param header_hash    The header hash to pack into the mix
+        @param nonce          The nonce to pack into the mix
+        @return               The resulting hash.
+*/
+ethash_return_value_t ethash_full_compute_internal(
+    node const* full_nodes,
+    uint64_t full_size,
+    ethash_h256_t const header_hash,
+    uint64_t nonce
+);
+
 void ethash_calculate_dag_item(
     node* const ret,
     uint32_t node_index,
     ethash_light_t const cache
 );
+/**
+        Compute @a count consecutive DAG items starting at @a first_index into @a ret.
+        Items are interleaved so their parent lookups overlap, prefer it for bulk generation.
+*/
+void ethash_calculate_dag_items(
+    node* const ret,
+    uint32_t first_index,
+    uint32_t count,
+    ethash_light_t const cache
+);
+
+/**
+        FNV fold one node of DAG data into the mix, using the selected host kernel.
+*/
+void ethash_fnv_node(node* mix, node const* data);
+
+/**
+        Host kernel used by ethash_calculate_dag_item(s)() and ethash_fnv_node().
+        SSE4.1 is selected at load time where the CPU supports it, the wider ones
+        measure slower on these memory bound paths.
+*/
+ethash_kernel_t ethash_get_kernel(void);
+/**
+        Override the host kernel. Not thread safe, call it before any hashing starts.
+        @return               false if the CPU does not support @a kernel.
+*/
+bool ethash_set_kernel(ethash_kernel_t kernel);
+char const* ethash_kernel_name(ethash_kernel_t kernel);
 
 uint64_t ethash_get_datasize(uint64_t const block_number);
 uint64_t ethash_get_cachesize(uint64_t const block_number);
@@ -0,0 +1,213 @@
+// This source code is licenced under GNU General Public License, Version 3.
+
+// Host kernels for the two FNV hot loops of ethash: folding 256 cache parents into a DAG item
+// and folding DAG pages into the hashimoto mix. SSE4.1 is picked once at load time where the
+// CPU has it, ethash_set_kernel() (--host-kern) can override the choice.
+
+#include "internal.h"
+#include "fnv.h"
+#include "sha3.h"
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define ETHASH_X86_KERNELS 1
+#include <immintrin.h>
+#endif
+
+// DAG items computed side by side by the dag_items kernels. Each parent lookup is a cache miss
+// that depends on the previous fold, interleaving independent items keeps several in flight.
+#define DAG_ITEM_LANES 4
+
+typedef struct ethash_kernel_ops {
+	void (*dag_item)(node* const ret, uint32_t node_index, ethash_light_t const light);
+	void (*dag_items)(node* const ret, uint32_t first_index, ethash_light_t const light);
+	void (*fnv_node)(node* mix, node const* data);
+} ethash_kernel_ops_t;
+
+static inline void dag_item_begin(node* const ret, uint32_t node_index, node const* cache_nodes, uint32_t num_parent_nodes)
+{
+	memcpy(ret, &cache_nodes[node_index % num_parent_nodes], sizeof(node));
+	ret->words[0] ^= node_index;
+	SHA3_512(ret->bytes, ret->bytes, sizeof(node));
+}
+
+static inline uint32_t dag_item_parent(node const* ret, uint32_t node_index, uint32_t i, uint32_t num_parent_nodes)
+{
+	return fnv_hash(node_index ^ i, ret->words[i % NODE_WORDS]) % num_parent_nodes;
+}
+
+// Instantiates the single and interleaved DAG item kernels around the fnv_node_<isa> fold.
+#define DEFINE_DAG_ITEM_KERNELS(isa, attr) \
+attr static void dag_item_##isa(node* const ret, uint32_t node_index, ethash_light_t const light) \
+{ \
+	uint32_t const num_parent_nodes = (uint32_t)(light->cache_size / sizeof(node)); \
+	node const* cache_nodes = (node const*)light->cache; \
+	dag_item_begin(ret, node_index, cache_nodes, num_parent_nodes); \
+	for (uint32_t i = 0; i != ETHASH_DATASET_PARENTS; ++i) \
+		fnv_node_##isa(ret, &cache_nodes[dag_item_parent(ret, node_index, i, num_parent_nodes)]); \
+	SHA3_512(ret->bytes, ret->bytes, sizeof(node)); \
+} \
+attr static void dag_items_##isa(node* const ret, uint32_t first_index, ethash_light_t const light) \
+{ \
+	uint32_t const num_parent_nodes = (uint32_t)(light->cache_size / sizeof(node)); \
+	node const* cache_nodes = (node const*)light->cache; \
+	for (unsigned l = 0; l != DAG_ITEM_LANES; ++l) \
+		dag_item_begin(&ret[l], first_index + l, cache_nodes, num_parent_nodes); \
+	for (uint32_t i = 0; i != ETHASH_DATASET_PARENTS; ++i) { \
+		node const* parents[DAG_ITEM_LANES]; \
+		for (unsigned l = 0; l != DAG_ITEM_LANES; ++l) \
+			parents[l] = &cache_nodes[dag_item_parent(&ret[l], first_index + l, i, num_parent_nodes)]; \
+		for (unsigned l = 0; l != DAG_ITEM_LANES; ++l) \
+			fnv_node_##isa(&ret[l], parents[l]); \
+	} \
+	for (unsigned l = 0; l != DAG_ITEM_LANES; ++l) \
+		SHA3_512(ret[l].bytes, ret[l].bytes, sizeof(node)); \
+}
+
+static inline void fnv_node_scalar(node* mix, node const* data)
+{
+	for (unsigned w = 0; w != NODE_WORDS; ++w)
+		mix->words[w] = fnv_hash(mix->words[w], data->words[w]);
+}
+
+DEFINE_DAG_ITEM_KERNELS(scalar, )
+
+#if ETHASH_X86_KERNELS
+
+__attribute__((target("sse4.1")))
+static inline void fnv_node_sse41(node* mix, node const* data)
+{
+	__m128i* const out = (__m128i*)mix->words;
+	__m128i const* in = (__m128i const*)data->words;
+	__m128i const fnv_prime = _mm_set1_epi32(FNV_PRIME);
+	for (unsigned w = 0; w != 4; ++w)
+		_mm_storeu_si128(out + w, _mm_xor_si128(_mm_mullo_epi32(_mm_loadu_si128(out + w), fnv_prime),
+		                 _mm_loadu_si128(in + w)));
+}
+
+DEFINE_DAG_ITEM_KERNELS(sse41, __attribute__((target("sse4.1"))))
+
+__attribute__((target("avx2")))
+static inline void fnv_node_avx2(node* mix, node const* data)
+{
+	__m256i* const out = (__m256i*)mix->words;
+	__m256i const* in = (__m256i const*)data->words;
+	__m256i const fnv_prime = _mm256_set1_epi32(FNV_PRIME);
+	_mm256_storeu_si256(out + 0, _mm256_xor_si256(_mm256_mullo_epi32(_mm256_loadu_si256(out + 0), fnv_prime),
+	                    _mm256_loadu_si256(in + 0)));
+	_mm256_storeu_si256(out + 1, _mm256_xor_si256(_mm256_mullo_epi32(_mm256_loadu_si256(out + 1), fnv_prime),
+	                    _mm256_loadu_si256(in + 1)));
+}
+
+DEFINE_DAG_ITEM_KERNELS(avx2, __attribute__((target("avx2"))))
+
+__attribute__((target("avx512f")))
+static inline void fnv_node_avx512(node* mix, node const* data)
+{
+	__m512i const fnv_prime = _mm512_set1_epi32(FNV_PRIME);
+	_mm512_storeu_si512(mix->words, _mm512_xor_si512(_mm512_mullo_epi32(_mm512_loadu_si512(mix->words), fnv_prime),
+	                    _mm512_loadu_si512(data->words)));
+}
+
+DEFINE_DAG_ITEM_KERNELS(avx512, __attribute__((target("avx512f"))))
+
+#endif
+
+static ethash_kernel_ops_t const s_kernel_ops[] = {
+	{dag_item_scalar, dag_items_scalar, fnv_node_scalar},
+#if ETHASH_X86_KERNELS
+	{dag_item_sse41, dag_items_sse41, fnv_node_sse41},
+	{dag_item_avx2, dag_items_avx2, fnv_node_avx2},
+	{dag_item_avx512, dag_items_avx512, fnv_node_avx512},
+#endif
+};
+
+static ethash_kernel_t s_kernel = ETHASH_KERNEL_SCALAR;
+static ethash_kernel_ops_t s_ops = {dag_item_scalar, dag_items_scalar, fnv_node_scalar};
+
+static bool ethash_kernel_supported(ethash_kernel_t kernel)
+{
+	switch (kernel) {
+	case ETHASH_KERNEL_SCALAR:
+		return true;
+#if ETHASH_X86_KERNELS
+	case ETHASH_KERNEL_SSE41:
+		return __builtin_cpu_supports("sse4.1");
+	case ETHASH_KERNEL_AVX2:
+		return __builtin_cpu_supports("avx2");
+	case ETHASH_KERNEL_AVX512:
+		return __builtin_cpu_supports("avx512f");
+#endif
+	default:
+		return false;
+	}
+}
+
+#if ETHASH_X86_KERNELS
+__attribute__((constructor))
+static void ethash_select_kernel(void)
+{
+	// Constructors may run before libgcc has probed the CPU.
+	__builtin_cpu_init();
+	// Not the widest one: the AVX2 and AVX-512 folds run slower than SSE4.1 on the
+	// light and DAG item paths, which are bound by the dependent parent reads.
+	if (!ethash_set_kernel(ETHASH_KERNEL_SSE41))
+		ethash_set_kernel(ETHASH_KERNEL_SCALAR);
+}
+#endif
+
+ethash_kernel_t ethash_get_kernel(void)
+{
+	return s_kernel;
+}
+
+bool ethash_set_kernel(ethash_kernel_t kernel)
+{
+	if (!ethash_kernel_supported(kernel))
+		return false;
+	s_ops = s_kernel_ops[kernel];
+	s_kernel = kernel;
+	return true;
+}
+
+char const* ethash_kernel_name(ethash_kernel_t kernel)
+{
+	switch (kernel) {
+	case ETHASH_KERNEL_SCALAR:
+		return "scalar";
+	case ETHASH_KERNEL_SSE41:
+		return "sse4.1";
+	case ETHASH_KERNEL_AVX2:
+		return "avx2";
+	case ETHASH_KERNEL_AVX512:
+		return "avx512";
+	}
+	return "unknown";
+}
+
+void ethash_calculate_dag_item(
+    node* const ret,
+    uint32_t node_index,
+    ethash_light_t const light
+)
+{
+	s_ops.dag_item(ret, node_index, light);
+}
+
+void ethash_calculate_dag_items(
+    node* const ret,
+    uint32_t first_index,
+    uint32_t count,
+    ethash_light_t const light
+)
+{
+	uint32_t i = 0;
+	for (; i + DAG_ITEM_LANES <= count; i += DAG_ITEM_LANES)
+		s_ops.dag_items(&ret[i], first_index + i, light);
+	for (; i != count; ++i)
+		s_ops.dag_item(&ret[i], first_index + i, light);
+}
+
+void ethash_fnv_node(node* mix, node const* data)
+{
+	s_ops.fnv_node(mix, data);
+}
@@ -0,0 +1,44 @@
+/*  Blah, blah, blah.. all this pedantic nonsense to say that this
+    source code is made available under the terms and conditions
+    of the accompanying GNU General Public License */
+
+#include "Difficulty.h"
+#include <cmath>
+#include <cstring>
+
+namespace dev
+{
+namespace eth
+{
+
+void diffToTarget(uint32_t* target, double diff)
+{
+	uint32_t target2[8];
+	uint64_t m;
+	int k;
+
+	for (k = 6; k > 0 && diff > 1.0; k--)
+		diff /= 4294967296.0;
+	m = (uint64_t)(4294901760.0 / diff);
+	if (m == 0 && k == 6)
+		memset(target2, 0xff, sizeof(target2));
+	else {
+		memset(target2, 0, sizeof(target2));
+		target2[k] = (uint32_t)m;
+		target2[k + 1] = (uint32_t)(m >> 32);
+	}
+
+	for (int i = 0; i < 32; i++)
+		((uint8_t*)target)[31 - i] = ((uint8_t*)target2)[i];
+}
+
+double boundaryToDiff(uint8_t const* boundary)
+{
+	double target = 0;
+	for (unsigned i = 0; i < 32; i++)
+		target = target * 256 + boundary[i];
+	return target > 0 ? ldexp(4294901760.0, 192) / target : 0;
+}
+
+}
+}
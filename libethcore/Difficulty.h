@@ -0,0 +1,21 @@
+/*  Blah, blah, blah.. all this pedantic nonsense to say that this
+    source code is made available under the terms and conditions
+    of the accompanying GNU General Public License */
+
+#pragma once
+
+#include <cstdint>
+
+namespace dev
+{
+namespace eth
+{
+
+/// Write the 256 bit big endian boundary of a stratum difficulty into @a target.
+void diffToTarget(uint32_t* target, double diff);
+
+/// Inverse of diffToTarget(): the stratum difficulty of the 32 byte big endian @a boundary.
+double boundaryToDiff(uint8_t const* boundary);
+
+}
+}
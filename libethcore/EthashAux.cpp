@@ -3,6 +3,11 @@
     of the accompanying GNU General Public License */
 
 #include "EthashAux.h"
+#include <atomic>
+#include <deque>
+#include <functional>
+#include <pthread.h>
+#include <thread>
 #include <libethash/internal.h>
 #include <libdevcore/Log.h>
 
@@ -11,75 +16,398 @@ using namespace chrono;
 using namespace dev;
 using namespace eth;
 
+namespace
+{
+
+// Runs the iterations of a loop on a few long lived threads, the calling thread joins in.
+class EvalPool
+{
+public:
+	EvalPool()
+	{
+		unsigned threads = std::thread::hardware_concurrency();
+		threads = threads > 1 ? std::min(threads - 1, 4u) : 1;
+		for (unsigned i = 0; i < threads; ++i)
+			m_workers.emplace_back([this]() { work(); });
+	}
+
+	~EvalPool()
+	{
+		{
+			Guard l(x_jobs);
+			m_stop = true;
+		}
+		m_jobsChanged.notify_all();
+		for (auto& t : m_workers)
+			t.join();
+	}
+
+	void run(unsigned _count, function<void(unsigned)> const& _body)
+	{
+		auto job = make_shared<Job>(_count, _body);
+		{
+			Guard l(x_jobs);
+			for (unsigned i = 1; i < std::min<size_t>(_count, m_workers.size() + 1); ++i)
+				m_jobs.push_back(job);
+		}
+		m_jobsChanged.notify_all();
+		job->drain();
+		unique_lock<mutex> l(job->x_done);
+		job->finished.wait(l, [&]() { return job->done == job->count; });
+	}
+
+private:
+	struct Job {
+		Job(unsigned _count, function<void(unsigned)> const& _body): count(_count), body(_body) {}
+
+		void drain()
+		{
+			unsigned i;
+			while ((i = next++) < count) {
+				body(i);
+				if (++done == count) {
+					Guard l(x_done);
+					finished.notify_all();
+				}
+			}
+		}
+
+		unsigned const count;
+		function<void(unsigned)> const& body;
+		atomic<unsigned> next = {0};
+		atomic<unsigned> done = {0};
+		mutex x_done;
+		condition_variable finished;
+	};
+
+	void work()
+	{
+		while (true) {
+			shared_ptr<Job> job;
+			{
+				unique_lock<mutex> l(x_jobs);
+				m_jobsChanged.wait(l, [this]() { return m_stop || !m_jobs.empty(); });
+				if (m_stop)
+					return;
+				job = m_jobs.front();
+				m_jobs.pop_front();
+			}
+			job->drain();
+		}
+	}
+
+	vector<thread> m_workers;
+	mutex x_jobs;
+	condition_variable m_jobsChanged;
+	deque<shared_ptr<Job>> m_jobs;
+	bool m_stop = false;
+};
+
+}
+
 EthashAux& EthashAux::get()
 {
 	static EthashAux instance;
 	return instance;
 }
 
-h256 EthashAux::seedHash(unsigned _number)
+// Highest epoch number() resolves, well beyond any chain's lifetime.
+static unsigned const c_maxEpochs = 2048;
+
+EthashAux const& EthashAux::epochs()
 {
-	unsigned epoch = _number / ETHASH_EPOCH_LENGTH;
 	EthashAux& ethash = EthashAux::get();
-	Guard l(ethash.x_epochs);
-	if (epoch >= ethash.m_seedHashes.size()) {
-		h256 ret;
-		unsigned n = 0;
-		if (!ethash.m_seedHashes.empty()) {
-			ret = ethash.m_seedHashes.back();
-			n = ethash.m_seedHashes.size() - 1;
+	call_once(ethash.m_epochsBuilt, [&]() {
+		ethash.m_seedHashes.resize(c_maxEpochs);
+		ethash.m_epochs.reserve(c_maxEpochs);
+		h256 h;
+		for (unsigned epoch = 0; epoch < c_maxEpochs; ++epoch, h = sha3(h)) {
+			ethash.m_seedHashes[epoch] = h;
+			ethash.m_epochs[h] = epoch;
 		}
-		ethash.m_seedHashes.resize(epoch + 1);
-		for (; n <= epoch; ++n, ret = sha3(ret))
-			ethash.m_seedHashes[n] = ret;
-	}
-	return ethash.m_seedHashes[epoch];
+	});
+	return ethash;
+}
+
+h256 EthashAux::seedHash(unsigned _number)
+{
+	unsigned epoch = _number / ETHASH_EPOCH_LENGTH;
+	EthashAux const& ethash = epochs();
+	if (epoch < c_maxEpochs)
+		return ethash.m_seedHashes[epoch];
+	h256 ret = ethash.m_seedHashes.back();
+	for (unsigned n = c_maxEpochs - 1; n < epoch; ++n)
+		ret = sha3(ret);
+	return ret;
 }
 
 uint64_t EthashAux::number(h256 const& _seedHash)
 {
-	EthashAux& ethash = EthashAux::get();
-	Guard l(ethash.x_epochs);
-	unsigned epoch = 0;
+	EthashAux const& ethash = epochs();
 	auto epochIter = ethash.m_epochs.find(_seedHash);
 	if (epochIter == ethash.m_epochs.end()) {
-		for (h256 h; h != _seedHash && epoch < 2048; ++epoch, h = sha3(h), ethash.m_epochs[h] = epoch) {}
-		if (epoch == 2048) {
-			std::ostringstream error;
-			error << "apparent block number for " << _seedHash << " is too high; max is " << (ETHASH_EPOCH_LENGTH * 2048);
-			throw std::invalid_argument(error.str());
-		}
+		std::ostringstream error;
+		error << "apparent block number for " << _seedHash << " is too high; max is " << (ETHASH_EPOCH_LENGTH * c_maxEpochs);
+		throw std::invalid_argument(error.str());
 	}
-	else
-		epoch = epochIter->second;
-	return epoch * ETHASH_EPOCH_LENGTH;
+	return epochIter->second * ETHASH_EPOCH_LENGTH;
+}
+
+EthashAux::~EthashAux()
+{
+	{
+		Guard l(x_lookahead);
+		m_lookaheadStop = true;
+	}
+	m_lookaheadRequested.notify_all();
+	if (m_lookahead.joinable())
+		m_lookahead.join();
+	if (m_fullSaver.joinable())
+		m_fullSaver.join();
 }
 
 EthashAux::LightType EthashAux::light(h256 const& _seedHash)
 {
 	// TODO: Use epoch number instead of seed hash?
 
+	EthashAux& ethash = EthashAux::get();
+	unique_lock<mutex> l(ethash.x_lights);
+	// Don't build the same cache twice, wait for whoever is building it instead. The miners
+	// must not be held up by an idle priority thread on a busy host.
+	if (ethash.m_prefetching && ethash.m_prefetchSeed == _seedHash) {
+		sched_param param = {};
+		pthread_setschedparam(ethash.m_prefetchThread, SCHED_OTHER, &param);
+	}
+	ethash.m_lightBuilt.wait(l, [&]() {
+		return !ethash.m_lightBuilding.count(_seedHash);
+	});
+	auto it = ethash.m_lights.find(_seedHash);
+	if (it != ethash.m_lights.end()) {
+		ethash.m_lightLru.splice(ethash.m_lightLru.begin(), ethash.m_lightLru, it->second.lru);
+		++ethash.m_lightStats.hits;
+		return it->second.light;
+	}
+
+	// Built without the lock, the counters and other epochs' caches stay available meanwhile.
+	ethash.m_lightBuilding.insert(_seedHash);
+	l.unlock();
+	LightType light;
+	auto start = steady_clock::now();
+	try {
+		light = make_shared<LightAllocation>(_seedHash);
+	}
+	catch (...) {
+		l.lock();
+		ethash.m_lightBuilding.erase(_seedHash);
+		l.unlock();
+		ethash.m_lightBuilt.notify_all();
+		throw;
+	}
+	uint64_t buildMs = duration_cast<milliseconds>(steady_clock::now() - start).count();
+	l.lock();
+	ethash.insertLight(_seedHash, light, buildMs);
+	ethash.m_lightBuilding.erase(_seedHash);
+	l.unlock();
+	ethash.m_lightBuilt.notify_all();
+	return light;
+}
+
+void EthashAux::insertLight(h256 const& _seedHash, LightType const& _light, uint64_t _buildMs)
+{
+	m_lightLru.push_front(_seedHash);
+	m_lights[_seedHash] = LightEntry{_light, m_lightLru.begin()};
+	++m_lightStats.misses;
+	m_lightStats.buildMs += _buildMs;
+	m_lightStats.residentBytes += _light->size;
+
+	// Holders of an evicted cache keep it alive until they let go.
+	while (m_lights.size() > 1 && ((m_lightMaxEntries && m_lights.size() > m_lightMaxEntries) ||
+	                              (m_lightMaxBytes && m_lightStats.residentBytes > m_lightMaxBytes))) {
+		auto victim = m_lights.find(m_lightLru.back());
+		m_lightStats.residentBytes -= victim->second.light->size;
+		++m_lightStats.evictions;
+		m_lights.erase(victim);
+		m_lightLru.pop_back();
+	}
+	m_lightStats.entries = m_lights.size();
+}
+
+void EthashAux::setLightLimits(unsigned _maxEntries, uint64_t _maxBytes)
+{
+	EthashAux& ethash = EthashAux::get();
+	Guard l(ethash.x_lights);
+	ethash.m_lightMaxEntries = _maxEntries;
+	ethash.m_lightMaxBytes = _maxBytes;
+}
+
+LightCacheStats EthashAux::lightStats()
+{
 	EthashAux& ethash = EthashAux::get();
 	Guard l(ethash.x_lights);
-	if (ethash.m_lights.count(_seedHash))
-		return ethash.m_lights.at(_seedHash);
-	return (ethash.m_lights[_seedHash] = make_shared<LightAllocation>(_seedHash));
+	return ethash.m_lightStats;
+}
+
+void EthashAux::setLookahead(unsigned _blocks)
+{
+	EthashAux& ethash = EthashAux::get();
+	Guard l(ethash.x_lookahead);
+	ethash.m_lookaheadBlocks = _blocks;
+}
+
+void EthashAux::lookahead(h256 const& _seedHash, int64_t _block)
+{
+	EthashAux& ethash = EthashAux::get();
+	Guard l(ethash.x_lookahead);
+	if (!ethash.m_lookaheadBlocks)
+		return;
+	int64_t epoch;
+	try {
+		epoch = number(_seedHash) / ETHASH_EPOCH_LENGTH;
+	}
+	catch (std::exception const&) {
+		return;
+	}
+	if (epoch < ethash.m_lookaheadEpoch)
+		return;
+	if (_block >= 0 && (epoch + 1) * ETHASH_EPOCH_LENGTH - _block > ethash.m_lookaheadBlocks)
+		return;
+	if (ethash.m_lookaheadEpoch == epoch + 1)
+		return;
+	ethash.m_lookaheadEpoch = epoch + 1;
+	// Called from the network threads, a build still running from the last request is not waited for.
+	ethash.m_lookaheadSeed = seedHash((epoch + 1) * ETHASH_EPOCH_LENGTH);
+	ethash.m_lookaheadPending = true;
+	if (!ethash.m_lookahead.joinable())
+		ethash.m_lookahead = thread(lookaheadLoop);
+	ethash.m_lookaheadRequested.notify_one();
+}
+
+void EthashAux::lookaheadLoop()
+{
+	EthashAux& ethash = EthashAux::get();
+	while (true) {
+		h256 seed;
+		{
+			unique_lock<mutex> l(ethash.x_lookahead);
+			ethash.m_lookaheadRequested.wait(l, [&]() {
+				return ethash.m_lookaheadPending || ethash.m_lookaheadStop;
+			});
+			if (ethash.m_lookaheadStop)
+				return;
+			seed = ethash.m_lookaheadSeed;
+			ethash.m_lookaheadPending = false;
+		}
+		prefetchLight(seed);
+	}
+}
+
+void EthashAux::prefetchLight(h256 _seedHash)
+{
+	EthashAux& ethash = EthashAux::get();
+	{
+		Guard l(ethash.x_lights);
+		if (ethash.m_lights.count(_seedHash) || ethash.m_lightBuilding.count(_seedHash))
+			return;
+		ethash.m_lightBuilding.insert(_seedHash);
+		// Stay out of the way of the miner and network threads, until someone waits for the cache.
+		sched_param param = {};
+		pthread_setschedparam(pthread_self(), SCHED_IDLE, &param);
+		ethash.m_prefetching = true;
+		ethash.m_prefetchSeed = _seedHash;
+		ethash.m_prefetchThread = pthread_self();
+	}
+	LightType light;
+	auto start = steady_clock::now();
+	try {
+		light = make_shared<LightAllocation>(_seedHash);
+	}
+	catch (std::exception const& e) {
+		logwarn("Look-ahead light cache failed: " << e.what());
+	}
+	uint64_t buildMs = duration_cast<milliseconds>(steady_clock::now() - start).count();
+	{
+		Guard l(ethash.x_lights);
+		if (light)
+			ethash.insertLight(_seedHash, light, buildMs);
+		ethash.m_lightBuilding.erase(_seedHash);
+		ethash.m_prefetching = false;
+	}
+	ethash.m_lightBuilt.notify_all();
+	if (light)
+		loginfo("Light cache for next epoch " << EthashAux::number(_seedHash) / ETHASH_EPOCH_LENGTH << " ready in " <<
+		        buildMs << " ms");
+}
+
+EthashAux::FullType EthashAux::full(h256 const& _seedHash)
+{
+	EthashAux& ethash = EthashAux::get();
+	Guard l(ethash.x_fulls);
+	if (ethash.m_full && ethash.m_fullSeed == _seedHash)
+		return ethash.m_full;
+	// Drop the previous epoch first, two full DAGs rarely fit in host memory. A save still
+	// running holds it too.
+	ethash.m_full.reset();
+	if (ethash.m_fullSaver.joinable())
+		ethash.m_fullSaver.join();
+	ethash.m_full = make_shared<FullAllocation>(light(_seedHash)->light);
+	ethash.m_fullSeed = _seedHash;
+	ethash.m_fullLoads = 0;
+	// Hand the DAG out now and write it to the store behind the miners' backs.
+	if (!ethash.m_full->stored && EthashStore::enabled(EthashStore::Kind::Full)) {
+		FullType full = ethash.m_full;
+		ethash.m_fullSaver = thread([full]() {
+			EthashStore::save(EthashStore::Kind::Full, full->epoch, full->data().data(), full->size);
+		});
+	}
+	return ethash.m_full;
+}
+
+void EthashAux::setFullLoaders(unsigned _loaders)
+{
+	EthashAux& ethash = EthashAux::get();
+	Guard l(ethash.x_fulls);
+	ethash.m_fullLoaders = _loaders;
+}
+
+bool EthashAux::fullLoaded(h256 const& _seedHash)
+{
+	EthashAux& ethash = EthashAux::get();
+	Guard l(ethash.x_fulls);
+	// A late upload of an older epoch must not count against the current one.
+	if (!ethash.m_full || ethash.m_fullSeed != _seedHash)
+		return false;
+	if (++ethash.m_fullLoads < ethash.m_fullLoaders)
+		return false;
+	ethash.m_full.reset();
+	ethash.m_fullSeed = h256();
+	return true;
 }
 
 EthashAux::LightAllocation::LightAllocation(h256 const& _seedHash)
 {
 	uint64_t blockNumber = EthashAux::number(_seedHash);
-	light = ethash_light_new(blockNumber);
+	unsigned epoch = blockNumber / ETHASH_EPOCH_LENGTH;
+	size = ethash_get_cachesize(blockNumber);
+	stored = EthashStore::load(EthashStore::Kind::Light, epoch, size);
+	if (stored) {
+		light = ethash_light_new_external(blockNumber, stored->data());
+		loginfo("Loaded light cache of epoch " << epoch << " from the DAG store");
+	} else {
+		light = ethash_light_new(blockNumber);
+		if (light)
+			EthashStore::save(EthashStore::Kind::Light, epoch, light->cache, size);
+	}
 	if (!light) {
 		loginfo("Light creation error.");
 		throw runtime_error("Light");
 	}
-	size = ethash_get_cachesize(blockNumber);
 }
 
 EthashAux::LightAllocation::~LightAllocation()
 {
+	// The handler may point into the mapping, release it first.
 	ethash_light_delete(light);
+	stored.reset();
 }
 
 bytesConstRef EthashAux::LightAllocation::data() const
@@ -97,6 +425,51 @@ Result EthashAux::LightAllocation::compute(h256 const& _headerHash, uint64_t _no
 	return Result{h256((uint8_t*)&r.result, h256::ConstructFromPointer), h256((uint8_t*)&r.mix_hash, h256::ConstructFromPointer)};
 }
 
+static int fullProgress(unsigned _progress)
+{
+	if (_progress % 10 == 0)
+		loginfo("Generating host DAG: " << _progress << '%');
+	return 0;
+}
+
+EthashAux::FullAllocation::FullAllocation(ethash_light_t _light)
+{
+	epoch = _light->block_number / ETHASH_EPOCH_LENGTH;
+	size = ethash_get_datasize(_light->block_number);
+	stored = EthashStore::load(EthashStore::Kind::Full, epoch, size);
+	if (stored) {
+		full = ethash_full_new_external(size, stored->data());
+		loginfo("Loaded full DAG of epoch " << epoch << " from the DAG store");
+	} else {
+		full = ethash_full_new(_light, 0, fullProgress);
+	}
+	if (!full) {
+		loginfo("Full DAG creation error.");
+		throw runtime_error("Full");
+	}
+}
+
+EthashAux::FullAllocation::~FullAllocation()
+{
+	ethash_full_delete(full);
+	stored.reset();
+}
+
+bytesConstRef EthashAux::FullAllocation::data() const
+{
+	return bytesConstRef((byte const*)ethash_full_dag(full), size);
+}
+
+Result EthashAux::FullAllocation::compute(h256 const& _headerHash, uint64_t _nonce) const
+{
+	ethash_return_value r = ethash_full_compute(full, *(ethash_h256_t*)_headerHash.data(), _nonce);
+	if (!r.success) {
+		loginfo("DAG compute error.");
+		throw runtime_error("DAG");
+	}
+	return Result{h256((uint8_t*)&r.result, h256::ConstructFromPointer), h256((uint8_t*)&r.mix_hash, h256::ConstructFromPointer)};
+}
+
 Result EthashAux::eval(h256 const& _seedHash, h256 const& _headerHash, uint64_t _nonce) noexcept
 {
 	try {
@@ -107,3 +480,25 @@ Result EthashAux::eval(h256 const& _seedHash, h256 const& _headerHash, uint64_t
 		return Result{~h256(), h256()};
 	}
 }
+
+vector<Result> EthashAux::evalBatch(h256 const& _seedHash, h256 const& _headerHash,
+                                    vector_ref<uint64_t const> _nonces) noexcept
+{
+	vector<Result> results(_nonces.size(), Result{~h256(), h256()});
+	try {
+		LightType l = get().light(_seedHash);
+		if (_nonces.size() == 1) {
+			results[0] = l->compute(_headerHash, _nonces[0]);
+			return results;
+		}
+		static EvalPool s_pool;
+		s_pool.run(_nonces.size(), [&](unsigned i) {
+			try {
+				results[i] = l->compute(_headerHash, _nonces[i]);
+			}
+			catch (std::exception const&) {}
+		});
+	}
+	catch (std::exception const&) {}
+	return results;
+}
@@ -5,10 +5,15 @@
 #pragma once
 
 #include <condition_variable>
+#include <list>
+#include <pthread.h>
+#include <thread>
+#include <unordered_set>
 #include <libethash/ethash.h>
 #include <libdevcore/Worker.h>
 #include <libdevcore/Common.h>
 #include <libdevcore/SHA3.h>
+#include "EthashStore.h"
 
 
 namespace dev
@@ -21,6 +26,16 @@ struct Result {
 	h256 mixHash;
 };
 
+/// Counters of the light cache LRU, see EthashAux::lightStats().
+struct LightCacheStats {
+	uint64_t hits = 0;
+	uint64_t misses = 0;          ///< lookups that had to build (or load) a cache
+	uint64_t evictions = 0;
+	uint64_t buildMs = 0;         ///< total time spent building caches
+	uint64_t residentBytes = 0;   ///< cache memory held by the LRU
+	unsigned entries = 0;
+};
+
 class EthashAux
 {
 public:
@@ -31,25 +46,98 @@ public:
 		Result compute(h256 const& _headerHash, uint64_t _nonce) const;
 		ethash_light_t light;
 		uint64_t size;
+		EthashStore::MappingPtr stored;   ///< backing memory when loaded from the DAG store
+	};
+
+	struct FullAllocation {
+		FullAllocation(ethash_light_t _light);
+		~FullAllocation();
+		bytesConstRef data() const;
+		Result compute(h256 const& _headerHash, uint64_t _nonce) const;
+		ethash_full_t full;
+		unsigned epoch;
+		uint64_t size;
+		EthashStore::MappingPtr stored;   ///< backing memory when loaded from the DAG store
 	};
 
 	using LightType = std::shared_ptr<LightAllocation>;
+	using FullType = std::shared_ptr<FullAllocation>;
 
 	static h256 seedHash(unsigned _number);
 	static uint64_t number(h256 const& _seedHash);
 
 	static LightType light(h256 const& _seedHash);
+	/// Bound the light caches kept around. The most recent one is always kept, 0 means no limit.
+	static void setLightLimits(unsigned _maxEntries, uint64_t _maxBytes);
+	static LightCacheStats lightStats();
+	/// Host resident copy of the full DAG. Only the most recent epoch is kept.
+	static FullType full(h256 const& _seedHash);
+	/// Devices uploading the host DAG (DAG_LOAD_MODE_SINGLE) across all sealer types.
+	static void setFullLoaders(unsigned _loaders);
+	/// A device uploaded the host DAG of @a _seedHash. Counted per epoch, the cached copy is
+	/// dropped once every loader has it. Returns true if this call dropped it.
+	static bool fullLoaded(h256 const& _seedHash);
+
+	/// Distance in blocks to the next epoch at which its light cache is built ahead of time. 0 disables.
+	static void setLookahead(unsigned _blocks);
+	/// Build the light cache following @a _seedHash on an idle priority thread when the boundary is near.
+	/// @a _block is the current block number, -1 when the pool does not report it (then always prefetch).
+	/// Only hands the request to that thread, never waits for a build.
+	static void lookahead(h256 const& _seedHash, int64_t _block);
 
 	static Result eval(h256 const& _seedHash, h256 const& _headerHash, uint64_t  _nonce) noexcept;
+	/// Verify several nonces of the same work at once, spread over a small pool of threads.
+	/// Results come back in the order of @a _nonces.
+	static std::vector<Result> evalBatch(h256 const& _seedHash, h256 const& _headerHash,
+	                                     vector_ref<uint64_t const> _nonces) noexcept;
 
 private:
 	EthashAux() = default;
+	~EthashAux();
 	static EthashAux& get();
+	static void lookaheadLoop();
+	static void prefetchLight(h256 _seedHash);
+	/// Insert a freshly built cache as most recently used and evict past the limits. x_lights must be held.
+	void insertLight(h256 const& _seedHash, LightType const& _light, uint64_t _buildMs);
+
+	struct LightEntry {
+		LightType light;
+		std::list<h256>::iterator lru;
+	};
 
 	mutable std::mutex x_lights;
-	std::unordered_map<h256, LightType> m_lights;
-
-	mutable std::mutex x_epochs;
+	std::unordered_map<h256, LightEntry> m_lights;
+	std::list<h256> m_lightLru;   ///< most recently used first
+	unsigned m_lightMaxEntries = 3;
+	uint64_t m_lightMaxBytes = 0;
+	LightCacheStats m_lightStats;
+	std::condition_variable m_lightBuilt;
+	std::unordered_set<h256> m_lightBuilding;   ///< caches being built outside x_lights
+
+	// The look-ahead thread's build, x_lights guarded. A caller waiting for it raises its priority.
+	bool m_prefetching = false;
+	h256 m_prefetchSeed;
+	pthread_t m_prefetchThread;
+
+	std::mutex x_lookahead;
+	std::condition_variable m_lookaheadRequested;
+	std::thread m_lookahead;      ///< started on the first request, then waits for the next one
+	unsigned m_lookaheadBlocks = 0;
+	int64_t m_lookaheadEpoch = -1;
+	h256 m_lookaheadSeed;
+	bool m_lookaheadPending = false;
+	bool m_lookaheadStop = false;
+
+	mutable std::mutex x_fulls;
+	h256 m_fullSeed;
+	FullType m_full;
+	unsigned m_fullLoaders = 0;
+	unsigned m_fullLoads = 0;
+	std::thread m_fullSaver;      ///< writes a freshly built DAG to the store, holding its own FullType
+
+	/// Seed hash <-> epoch tables, built once on first use and read without locking after that.
+	static EthashAux const& epochs();
+	std::once_flag m_epochsBuilt;
 	std::unordered_map<h256, unsigned> m_epochs;
 	h256s m_seedHashes;
 };
@@ -70,6 +158,8 @@ struct WorkPackage {
 	h256 header;    ///< When h256() means "pause until notified a new work package is available".
 	h256 seed;
 	h256 job;
+	int64_t block = -1;    ///< Block number if the pool reports it, -1 otherwise.
+	unsigned connection = 0;    ///< Index of the pool connection the work came from.
 
 	uint64_t startNonce = 0;
 	int exSizeBits = -1;
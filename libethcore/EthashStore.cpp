@@ -0,0 +1,221 @@
+/*  Blah, blah, blah.. all this pedantic nonsense to say that this
+    source code is made available under the terms and conditions
+    of the accompanying GNU General Public License */
+
+#include "EthashStore.h"
+#include <cerrno>
+#include <cstring>
+#include <sstream>
+#include <dirent.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <libethash/ethash.h>
+#include <libdevcore/Log.h>
+
+using namespace std;
+using namespace dev;
+using namespace eth;
+
+namespace
+{
+
+char const c_magic[8] = {'E', 'T', 'H', 'S', 'T', 'O', 'R', 'E'};
+uint32_t const c_formatVersion = 1;
+
+// 64 bytes so the payload keeps the node alignment ethash expects.
+struct StoreHeader {
+	char magic[8];
+	uint32_t format;
+	uint32_t revision;
+	uint32_t kind;
+	uint32_t epoch;
+	uint64_t size;
+	uint64_t checksum;
+	uint8_t reserved[24];
+};
+static_assert(sizeof(StoreHeader) == 64, "store header must stay 64 bytes");
+
+// FNV-1a over 64 bit words, the sizes ethash produces are always multiples of 64 bytes.
+uint64_t checksum(void const* _data, uint64_t _size)
+{
+	uint64_t const* words = (uint64_t const*)_data;
+	uint64_t h = 0xcbf29ce484222325ULL;
+	for (uint64_t i = 0; i < _size / sizeof(uint64_t); ++i)
+		h = (h ^ words[i]) * 0x100000001b3ULL;
+	return h;
+}
+
+bool writeAll(int _fd, void const* _data, uint64_t _size)
+{
+	char const* p = (char const*)_data;
+	while (_size) {
+		ssize_t n = ::write(_fd, p, _size);
+		if (n < 0) {
+			if (errno == EINTR)
+				continue;
+			return false;
+		}
+		p += n;
+		_size -= n;
+	}
+	return true;
+}
+
+}
+
+mutex EthashStore::s_lock;
+string EthashStore::s_dir;
+bool EthashStore::s_storeFull = false;
+unsigned EthashStore::s_newest[2] = {0, 0};
+
+EthashStore::Mapping::Mapping(void* _base, uint64_t _length, uint64_t _offset):
+	m_base(_base), m_length(_length), m_offset(_offset)
+{
+}
+
+EthashStore::Mapping::~Mapping()
+{
+	munmap(m_base, m_length);
+}
+
+void EthashStore::configure(string const& _dir, bool _storeFull)
+{
+	lock_guard<mutex> l(s_lock);
+	s_dir = _dir;
+	while (s_dir.size() > 1 && s_dir.back() == '/')
+		s_dir.pop_back();
+	s_storeFull = _storeFull;
+	if (!s_dir.empty() && mkdir(s_dir.c_str(), 0755) && errno != EEXIST)
+		logwarn("DAG store: can't create " << s_dir << ": " << strerror(errno));
+}
+
+bool EthashStore::enabled(Kind _kind)
+{
+	lock_guard<mutex> l(s_lock);
+	return !s_dir.empty() && (_kind == Kind::Light || s_storeFull);
+}
+
+string EthashStore::prefix(Kind _kind)
+{
+	return (_kind == Kind::Light ? "light-R" : "full-R") + to_string(ETHASH_REVISION) + "-";
+}
+
+string EthashStore::path(Kind _kind, unsigned _epoch)
+{
+	lock_guard<mutex> l(s_lock);
+	return s_dir + "/" + prefix(_kind) + to_string(_epoch);
+}
+
+void EthashStore::prune(Kind _kind, unsigned _first)
+{
+	string dir;
+	{
+		lock_guard<mutex> l(s_lock);
+		dir = s_dir;
+	}
+	DIR* d = opendir(dir.c_str());
+	if (!d)
+		return;
+	string p = prefix(_kind);
+	while (dirent* e = readdir(d)) {
+		string name = e->d_name;
+		// Temporary files of a write in progress carry a suffix and are left alone.
+		if (name.compare(0, p.size(), p) || name.size() == p.size() ||
+		        name.find_first_not_of("0123456789", p.size()) != string::npos)
+			continue;
+		unsigned long epoch = strtoul(name.c_str() + p.size(), nullptr, 10);
+		if (epoch >= _first)
+			continue;
+		string file = dir + "/" + name;
+		if (unlink(file.c_str())) {
+			logwarn("DAG store: can't remove " << file << ": " << strerror(errno));
+			continue;
+		}
+		loginfo("DAG store: removed " << file);
+	}
+	closedir(d);
+}
+
+EthashStore::MappingPtr EthashStore::load(Kind _kind, unsigned _epoch, uint64_t _size)
+{
+	if (!enabled(_kind))
+		return nullptr;
+	string file = path(_kind, _epoch);
+	int fd = ::open(file.c_str(), O_RDONLY);
+	if (fd < 0)
+		return nullptr;
+	struct stat st;
+	uint64_t length = sizeof(StoreHeader) + _size;
+	if (fstat(fd, &st) || (uint64_t)st.st_size != length) {
+		::close(fd);
+		logwarn("DAG store: ignoring " << file << ", unexpected size");
+		return nullptr;
+	}
+	void* base = mmap(nullptr, length, PROT_READ, MAP_PRIVATE | MAP_POPULATE, fd, 0);
+	::close(fd);
+	if (base == MAP_FAILED) {
+		logwarn("DAG store: can't map " << file << ": " << strerror(errno));
+		return nullptr;
+	}
+	auto mapping = make_shared<Mapping>(base, length, sizeof(StoreHeader));
+
+	StoreHeader const& h = *(StoreHeader const*)base;
+	if (memcmp(h.magic, c_magic, sizeof(c_magic)) || h.format != c_formatVersion || h.revision != ETHASH_REVISION ||
+	        h.kind != (uint32_t)_kind || h.epoch != _epoch || h.size != _size) {
+		logwarn("DAG store: ignoring " << file << ", stale header");
+		return nullptr;
+	}
+	if (h.checksum != checksum(mapping->data(), _size)) {
+		logwarn("DAG store: ignoring " << file << ", checksum mismatch");
+		return nullptr;
+	}
+	return mapping;
+}
+
+void EthashStore::save(Kind _kind, unsigned _epoch, void const* _data, uint64_t _size)
+{
+	if (!enabled(_kind))
+		return;
+	string file = path(_kind, _epoch);
+	string tmp = file + ".tmp" + to_string(getpid());
+
+	StoreHeader h;
+	memset(&h, 0, sizeof(h));
+	memcpy(h.magic, c_magic, sizeof(c_magic));
+	h.format = c_formatVersion;
+	h.revision = ETHASH_REVISION;
+	h.kind = (uint32_t)_kind;
+	h.epoch = _epoch;
+	h.size = _size;
+	h.checksum = checksum(_data, _size);
+
+	int fd = ::open(tmp.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+	if (fd < 0) {
+		logwarn("DAG store: can't create " << tmp << ": " << strerror(errno));
+		return;
+	}
+	bool ok = writeAll(fd, &h, sizeof(h)) && writeAll(fd, _data, _size) && fsync(fd) == 0;
+	ok = ::close(fd) == 0 && ok;
+	if (!ok || rename(tmp.c_str(), file.c_str())) {
+		logwarn("DAG store: can't write " << file << ": " << strerror(errno));
+		unlink(tmp.c_str());
+		return;
+	}
+	loginfo("DAG store: saved " << file);
+
+	// Prune on epoch advance only, so an older blob written later (a stale share check) removes nothing.
+	{
+		lock_guard<mutex> l(s_lock);
+		if (_epoch <= s_newest[(uint32_t)_kind])
+			return;
+		s_newest[(uint32_t)_kind] = _epoch;
+	}
+	// Full DAGs are only written for the epoch being mined. Light caches are also built ahead of
+	// the boundary, so the epoch before the one written may still be current.
+	if (_kind == Kind::Full)
+		prune(_kind, _epoch);
+	else
+		prune(_kind, _epoch ? _epoch - 1 : 0);
+}
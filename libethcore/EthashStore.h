@@ -0,0 +1,70 @@
+/*  Blah, blah, blah.. all this pedantic nonsense to say that this
+    source code is made available under the terms and conditions
+    of the accompanying GNU General Public License */
+
+#pragma once
+
+#include <memory>
+#include <mutex>
+#include <string>
+
+namespace dev
+{
+namespace eth
+{
+
+/// Epoch keyed on-disk store for light caches and full DAGs (--dag-dir).
+/// Blobs carry a versioned header with a checksum and are mapped read only on load.
+/// A directory is assumed to serve a single chain: blobs are keyed on the epoch alone, and
+/// the epochs another chain left behind the one being mined get pruned.
+class EthashStore
+{
+public:
+	enum class Kind: uint32_t {
+		Light = 0,
+		Full = 1
+	};
+
+	/// Read only mapping of a stored blob, unmapped when the last reference goes.
+	class Mapping
+	{
+	public:
+		Mapping(void* _base, uint64_t _length, uint64_t _offset);
+		~Mapping();
+		void* data() const
+		{
+			return (char*)m_base + m_offset;
+		}
+
+	private:
+		void* m_base;
+		uint64_t m_length;
+		uint64_t m_offset;
+	};
+	using MappingPtr = std::shared_ptr<Mapping>;
+
+	/// Enable the store. An empty directory disables it.
+	static void configure(std::string const& _dir, bool _storeFull);
+	static bool enabled(Kind _kind);
+
+	/// The blob for @a _epoch, or nullptr if it is missing, stale or corrupt.
+	static MappingPtr load(Kind _kind, unsigned _epoch, uint64_t _size);
+	/// Persist a blob through a temporary file renamed into place. Failures are only logged.
+	/// When @a _epoch is the newest written so far, blobs of the same kind for older epochs that
+	/// won't be used again are deleted. Epochs ahead are never touched.
+	static void save(Kind _kind, unsigned _epoch, void const* _data, uint64_t _size);
+
+private:
+	static std::string prefix(Kind _kind);
+	static std::string path(Kind _kind, unsigned _epoch);
+	/// Delete the blobs of @a _kind for epochs before @a _first.
+	static void prune(Kind _kind, unsigned _first);
+
+	static std::mutex s_lock;
+	static std::string s_dir;
+	static bool s_storeFull;
+	static unsigned s_newest[2];   ///< newest epoch written per kind
+};
+
+}
+}
@@ -8,8 +8,12 @@
 #include <boost/bind.hpp>
 #include <thread>
 #include <list>
+#include <array>
+#include <libdevcore/bounded_queue.h>
 #include <libdevcore/Common.h>
 #include <libdevcore/Worker.h>
+#include <libethcore/HashrateSampler.h>
+#include <libethcore/HwMonitorPoller.h>
 #include <libethcore/Miner.h>
 #include <libhwmon/wrapnvml.h>
 #include <libhwmon/wrapadl.h>
@@ -42,11 +46,14 @@ public:
 		adlh = wrap_adl_create();
 		sysfsh = wrap_amdsysfs_create();
 		nvmlh = wrap_nvml_create();
+		m_hwmon.reset(new HwMonitorPoller(nvmlh, adlh, sysfsh));
 	}
 
 	~Farm()
 	{
-		// Deinit HWMON
+		m_hashrates.stop();
+		// Deinit HWMON, once nothing reads it
+		m_hwmon.reset();
 		if (adlh)
 			wrap_adl_destroy(adlh);
 		if (sysfsh)
@@ -57,10 +64,14 @@ public:
 
 	void setWork(WorkPackage const& _wp)
 	{
-		// Set work to each miner
-		Guard l(x_minerWork);
-		for (auto const& m : m_miners)
-			m->setWork(_wp);
+		// The miners pick it up on their next batch, nothing is copied per miner.
+		m_publisher.publish(_wp);
+		EthashAux::lookahead(_wp.seed, _wp.block);
+	}
+
+	WorkPublisher const& workPublisher() const override
+	{
+		return m_publisher;
 	}
 
 	void setSealers(std::map<std::string, SealerDescriptor> const& _sealers)
@@ -107,9 +118,35 @@ public:
 
 		m_serviceThread = std::thread{ boost::bind(&boost::asio::io_service::run, &m_io_service) };
 
+		m_hashrates.start([this]() {
+			Guard l(x_minerWork);
+			std::vector<uint64_t> counters;
+			for (auto const& miner : m_miners)
+				counters.push_back(miner->hashCount());
+			return counters;
+		});
+
 		return true;
 	}
 
+	/// Start the sealers of @a _type, CUDA and OpenCL side by side for MinerType::Mixed.
+	bool start(MinerType _type)
+	{
+		switch (_type) {
+		case MinerType::CL:
+			return start("opencl", false);
+		case MinerType::CUDA:
+			return start("cuda", false);
+		case MinerType::CPU:
+			return start("cpu", false);
+		case MinerType::Mixed: {
+			bool cuda = start("cuda", false);
+			return start("opencl", true) || cuda;
+		}
+		}
+		return false;
+	}
+
 	bool isMining() const
 	{
 		return m_isMining;
@@ -120,82 +157,81 @@ public:
 		return m_miners[index]->hwmonInfo();
 	}
 
-	void collectProgress(unsigned level) const
+	/// Hashes since the previous call, for the one caller that reports at an interval of its own.
+	WorkingProgress collectProgress()
 	{
-		Guard l(x_minerWork);
-
-		auto now = std::chrono::steady_clock::now();
-		auto ms = std::chrono::duration_cast<std::chrono::milliseconds>(now - m_lastStart).count();
-		m_lastStart = now;
-
-		m_progress.ms = ms;
-		m_progress.minersHashes.clear();
-		m_progress.minerMonitors.clear();
-		m_progress.hashes = 0;
-		for (auto const& miner : m_miners) {
-			uint64_t minerHashCount = miner->hashCount();
-			m_progress.hashes += minerHashCount;
-			m_progress.minersHashes.push_back(minerHashCount);
-			if (level > 0) {
-				HwMonitorInfo hwInfo = miner->hwmonInfo();
-				HwMonitor hw;
-				unsigned int tempC = 0, fanpcnt = 0, powerW = 0;
-				if (hwInfo.deviceIndex >= 0) {
-					if (hwInfo.deviceType == HwMonitorInfoType::NVIDIA && nvmlh) {
-						int typeidx = 0;
-						if (hwInfo.indexSource == HwMonitorIndexSource::CUDA)
-							typeidx = nvmlh->cuda_nvml_device_id[hwInfo.deviceIndex];
-						else if (hwInfo.indexSource == HwMonitorIndexSource::OPENCL)
-							typeidx = nvmlh->opencl_nvml_device_id[hwInfo.deviceIndex];
-						else {
-							//Unknown, don't map
-							typeidx = hwInfo.deviceIndex;
-						}
-						wrap_nvml_get_tempC(nvmlh, typeidx, &tempC);
-						wrap_nvml_get_fanpcnt(nvmlh, typeidx, &fanpcnt);
-						if (level > 1)
-							wrap_nvml_get_power_usage(nvmlh, typeidx, &powerW);
-					}
-					else if (hwInfo.deviceType == HwMonitorInfoType::AMD && adlh) {
-						int typeidx = 0;
-						if (hwInfo.indexSource == HwMonitorIndexSource::OPENCL)
-							typeidx = adlh->opencl_adl_device_id[hwInfo.deviceIndex];
-						else {
-							//Unknown, don't map
-							typeidx = hwInfo.deviceIndex;
-						}
-						wrap_adl_get_tempC(adlh, typeidx, &tempC);
-						wrap_adl_get_fanpcnt(adlh, typeidx, &fanpcnt);
-						if (level > 1)
-							wrap_adl_get_power_usage(adlh, typeidx, &powerW);
-					}
-					// Overwrite with sysfs data if present
-					if (hwInfo.deviceType == HwMonitorInfoType::AMD && sysfsh) {
-						int typeidx = 0;
-						if (hwInfo.indexSource == HwMonitorIndexSource::OPENCL)
-							typeidx = sysfsh->opencl_sysfs_device_id[hwInfo.deviceIndex];
-						else {
-							//Unknown, don't map
-							typeidx = hwInfo.deviceIndex;
-						}
-						wrap_amdsysfs_get_tempC(sysfsh, typeidx, &tempC);
-						wrap_amdsysfs_get_fanpcnt(sysfsh, typeidx, &fanpcnt);
-						if (level > 1)
-							wrap_amdsysfs_get_power_usage(sysfsh, typeidx, &powerW);
-					}
-				}
-				hw.tempC = tempC;
-				hw.fanP = fanpcnt;
-				hw.powerW = powerW / ((double)1000.0);
-				m_progress.minerMonitors.push_back(hw);
+		WorkingProgress p;
+		{
+			Guard l(x_minerWork);
+			auto now = std::chrono::steady_clock::now();
+			p.ms = std::chrono::duration_cast<std::chrono::milliseconds>(now - m_lastStart).count();
+			m_lastStart = now;
+
+			m_lastHashes.resize(m_miners.size());
+			for (size_t i = 0; i < m_miners.size(); i++) {
+				uint64_t total = m_miners[i]->hashCount();
+				// A miner started over counts from 0 again.
+				uint64_t n = total >= m_lastHashes[i] ? total - m_lastHashes[i] : total;
+				m_lastHashes[i] = total;
+				p.hashes += n;
+				p.minersHashes.push_back(n);
 			}
 		}
+		p.minerMonitors = m_hwmon->snapshot()->monitors;
+		return p;
+	}
+
+	/// Read the devices' temperature, fan and power on a thread of their own, @a _level as for --level.
+	void startHwMonitor(unsigned _level, unsigned _intervalMs)
+	{
+		m_hwmon->start([this]() {
+			// Copied under the lock, the slow reads happen outside of it.
+			Guard l(x_minerWork);
+			std::vector<HwMonitorInfo> devices;
+			for (auto const& miner : m_miners)
+				devices.push_back(miner->hwmonInfo());
+			return devices;
+		}, _level, _intervalMs);
+	}
+
+	/// The last hardware readings, never waits for the devices.
+	std::shared_ptr<HwMonitorPoller::Snapshot const> hwMonitors() const
+	{
+		return m_hwmon->snapshot();
 	}
 
-	WorkingProgress miningProgress()
+	std::vector<MinerTimings> minerTimings() const
 	{
 		Guard l(x_minerWork);
-		return m_progress;
+		std::vector<MinerTimings> timings;
+		for (auto const& miner : m_miners)
+			timings.push_back(miner->timings());
+		return timings;
+	}
+
+	/// The latest sample at resolution @a _r, the same for every caller until the next one is taken.
+	WorkingProgress miningProgress(HashrateSampler::Resolution _r = HashrateSampler::TenSeconds) const
+	{
+		WorkingProgress p;
+		HashrateSampler::Sample s = m_hashrates.last(_r);
+		p.ms = s.ms;
+		p.minersHashes = s.hashes;
+		for (auto h : s.hashes)
+			p.hashes += h;
+		{
+			// Every miner shows up, sampled or not.
+			Guard l(x_minerWork);
+			if (p.minersHashes.size() < m_miners.size())
+				p.minersHashes.resize(m_miners.size());
+		}
+		p.minerMonitors = m_hwmon->snapshot()->monitors;
+		return p;
+	}
+
+	/// Hashrate history of the miners, readable from any thread without disturbing the others.
+	HashrateSampler const& hashrates() const
+	{
+		return m_hashrates;
 	}
 
 	SolutionStats getSolutionStats()
@@ -228,6 +264,37 @@ public:
 		m_onSolutionFound = _handler;
 	}
 
+	/// Called on a miner thread when solutions are waiting, it has to get drainSolutions() run
+	/// on another thread. Without a handler the miner hands them to onSolutionFound() itself.
+	void onSolutionsQueued(std::function<void()> const& _handler)
+	{
+		m_onSolutionsQueued = _handler;
+	}
+
+	/// Hand the queued solutions to onSolutionFound(), a nonce already seen for the same header is dropped.
+	void drainSolutions()
+	{
+		// Cleared first, a solution queued from here on asks for another drain.
+		m_drainPending.store(false, std::memory_order_seq_cst);
+		Solution s;
+		while (m_solutions.pop(s)) {
+			{
+				Guard l(x_recentSolutions);
+				bool seen = false;
+				for (auto const& r : m_recentSolutions)
+					if (r.first == s.nonce && r.second == s.work.header)
+						seen = true;
+				if (seen) {
+					logwarn(s.gpu << " - duplicate solution 0x" << std::hex << s.nonce << std::dec << " dropped");
+					continue;
+				}
+				m_recentSolutions[m_recentSolution++ % c_recentSolutions] = std::make_pair(s.nonce, s.work.header);
+			}
+			assert(m_onSolutionFound);
+			m_onSolutionFound(s);
+		}
+	}
+
 	std::chrono::steady_clock::time_point farmLaunched()
 	{
 		return m_farm_launched;
@@ -252,11 +319,13 @@ public:
 	{
 		stringstream ssPoolAddresses;
 		ssPoolAddresses << host << ':' << port;
+		Guard l(x_pool_addresses);
 		m_pool_addresses = ssPoolAddresses.str();
 	}
 
 	string get_pool_addresses()
 	{
+		Guard l(x_pool_addresses);
 		return m_pool_addresses;
 	}
 
@@ -268,27 +337,49 @@ public:
 private:
 	void submitProof(Solution const& _s) override
 	{
-		assert(m_onSolutionFound);
-		m_onSolutionFound(_s);
+		// Lock free, the miner goes back to hashing while the network thread submits.
+		if (!m_solutions.push(_s)) {
+			m_solutionStats.failed();
+			return;
+		}
+		if (m_drainPending.exchange(true))
+			return;
+		if (m_onSolutionsQueued)
+			m_onSolutionsQueued();
+		else
+			drainSolutions();
 	}
 
+	static const size_t c_solutionQueue = 64;
+	static const size_t c_recentSolutions = 64;
+
+	WorkPublisher m_publisher;    ///< before the miners, they read it until they're gone
 	std::vector<std::shared_ptr<Miner>> m_miners;
 	bool m_isMining = false;
-	mutable WorkingProgress m_progress;
+	std::vector<uint64_t> m_lastHashes;    ///< as of the last collectProgress()
+	HashrateSampler m_hashrates;    ///< after the miners, it reads them until it's gone
 	SolutionFound m_onSolutionFound;
+	std::function<void()> m_onSolutionsQueued;
+	tp::BoundedQueue<Solution> m_solutions{c_solutionQueue};
+	std::atomic<bool> m_drainPending = {false};
+	std::mutex x_recentSolutions;
+	std::array<std::pair<uint64_t, h256>, c_recentSolutions> m_recentSolutions;
+	unsigned m_recentSolution = 0;
 	std::map<std::string, SealerDescriptor> m_sealers;
 	std::string m_lastSealer;
 	bool b_lastMixed = false;
-	mutable std::chrono::steady_clock::time_point m_lastStart = std::chrono::steady_clock::now();
+	std::chrono::steady_clock::time_point m_lastStart = std::chrono::steady_clock::now();
 	std::thread m_serviceThread;  ///< The IO service thread.
 	boost::asio::io_service m_io_service;
 	mutable SolutionStats m_solutionStats;
 	std::chrono::steady_clock::time_point m_farm_launched = std::chrono::steady_clock::now();
 	string m_pool_addresses;
+	std::mutex x_pool_addresses;    ///< changes when the pool manager fails over
 	uint64_t m_nonce_scrambler;
 	wrap_nvml_handle* nvmlh = NULL;
 	wrap_adl_handle* adlh = NULL;
 	wrap_amdsysfs_handle* sysfsh = NULL;
+	std::unique_ptr<HwMonitorPoller> m_hwmon;
 	static std::mutex x_minerWork;
 };
 
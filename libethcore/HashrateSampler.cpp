@@ -0,0 +1,224 @@
+/*  Blah, blah, blah.. all this pedantic nonsense to say that this
+    source code is made available under the terms and conditions
+    of the accompanying GNU General Public License */
+
+#include <algorithm>
+#include <cmath>
+#include "HashrateSampler.h"
+
+using namespace std;
+using namespace dev;
+using namespace dev::eth;
+
+namespace
+{
+
+// Ring sizes: 15 minutes, 2 hours and 2 days.
+const size_t c_ringSize[HashrateSampler::Resolutions] = {90, 120, 48};
+const unsigned c_period[HashrateSampler::Resolutions] = {10, 60, 3600};
+const char* const c_name[HashrateSampler::Resolutions] = {"10s", "1m", "1h"};
+
+// The EWMA's time constant, in samples.
+const double c_ewmaSamples = 6;
+
+HashrateSampler::Rate rate(vector<uint64_t> const& _rates, uint64_t _ewma)
+{
+	HashrateSampler::Rate r;
+	r.ewma = _ewma;
+	r.p5 = percentile(_rates, 0.05);
+	r.p50 = percentile(_rates, 0.5);
+	r.p95 = percentile(_rates, 0.95);
+	return r;
+}
+
+}
+
+HashrateSampler::HashrateSampler()
+{
+	for (unsigned r = 0; r < Resolutions; r++) {
+		m_rings[r].size = c_ringSize[r];
+		m_rings[r].slots.reset(new Slot[c_ringSize[r]]);
+	}
+}
+
+HashrateSampler::~HashrateSampler()
+{
+	stop();
+}
+
+char const* HashrateSampler::name(Resolution _r)
+{
+	return c_name[_r];
+}
+
+unsigned HashrateSampler::period(Resolution _r)
+{
+	return c_period[_r];
+}
+
+void HashrateSampler::start(Counters const& _counters, unsigned _tickMs)
+{
+	if (m_thread.joinable())
+		return;
+	m_counters = _counters;
+	m_tick = chrono::milliseconds(_tickMs);
+	// Counted from 0, the counters aren't read here since the caller may hold their lock.
+	auto now = chrono::steady_clock::now();
+	for (unsigned r = 0; r < Resolutions; r++) {
+		Ring& ring = m_rings[r];
+		ring.ticks = c_period[r] / c_period[TenSeconds];
+		ring.ticked = 0;
+		ring.base.clear();
+		ring.start = now;
+	}
+	m_stop = false;
+	m_thread = thread(&HashrateSampler::sampleLoop, this);
+}
+
+void HashrateSampler::stop()
+{
+	{
+		unique_lock<mutex> l(x_stop);
+		m_stop = true;
+	}
+	m_stopped.notify_all();
+	if (m_thread.joinable())
+		m_thread.join();
+}
+
+void HashrateSampler::sampleLoop()
+{
+	auto next = chrono::steady_clock::now();
+	while (true) {
+		// On a schedule of its own so the intervals don't drift with the time taken here.
+		next += m_tick;
+		{
+			unique_lock<mutex> l(x_stop);
+			if (m_stopped.wait_until(l, next, [this]() { return m_stop; }))
+				return;
+		}
+		auto now = chrono::steady_clock::now();
+		vector<uint64_t> counters = m_counters();
+		if (counters.size() > MAX_MINERS)
+			counters.resize(MAX_MINERS);
+		for (auto& ring : m_rings)
+			if (++ring.ticked == ring.ticks) {
+				ring.ticked = 0;
+				push(ring, counters, now);
+			}
+	}
+}
+
+void HashrateSampler::push(Ring& _ring, vector<uint64_t> const& _counters, chrono::steady_clock::time_point _now)
+{
+	uint64_t ms = chrono::duration_cast<chrono::milliseconds>(_now - _ring.start).count();
+	if (!ms)
+		return;
+	double alpha = 1 - exp(-(double)ms / (c_ewmaSamples * _ring.ticks * m_tick.count()));
+	bool first = _ring.count.load(memory_order_relaxed) == 0;
+
+	// A counter going back is a miner started over.
+	vector<uint64_t> hashes(_counters.size());
+	_ring.base.resize(_counters.size());
+	_ring.ewma.resize(_counters.size());
+	for (size_t i = 0; i < _counters.size(); i++) {
+		hashes[i] = _counters[i] >= _ring.base[i] ? _counters[i] - _ring.base[i] : _counters[i];
+		double rate = hashes[i] * 1000.0 / ms;
+		_ring.ewma[i] = first ? rate : _ring.ewma[i] + alpha * (rate - _ring.ewma[i]);
+	}
+	_ring.base = _counters;
+	_ring.start = _now;
+
+	// Seqlock write, readers that raced it see the sequence change and drop the slot.
+	uint64_t number = _ring.count.load(memory_order_relaxed) + 1;
+	Slot& slot = _ring.slots[number % _ring.size];
+	uint64_t seq = slot.seq.load(memory_order_relaxed);
+	slot.seq.store(seq + 1, memory_order_relaxed);
+	atomic_thread_fence(memory_order_release);
+	slot.number.store(number, memory_order_relaxed);
+	slot.ms.store(ms, memory_order_relaxed);
+	slot.miners.store(hashes.size(), memory_order_relaxed);
+	for (size_t i = 0; i < hashes.size(); i++) {
+		slot.hashes[i].store(hashes[i], memory_order_relaxed);
+		slot.ewma[i].store(llround(_ring.ewma[i]), memory_order_relaxed);
+	}
+	slot.seq.store(seq + 2, memory_order_release);
+	_ring.count.store(number, memory_order_release);
+}
+
+bool HashrateSampler::read(Ring const& _ring, uint64_t _number, Sample& _s) const
+{
+	Slot const& slot = _ring.slots[_number % _ring.size];
+	while (true) {
+		uint64_t seq = slot.seq.load(memory_order_acquire);
+		if (seq & 1) {
+			this_thread::yield();
+			continue;
+		}
+		uint64_t number = slot.number.load(memory_order_relaxed);
+		_s.ms = slot.ms.load(memory_order_relaxed);
+		unsigned miners = min<unsigned>(slot.miners.load(memory_order_relaxed), MAX_MINERS);
+		_s.hashes.resize(miners);
+		_s.ewma.resize(miners);
+		for (unsigned i = 0; i < miners; i++) {
+			_s.hashes[i] = slot.hashes[i].load(memory_order_relaxed);
+			_s.ewma[i] = slot.ewma[i].load(memory_order_relaxed);
+		}
+		atomic_thread_fence(memory_order_acquire);
+		if (slot.seq.load(memory_order_relaxed) != seq)
+			continue;
+		// Overwritten by a newer sample since the caller looked at the count.
+		return number == _number;
+	}
+}
+
+vector<HashrateSampler::Sample> HashrateSampler::history(Resolution _r, size_t _max) const
+{
+	Ring const& ring = m_rings[_r];
+	uint64_t count = ring.count.load(memory_order_acquire);
+	// The oldest slot is the one written next, leave it alone.
+	uint64_t n = min<uint64_t>({count, ring.size - 1, _max});
+	vector<Sample> samples;
+	samples.reserve(n);
+	Sample s;
+	for (uint64_t number = count - n + 1; number <= count; number++)
+		if (read(ring, number, s))
+			samples.push_back(s);
+	return samples;
+}
+
+HashrateSampler::Sample HashrateSampler::last(Resolution _r) const
+{
+	vector<Sample> samples = history(_r, 1);
+	return samples.empty() ? Sample() : samples.back();
+}
+
+HashrateSampler::Stats HashrateSampler::stats(Resolution _r) const
+{
+	Stats stats;
+	vector<Sample> samples = history(_r);
+	if (samples.empty())
+		return stats;
+	stats.samples = samples.size();
+
+	size_t miners = samples.back().hashes.size();
+	vector<vector<uint64_t>> rates(miners);
+	vector<uint64_t> totals;
+	for (auto const& s : samples) {
+		uint64_t total = 0;
+		for (size_t i = 0; i < s.hashes.size(); i++) {
+			uint64_t r = s.hashes[i] * 1000 / s.ms;
+			total += r;
+			if (i < miners)
+				rates[i].push_back(r);
+		}
+		totals.push_back(total);
+	}
+	uint64_t ewma = 0;
+	for (size_t i = 0; i < miners; i++) {
+		stats.miners.push_back(rate(rates[i], samples.back().ewma[i]));
+		ewma += samples.back().ewma[i];
+	}
+	stats.total = rate(totals, ewma);
+	return stats;
+}
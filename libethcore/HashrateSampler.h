@@ -0,0 +1,121 @@
+/*  Blah, blah, blah.. all this pedantic nonsense to say that this
+    source code is made available under the terms and conditions
+    of the accompanying GNU General Public License */
+
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include <libethcore/Miner.h>
+
+namespace dev
+{
+namespace eth
+{
+
+/// Keeps the miners' hashrate history at 10 second, 1 minute and 1 hour resolution.
+///
+/// A thread of its own turns the miners' hash counters into samples, each written to a
+/// fixed ring slot guarded by a sequence number. Readers copy what they need without
+/// locking or resetting anything, so the CLI, the API and the pool reports each get
+/// the same history no matter how often they ask.
+class HashrateSampler
+{
+public:
+	enum Resolution {
+		TenSeconds,
+		Minute,
+		Hour,
+		Resolutions
+	};
+
+	/// One interval.
+	struct Sample {
+		uint64_t ms = 0;                 ///< length of the interval, 0 for no sample
+		std::vector<uint64_t> hashes;    ///< by miner index
+		std::vector<uint64_t> ewma;      ///< smoothed H/s by miner index, as of the end of the interval
+	};
+
+	/// Rates in H/s.
+	struct Rate {
+		uint64_t ewma = 0;
+		uint64_t p5 = 0;
+		uint64_t p50 = 0;
+		uint64_t p95 = 0;
+	};
+
+	struct Stats {
+		size_t samples = 0;
+		std::vector<Rate> miners;
+		Rate total;
+	};
+
+	/// Every miner's hashes since it started, by miner index.
+	using Counters = std::function<std::vector<uint64_t>()>;
+
+	HashrateSampler();
+	~HashrateSampler();
+
+	/// Start sampling counters that start at 0, @a _tickMs is the finest resolution, only shortened
+	/// for testing. Does nothing when running.
+	void start(Counters const& _counters, unsigned _tickMs = 10000);
+	void stop();
+
+	/// Up to @a _max of the latest samples, oldest first.
+	std::vector<Sample> history(Resolution _r, size_t _max = SIZE_MAX) const;
+	/// The latest sample, ms is 0 before the first one.
+	Sample last(Resolution _r) const;
+	/// EWMA as of the latest sample and percentiles over the ring.
+	Stats stats(Resolution _r) const;
+
+	static char const* name(Resolution _r);
+	/// Seconds per sample.
+	static unsigned period(Resolution _r);
+
+private:
+	struct Slot {
+		std::atomic<uint64_t> seq = {0};       ///< odd while written
+		std::atomic<uint64_t> number = {0};    ///< of the sample held, from 1
+		std::atomic<uint64_t> ms = {0};
+		std::atomic<unsigned> miners = {0};
+		std::atomic<uint64_t> hashes[MAX_MINERS];
+		std::atomic<uint64_t> ewma[MAX_MINERS];
+	};
+
+	struct Ring {
+		std::unique_ptr<Slot[]> slots;
+		size_t size = 0;
+		std::atomic<uint64_t> count = {0};    ///< samples written
+
+		// Sampler thread only.
+		unsigned ticks = 0;                   ///< per sample
+		unsigned ticked = 0;
+		std::vector<uint64_t> base;           ///< counters at the start of the interval
+		std::chrono::steady_clock::time_point start;
+		std::vector<double> ewma;
+	};
+
+	void sampleLoop();
+	void push(Ring& _ring, std::vector<uint64_t> const& _counters, std::chrono::steady_clock::time_point _now);
+	bool read(Ring const& _ring, uint64_t _number, Sample& _s) const;
+
+	Ring m_rings[Resolutions];
+
+	Counters m_counters;
+	std::chrono::milliseconds m_tick;
+
+	std::mutex x_stop;
+	std::condition_variable m_stopped;
+	bool m_stop = false;
+	std::thread m_thread;
+};
+
+}
+}
@@ -0,0 +1,109 @@
+/*  Blah, blah, blah.. all this pedantic nonsense to say that this
+    source code is made available under the terms and conditions
+    of the accompanying GNU General Public License */
+
+#include "HwMonitorPoller.h"
+
+using namespace std;
+using namespace dev;
+using namespace dev::eth;
+
+HwMonitorPoller::HwMonitorPoller(wrap_nvml_handle* _nvml, wrap_adl_handle* _adl, wrap_amdsysfs_handle* _sysfs):
+	m_nvml(_nvml),
+	m_adl(_adl),
+	m_sysfs(_sysfs),
+	m_snapshot(make_shared<Snapshot>())
+{
+}
+
+HwMonitorPoller::~HwMonitorPoller()
+{
+	stop();
+}
+
+void HwMonitorPoller::start(Devices const& _devices, unsigned _level, unsigned _intervalMs)
+{
+	stop();
+	m_devices = _devices;
+	m_level = _level;
+	m_interval = chrono::milliseconds(_intervalMs);
+	m_stop = false;
+	m_thread = thread(&HwMonitorPoller::pollLoop, this);
+}
+
+void HwMonitorPoller::stop()
+{
+	{
+		unique_lock<mutex> l(x_stop);
+		m_stop = true;
+	}
+	m_stopped.notify_all();
+	if (m_thread.joinable())
+		m_thread.join();
+}
+
+void HwMonitorPoller::pollLoop()
+{
+	while (true) {
+		auto s = make_shared<Snapshot>();
+		for (auto const& info : m_devices())
+			s->monitors.push_back(sample(info));
+		s->taken = chrono::steady_clock::now();
+		atomic_store_explicit(&m_snapshot, shared_ptr<Snapshot const>(s), memory_order_release);
+
+		unique_lock<mutex> l(x_stop);
+		if (m_stopped.wait_for(l, m_interval, [this]() { return m_stop; }))
+			return;
+	}
+}
+
+HwMonitor HwMonitorPoller::sample(HwMonitorInfo const& _info) const
+{
+	HwMonitor hw;
+	unsigned int tempC = 0, fanpcnt = 0, powerW = 0;
+	if (_info.deviceIndex >= 0) {
+		if (_info.deviceType == HwMonitorInfoType::NVIDIA && m_nvml) {
+			int typeidx = 0;
+			if (_info.indexSource == HwMonitorIndexSource::CUDA)
+				typeidx = m_nvml->cuda_nvml_device_id[_info.deviceIndex];
+			else if (_info.indexSource == HwMonitorIndexSource::OPENCL)
+				typeidx = m_nvml->opencl_nvml_device_id[_info.deviceIndex];
+			else {
+				//Unknown, don't map
+				typeidx = _info.deviceIndex;
+			}
+			wrap_nvml_get_tempC(m_nvml, typeidx, &tempC);
+			wrap_nvml_get_fanpcnt(m_nvml, typeidx, &fanpcnt);
+			if (m_level > 1)
+				wrap_nvml_get_power_usage(m_nvml, typeidx, &powerW);
+		}
+		else if (_info.deviceType == HwMonitorInfoType::AMD && m_adl) {
+			int typeidx = 0;
+			if (_info.indexSource == HwMonitorIndexSource::OPENCL)
+				typeidx = m_adl->opencl_adl_device_id[_info.deviceIndex];
+			else {
+				//Unknown, don't map
+				typeidx = _info.deviceIndex;
+			}
+			wrap_adl_get_tempC(m_adl, typeidx, &tempC);
+			wrap_adl_get_fanpcnt(m_adl, typeidx, &fanpcnt);
+			if (m_level > 1)
+				wrap_adl_get_power_usage(m_adl, typeidx, &powerW);
+		}
+		// Overwrite with sysfs data if present
+		if (_info.deviceType == HwMonitorInfoType::AMD && m_sysfs) {
+			int typeidx = 0;
+			if (_info.indexSource == HwMonitorIndexSource::OPENCL)
+				typeidx = m_sysfs->opencl_sysfs_device_id[_info.deviceIndex];
+			else {
+				//Unknown, don't map
+				typeidx = _info.deviceIndex;
+			}
+			wrap_amdsysfs_get_readings(m_sysfs, typeidx, &tempC, &fanpcnt, m_level > 1 ? &powerW : nullptr);
+		}
+	}
+	hw.tempC = tempC;
+	hw.fanP = fanpcnt;
+	hw.powerW = powerW / ((double)1000.0);
+	return hw;
+}
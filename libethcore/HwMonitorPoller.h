@@ -0,0 +1,73 @@
+/*  Blah, blah, blah.. all this pedantic nonsense to say that this
+    source code is made available under the terms and conditions
+    of the accompanying GNU General Public License */
+
+#pragma once
+
+#include <chrono>
+#include <condition_variable>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include <libethcore/Miner.h>
+#include <libhwmon/wrapnvml.h>
+#include <libhwmon/wrapadl.h>
+#include <libhwmon/wrapamdsysfs.h>
+
+namespace dev
+{
+namespace eth
+{
+
+/// Reads temperature, fan and power of the miners' devices on its own thread.
+///
+/// Driver and sysfs calls can take milliseconds per device, so nobody else waits on
+/// them: each round publishes a timestamped snapshot that readers take without blocking.
+class HwMonitorPoller
+{
+public:
+	struct Snapshot {
+		std::vector<HwMonitor> monitors;    ///< by miner index
+		std::chrono::steady_clock::time_point taken;
+	};
+	/// The devices to read, asked for every round since miners fill them in as they start.
+	using Devices = std::function<std::vector<HwMonitorInfo>()>;
+
+	/// The handles may be null and must outlive the poller.
+	HwMonitorPoller(wrap_nvml_handle* _nvml, wrap_adl_handle* _adl, wrap_amdsysfs_handle* _sysfs);
+	~HwMonitorPoller();
+
+	/// Poll every @a _intervalMs, @a _level 1 reads temperature and fan, 2 also power.
+	void start(Devices const& _devices, unsigned _level, unsigned _intervalMs);
+	void stop();
+
+	/// The last round, empty before the first one.
+	std::shared_ptr<Snapshot const> snapshot() const
+	{
+		return std::atomic_load_explicit(&m_snapshot, std::memory_order_acquire);
+	}
+
+private:
+	void pollLoop();
+	HwMonitor sample(HwMonitorInfo const& _info) const;
+
+	wrap_nvml_handle* m_nvml;
+	wrap_adl_handle* m_adl;
+	wrap_amdsysfs_handle* m_sysfs;
+
+	Devices m_devices;
+	unsigned m_level = 0;
+	std::chrono::milliseconds m_interval;
+
+	std::mutex x_stop;
+	std::condition_variable m_stopped;
+	bool m_stop = false;
+	std::thread m_thread;
+
+	std::shared_ptr<Snapshot const> m_snapshot;
+};
+
+}
+}
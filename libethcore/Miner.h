@@ -4,10 +4,12 @@
 
 #pragma once
 
+#include <atomic>
+#include <chrono>
+#include <memory>
 #include <thread>
 #include <list>
 #include <string>
-#include <boost/timer.hpp>
 #include <libdevcore/Common.h>
 #include <libdevcore/Worker.h>
 #include <libdevcore/Log.h>
@@ -34,7 +36,8 @@ namespace eth
 enum class MinerType {
 	Mixed,
 	CL,
-	CUDA
+	CUDA,
+	CPU
 };
 
 enum class HwMonitorInfoType {
@@ -170,6 +173,48 @@ inline std::ostream& operator<<(std::ostream& os, SolutionStats s)
 
 class Miner;
 
+/// The current work of the farm, handed to the miners without locking.
+///
+/// Every publish() makes a new immutable snapshot and bumps the generation. A miner
+/// notices new work by comparing the generation with the one it last read, a single
+/// atomic load, and only then takes the snapshot.
+class WorkPublisher
+{
+public:
+	struct Snapshot {
+		WorkPackage work;
+		uint64_t generation = 0;
+		std::chrono::high_resolution_clock::time_point published;
+	};
+
+	WorkPublisher(): m_snapshot(std::make_shared<Snapshot>()) {}
+
+	void publish(WorkPackage const& _work)
+	{
+		auto s = std::make_shared<Snapshot>();
+		s->work = _work;
+		s->published = std::chrono::high_resolution_clock::now();
+		Guard l(x_publish);
+		s->generation = m_generation.load(std::memory_order_relaxed) + 1;
+		std::atomic_store_explicit(&m_snapshot, std::shared_ptr<Snapshot const>(s), std::memory_order_release);
+		m_generation.store(s->generation, std::memory_order_release);
+	}
+
+	uint64_t generation() const
+	{
+		return m_generation.load(std::memory_order_acquire);
+	}
+
+	std::shared_ptr<Snapshot const> snapshot() const
+	{
+		return std::atomic_load_explicit(&m_snapshot, std::memory_order_acquire);
+	}
+
+private:
+	std::mutex x_publish;    ///< orders concurrent publishers, miners never take it
+	std::atomic<uint64_t> m_generation = {0};
+	std::shared_ptr<Snapshot const> m_snapshot;
+};
 
 /**
         @brief Class for hosting one or more Miners.
@@ -189,6 +234,13 @@ public:
 	virtual void submitProof(Solution const& _p) = 0;
 	virtual void failedSolution() = 0;
 	virtual uint64_t get_nonce_scrambler() = 0;
+	virtual WorkPublisher const& workPublisher() const = 0;
+};
+
+/// Load and switch timings of one miner, see Farm::minerTimings().
+struct MinerTimings {
+	uint64_t dagMs = 0;              ///< Duration of the last DAG load.
+	std::vector<float> switchMs;     ///< Most recent job switch latencies, in no particular order.
 };
 
 /**
@@ -205,24 +257,16 @@ public:
 	Miner(std::string const& _name, FarmFace& _farm, size_t _index):
 		Worker(_name + std::to_string(_index)),
 		index(_index),
-		farm(_farm)
+		farm(_farm),
+		m_publisher(_farm.workPublisher())
 	{}
 
 	virtual ~Miner() = default;
 
-	void setWork(WorkPackage const& _work)
-	{
-		{
-			Guard l(x_work);
-			m_work = _work;
-			workSwitchStart = std::chrono::high_resolution_clock::now();
-		}
-		kick_miner();
-	}
-
-	uint64_t hashCount()
+	/// Hashes since the miner started, never reset so any number of readers can take deltas.
+	uint64_t hashCount() const
 	{
-		return m_hashCount.exchange(0, memory_order_relaxed);
+		return m_hashCount.load(memory_order_relaxed);
 	}
 
 	unsigned Index()
@@ -241,14 +285,46 @@ public:
 		return farm.get_nonce_scrambler() + ((uint64_t) index << 40);
 	}
 
+	MinerTimings timings() const
+	{
+		Guard l(x_timings);
+		return m_timings;
+	}
+
 protected:
+	/// Called by the mining loop once it hashes the package of the last work().
+	void workSwitched()
+	{
+		float ms = std::chrono::duration<float, std::milli>(std::chrono::high_resolution_clock::now() -
+		           m_workPublished).count();
+		if (g_logSwitchTime)
+			loginfo(workerName() << " - switch time " << (unsigned)ms << " ms.");
+		Guard l(x_timings);
+		if (m_timings.switchMs.size() < c_switchSamples)
+			m_timings.switchMs.push_back(ms);
+		else
+			m_timings.switchMs[m_switchSample++ % c_switchSamples] = ms;
+	}
+
+	void dagLoaded(uint64_t _ms)
+	{
+		Guard l(x_timings);
+		m_timings.dagMs = _ms;
+	}
 
-	virtual void kick_miner() = 0;
+	/// True once the farm has work newer than the last work(). Cheap enough to poll per batch.
+	bool newWork() const
+	{
+		return m_publisher.generation() != m_generation;
+	}
 
-	WorkPackage work() const
+	/// The farm's current work, shared and never changed, keep it for as long as it's mined.
+	std::shared_ptr<WorkPackage const> work()
 	{
-		Guard l(x_work);
-		return m_work;
+		auto s = m_publisher.snapshot();
+		m_generation = s->generation;
+		m_workPublished = s->published;
+		return std::shared_ptr<WorkPackage const>(s, &s->work);
 	}
 
 	void addHashCount(uint32_t _n)
@@ -258,18 +334,22 @@ protected:
 
 	static unsigned s_dagLoadMode;
 	static unsigned s_dagLoadIndex;
-	static unsigned s_dagCreateDevice;
-	static uint8_t* s_dagInHostMemory;
 
 	const size_t index = 0;
 	FarmFace& farm;
-	std::chrono::high_resolution_clock::time_point workSwitchStart;
 	HwMonitorInfo m_hwmoninfo;
-	mutable std::mutex x_work;
 private:
+	static const unsigned c_switchSamples = 1024;
+
 	std::atomic<uint64_t> m_hashCount = {0};
 
-	WorkPackage m_work;
+	WorkPublisher const& m_publisher;
+	uint64_t m_generation = 0;    ///< of the last work(), miner thread only
+	std::chrono::high_resolution_clock::time_point m_workPublished;
+
+	mutable std::mutex x_timings;
+	MinerTimings m_timings;
+	unsigned m_switchSample = 0;
 };
 
 }
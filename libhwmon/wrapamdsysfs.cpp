@@ -14,14 +14,22 @@
 #include <algorithm>
 #include <fstream>
 #include <sys/types.h>
-#include <regex>
 #if defined(__linux)
 #include <dirent.h>
+#include <fcntl.h>
+#include <unistd.h>
 #endif
 
 #include "wraphelper.h"
 #include "wrapamdsysfs.h"
 
+// Room for the paths under a $MINER_SYSFS_ROOT.
+#define SYSFS_PATH_SIZE 512
+// amdgpu_pm_info is the longest file read, a couple of KB.
+#define SYSFS_BUF_SIZE 8192
+
+static std::string s_root = "/sys";
+
 static bool getFileContentValue(const char* filename, unsigned int& value)
 {
 	value = 0;
@@ -37,17 +45,52 @@ static bool getFileContentValue(const char* filename, unsigned int& value)
 	return (p != p2);
 }
 
+#if defined(__linux)
+static int openAttribute(const char* filename)
+{
+	return open(filename, O_RDONLY | O_CLOEXEC);
+}
+
+// Attributes regenerate their content on every read from offset 0, no need to reopen them.
+static ssize_t readAttribute(wrap_amdsysfs_handle* sysfsh, int fd)
+{
+	if (fd < 0)
+		return -1;
+	ssize_t n = pread(fd, sysfsh->buf, sysfsh->bufsize - 1, 0);
+	if (n < 0)
+		return -1;
+	sysfsh->buf[n] = 0;
+	return n;
+}
+
+static bool readAttributeValue(wrap_amdsysfs_handle* sysfsh, int fd, unsigned int& value)
+{
+	if (readAttribute(sysfsh, fd) <= 0)
+		return false;
+	char* p2;
+	errno = 0;
+	value = strtoul(sysfsh->buf, &p2, 0);
+	return errno == 0 && p2 != sysfsh->buf;
+}
+#endif
+
 wrap_amdsysfs_handle* wrap_amdsysfs_create()
 {
 	wrap_amdsysfs_handle* sysfsh = NULL;
 
 #if defined(__linux)
-	sysfsh = (wrap_amdsysfs_handle*)calloc(1, sizeof(wrap_amdsysfs_handle));
+	const char* root = getenv("MINER_SYSFS_ROOT");
+	if (root && *root)
+		s_root = root;
 
-	DIR* dirp = opendir("/sys/class/drm");
+	char dbuf[SYSFS_PATH_SIZE];
+	snprintf(dbuf, SYSFS_PATH_SIZE, "%s/class/drm", s_root.c_str());
+	DIR* dirp = opendir(dbuf);
 	if (dirp == nullptr)
 		return NULL;
 
+	sysfsh = (wrap_amdsysfs_handle*)calloc(1, sizeof(wrap_amdsysfs_handle));
+
 	unsigned int gpucount = 0;
 	struct dirent* dire;
 	errno = 0;
@@ -63,6 +106,7 @@ wrap_amdsysfs_handle* wrap_amdsysfs_create()
 	}
 	if (errno != 0) {
 		closedir(dirp);
+		free(sysfsh);
 		return NULL;
 	}
 	closedir(dirp);
@@ -71,13 +115,12 @@ wrap_amdsysfs_handle* wrap_amdsysfs_create()
 	sysfsh->sysfs_hwmon_id = (int*)calloc(gpucount, sizeof(int));
 
 	// filter AMD GPU cards and create mappings
-	char dbuf[120];
 	int cardIndex = 0;
 	for (unsigned int i = 0; i < gpucount; i++) {
 		sysfsh->card_sysfs_device_id[cardIndex] = -1;
 		sysfsh->sysfs_hwmon_id[cardIndex] = -1;
 
-		snprintf(dbuf, 120, "/sys/class/drm/card%u/device/vendor", i);
+		snprintf(dbuf, SYSFS_PATH_SIZE, "%s/class/drm/card%u/device/vendor", s_root.c_str(), i);
 		unsigned int vendorId = 0;
 		if (!getFileContentValue(dbuf, vendorId))
 			continue;
@@ -103,7 +146,7 @@ wrap_amdsysfs_handle* wrap_amdsysfs_create()
 
 		// search hwmon
 		errno = 0;
-		snprintf(dbuf, 120, "/sys/class/drm/card%u/device/hwmon", sysfsIdx);
+		snprintf(dbuf, SYSFS_PATH_SIZE, "%s/class/drm/card%u/device/hwmon", s_root.c_str(), sysfsIdx);
 		DIR* dirp = opendir(dbuf);
 		if (dirp == nullptr) {
 			free(sysfsh);
@@ -137,6 +180,37 @@ wrap_amdsysfs_handle* wrap_amdsysfs_create()
 		sysfsh->sysfs_hwmon_id[i] = hwmonIndex;
 	}
 
+	// Open what gets sampled now, so sampling costs a pread per value.
+	int n = sysfsh->sysfs_gpucount;
+	sysfsh->temp_fd = (int*)malloc(n * sizeof(int));
+	sysfsh->pwm_fd = (int*)malloc(n * sizeof(int));
+	sysfsh->power_fd = (int*)malloc(n * sizeof(int));
+	sysfsh->pm_info_fd = (int*)malloc(n * sizeof(int));
+	sysfsh->pwm_min = (unsigned int*)calloc(n, sizeof(unsigned int));
+	sysfsh->pwm_max = (unsigned int*)calloc(n, sizeof(unsigned int));
+	sysfsh->bufsize = SYSFS_BUF_SIZE;
+	sysfsh->buf = (char*)malloc(sysfsh->bufsize);
+	for (int i = 0; i < n; i++) {
+		char hwmon[SYSFS_PATH_SIZE];
+		snprintf(hwmon, SYSFS_PATH_SIZE, "%s/class/drm/card%u/device/hwmon/hwmon%u", s_root.c_str(),
+		         sysfsh->card_sysfs_device_id[i], sysfsh->sysfs_hwmon_id[i]);
+		snprintf(dbuf, SYSFS_PATH_SIZE, "%s/temp1_input", hwmon);
+		sysfsh->temp_fd[i] = openAttribute(dbuf);
+		snprintf(dbuf, SYSFS_PATH_SIZE, "%s/pwm1", hwmon);
+		sysfsh->pwm_fd[i] = openAttribute(dbuf);
+		snprintf(dbuf, SYSFS_PATH_SIZE, "%s/power1_average", hwmon);
+		sysfsh->power_fd[i] = openAttribute(dbuf);
+		snprintf(dbuf, SYSFS_PATH_SIZE, "%s/kernel/debug/dri/%u/amdgpu_pm_info", s_root.c_str(),
+		         sysfsh->card_sysfs_device_id[i]);
+		sysfsh->pm_info_fd[i] = sysfsh->power_fd[i] < 0 ? openAttribute(dbuf) : -1;
+
+		sysfsh->pwm_max[i] = 255;
+		snprintf(dbuf, SYSFS_PATH_SIZE, "%s/pwm1_max", hwmon);
+		getFileContentValue(dbuf, sysfsh->pwm_max[i]);
+		snprintf(dbuf, SYSFS_PATH_SIZE, "%s/pwm1_min", hwmon);
+		getFileContentValue(dbuf, sysfsh->pwm_min[i]);
+	}
+
 	sysfsh->opencl_gpucount = 0;
 	sysfsh->sysfs_opencl_device_id = (int*)calloc(sysfsh->sysfs_gpucount, sizeof(int));
 #if ETH_ETHASHCL
@@ -169,8 +243,7 @@ wrap_amdsysfs_handle* wrap_amdsysfs_create()
 					if (topology.raw.type == CL_DEVICE_TOPOLOGY_TYPE_PCIE_AMD) {
 
 						int gpuindex = sysfsh->card_sysfs_device_id[i];
-						char dbuf[120];
-						snprintf(dbuf, 120, "/sys/class/drm/card%u/device/uevent", gpuindex);
+						snprintf(dbuf, SYSFS_PATH_SIZE, "%s/class/drm/card%u/device/uevent", s_root.c_str(), gpuindex);
 						std::ifstream ifs(dbuf, std::ios::binary);
 						std::string line;
 						int iBus = 0, iDevice = 0, iFunction = 0;
@@ -222,6 +295,25 @@ wrap_amdsysfs_handle* wrap_amdsysfs_create()
 }
 int wrap_amdsysfs_destroy(wrap_amdsysfs_handle* sysfsh)
 {
+#if defined(__linux)
+	for (int i = 0; sysfsh->buf && i < sysfsh->sysfs_gpucount; i++) {
+		int fds[] = {sysfsh->temp_fd[i], sysfsh->pwm_fd[i], sysfsh->power_fd[i], sysfsh->pm_info_fd[i]};
+		for (int fd : fds)
+			if (fd >= 0)
+				close(fd);
+	}
+#endif
+	free(sysfsh->card_sysfs_device_id);
+	free(sysfsh->sysfs_hwmon_id);
+	free(sysfsh->sysfs_opencl_device_id);
+	free(sysfsh->opencl_sysfs_device_id);
+	free(sysfsh->temp_fd);
+	free(sysfsh->pwm_fd);
+	free(sysfsh->power_fd);
+	free(sysfsh->pm_info_fd);
+	free(sysfsh->pwm_min);
+	free(sysfsh->pwm_max);
+	free(sysfsh->buf);
 	free(sysfsh);
 	return 0;
 }
@@ -238,8 +330,8 @@ int wrap_amdsysfs_get_gpu_pci_id(wrap_amdsysfs_handle* sysfsh, int index, char*
 	if (gpuindex < 0 || index >= sysfsh->sysfs_gpucount)
 		return -1;
 
-	char dbuf[120];
-	snprintf(dbuf, 120, "/sys/class/drm/card%u/device/uevent", gpuindex);
+	char dbuf[SYSFS_PATH_SIZE];
+	snprintf(dbuf, SYSFS_PATH_SIZE, "%s/class/drm/card%u/device/uevent", s_root.c_str(), gpuindex);
 
 	std::ifstream ifs(dbuf, std::ios::binary);
 	std::string line;
@@ -257,80 +349,75 @@ int wrap_amdsysfs_get_gpu_pci_id(wrap_amdsysfs_handle* sysfsh, int index, char*
 
 int wrap_amdsysfs_get_tempC(wrap_amdsysfs_handle* sysfsh, int index, unsigned int* tempC)
 {
-	int gpuindex = sysfsh->card_sysfs_device_id[index];
-	if (gpuindex < 0 || index >= sysfsh->sysfs_gpucount)
+	if (index < 0 || index >= sysfsh->sysfs_gpucount)
 		return -1;
 
-	int hwmonindex = sysfsh->sysfs_hwmon_id[index];
-	if (hwmonindex < 0)
-		return -1;
-
-	char dbuf[120];
-	snprintf(dbuf, 120, "/sys/class/drm/card%u/device/hwmon/hwmon%u/temp1_input",
-	         gpuindex, hwmonindex);
-
+#if defined(__linux)
 	unsigned int temp = 0;
-	getFileContentValue(dbuf, temp);
+	readAttributeValue(sysfsh, sysfsh->temp_fd[index], temp);
 
 	if (temp > 0)
 		*tempC = temp / 1000;
+#endif
 
 	return 0;
 }
 
 int wrap_amdsysfs_get_fanpcnt(wrap_amdsysfs_handle* sysfsh, int index, unsigned int* fanpcnt)
 {
-	int gpuindex = sysfsh->card_sysfs_device_id[index];
-	if (gpuindex < 0 || index >= sysfsh->sysfs_gpucount)
+	if (index < 0 || index >= sysfsh->sysfs_gpucount)
 		return -1;
 
-	int hwmonindex = sysfsh->sysfs_hwmon_id[index];
-	if (hwmonindex < 0)
+#if defined(__linux)
+	unsigned int pwm = 0, pwmMax = sysfsh->pwm_max[index], pwmMin = sysfsh->pwm_min[index];
+	readAttributeValue(sysfsh, sysfsh->pwm_fd[index], pwm);
+	if (pwmMax <= pwmMin || pwm < pwmMin)
 		return -1;
 
-	unsigned int pwm = 0, pwmMax = 255, pwmMin = 0;
-
-	char dbuf[120];
-	snprintf(dbuf, 120, "/sys/class/drm/card%u/device/hwmon/hwmon%u/pwm1",
-	         gpuindex, hwmonindex);
-	getFileContentValue(dbuf, pwm);
-
-	snprintf(dbuf, 120, "/sys/class/drm/card%u/device/hwmon/hwmon%u/pwm1_max",
-	         gpuindex, hwmonindex);
-	getFileContentValue(dbuf, pwmMax);
-
-	snprintf(dbuf, 120, "/sys/class/drm/card%u/device/hwmon/hwmon%u/pwm1_min",
-	         gpuindex, hwmonindex);
-	getFileContentValue(dbuf, pwmMin);
-
 	*fanpcnt = double(pwm - pwmMin) / double(pwmMax - pwmMin) * 100.0;
+#endif
 	return 0;
 }
 
 int wrap_amdsysfs_get_power_usage(wrap_amdsysfs_handle* sysfsh, int index, unsigned int* milliwatts)
 {
-	int gpuindex = sysfsh->card_sysfs_device_id[index];
-	if (gpuindex < 0 || index >= sysfsh->sysfs_gpucount)
+	if (index < 0 || index >= sysfsh->sysfs_gpucount)
 		return -1;
 
-	char dbuf[120];
-	snprintf(dbuf, 120, "/sys/kernel/debug/dri/%u/amdgpu_pm_info", gpuindex);
-
-	std::ifstream ifs(dbuf, std::ios::binary);
-	std::string line;
-
-	while (std::getline(ifs, line)) {
-		std::smatch sm;
-		std::regex regex(R"(([\d|\.]+) W \(average GPU\))");
-		if (std::regex_search(line, sm, regex)) {
-			if (sm.size() == 2) {
-				double watt = atof(sm.str(1).c_str());
-				*milliwatts = (unsigned int)(watt * 1000);
-				return 0;
-			}
-		}
-
+#if defined(__linux)
+	// Microwatts, on kernels that have it.
+	unsigned int uw = 0;
+	if (readAttributeValue(sysfsh, sysfsh->power_fd[index], uw)) {
+		*milliwatts = uw / 1000;
+		return 0;
 	}
 
+	// Otherwise the "<watts> W (average GPU)" line of the debugfs summary.
+	if (readAttribute(sysfsh, sysfsh->pm_info_fd[index]) <= 0)
+		return -1;
+	const char* tag = strstr(sysfsh->buf, " W (average GPU)");
+	if (!tag)
+		return -1;
+	const char* p = tag;
+	while (p > sysfsh->buf && (isdigit((unsigned char)p[-1]) || p[-1] == '.'))
+		p--;
+	if (p == tag)
+		return -1;
+	*milliwatts = (unsigned int)(atof(p) * 1000);
+	return 0;
+#else
 	return -1;
+#endif
+}
+
+int wrap_amdsysfs_get_readings(wrap_amdsysfs_handle* sysfsh, int index, unsigned int* tempC, unsigned int* fanpcnt,
+                               unsigned int* milliwatts)
+{
+	if (index < 0 || index >= sysfsh->sysfs_gpucount)
+		return -1;
+	wrap_amdsysfs_get_tempC(sysfsh, index, tempC);
+	wrap_amdsysfs_get_fanpcnt(sysfsh, index, fanpcnt);
+	if (milliwatts)
+		wrap_amdsysfs_get_power_usage(sysfsh, index, milliwatts);
+	return 0;
 }
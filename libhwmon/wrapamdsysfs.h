@@ -4,6 +4,9 @@
 
 #pragma once
 
+#include <stddef.h>
+
+/* Paths are under /sys, or under $MINER_SYSFS_ROOT to read a fake tree instead. */
 typedef struct {
 	int sysfs_gpucount;
 	int opencl_gpucount;
@@ -11,6 +14,15 @@ typedef struct {
 	int* sysfs_hwmon_id;        /* filesystem card idx to filesystem hwmon idx */
 	int* sysfs_opencl_device_id;          /* map ADL dev to OPENCL dev */
 	int* opencl_sysfs_device_id;          /* map OPENCL dev to ADL dev */
+	/* Attributes opened once at create and re-read with pread, -1 if missing */
+	int* temp_fd;               /* hwmon temp1_input */
+	int* pwm_fd;                /* hwmon pwm1 */
+	int* power_fd;              /* hwmon power1_average */
+	int* pm_info_fd;            /* debugfs amdgpu_pm_info, for power without power1_average */
+	unsigned int* pwm_min;      /* fixed, read at create */
+	unsigned int* pwm_max;
+	char* buf;                  /* reads land here, so a handle is for one thread at a time */
+	size_t bufsize;
 } wrap_amdsysfs_handle;
 
 wrap_amdsysfs_handle* wrap_amdsysfs_create();
@@ -25,3 +37,7 @@ int wrap_amdsysfs_get_tempC(wrap_amdsysfs_handle* sysfsh, int index, unsigned in
 int wrap_amdsysfs_get_fanpcnt(wrap_amdsysfs_handle* sysfsh, int index, unsigned int* fanpcnt);
 
 int wrap_amdsysfs_get_power_usage(wrap_amdsysfs_handle* sysfsh, int index, unsigned int* milliwatts);
+
+/* Temperature, fan and, unless milliwatts is null, power of one card in one go */
+int wrap_amdsysfs_get_readings(wrap_amdsysfs_handle* sysfsh, int index, unsigned int* tempC, unsigned int* fanpcnt,
+                               unsigned int* milliwatts);
@@ -3,9 +3,13 @@
     of the accompanying GNU General Public License */
 
 #include <boost/algorithm/string.hpp>
+#include <netinet/tcp.h>
 
 #include "EthStratumClient.h"
+#include "PoolLatency.h"
+#include "StratumCapture.h"
 #include "libethash/endian.h"
+#include "libethcore/Difficulty.h"
 #include "libdevcore/Log.h"
 #include <miner-buildinfo.h>
 
@@ -13,37 +17,121 @@ using boost::asio::ip::tcp;
 
 extern string g_email;
 extern unsigned g_worktimeout;
+extern unsigned g_stopAfter;
+
+// Seconds after which a share without an answer counts as rejected.
+static const unsigned c_responseTimeout = 5;
+
+static std::atomic<unsigned> s_clients = {0};
+
+// How long a resolved pool address is used before resolving it again.
+static const std::chrono::minutes c_resolveTtl(5);
+// Wait before racing the next address against a connect that hasn't completed (RFC 8305).
+static const unsigned c_attemptDelayMs = 250;
+// Give up on the addresses still connecting this long after the last one was tried.
+static const unsigned c_connectTimeoutMs = 10000;
+// Keep alive probes, a dead link is noticed after idle + interval * count seconds.
+static const int c_keepAliveIdle = 10;
+static const int c_keepAliveInterval = 5;
+static const int c_keepAliveCount = 3;
 
-static void diffToTarget(uint32_t* target, double diff)
+struct ResolvedHost {
+	std::vector<tcp::endpoint> endpoints;
+	std::chrono::steady_clock::time_point expires;
+};
+
+// Shared by all clients, the standby and the proxy's upstream often go to the same hosts.
+static std::mutex x_resolved;
+static std::map<string, ResolvedHost> s_resolved;
+
+static string resolveKey(PoolConnection const& _conn)
 {
-	uint32_t target2[8];
-	uint64_t m;
-	int k;
+	stringstream ss;
+	ss << _conn.Host() << ':' << _conn.Port();
+	return ss.str();
+}
 
-	for (k = 6; k > 0 && diff > 1.0; k--)
-		diff /= 4294967296.0;
-	m = (uint64_t)(4294901760.0 / diff);
-	if (m == 0 && k == 6)
-		memset(target2, 0xff, sizeof(target2));
-	else {
-		memset(target2, 0, sizeof(target2));
-		target2[k] = (uint32_t)m;
-		target2[k + 1] = (uint32_t)(m >> 32);
-	}
+// TLS sessions to resume, by the key their connection was given through s_sessionKeyIdx.
+static std::mutex x_sessions;
+static std::map<string, SSL_SESSION*> s_sessions;
+static int s_sessionKeyIdx = -1;
 
-	for (int i = 0; i < 32; i++)
-		((uint8_t*)target)[31 - i] = ((uint8_t*)target2)[i];
+static int storeSession(SSL* _ssl, SSL_SESSION* _session)
+{
+	string const* key = static_cast<string const*>(SSL_get_ex_data(_ssl, s_sessionKeyIdx));
+	if (!key)
+		return 0;
+	Guard l(x_sessions);
+	SSL_SESSION*& stored = s_sessions[*key];
+	if (stored)
+		SSL_SESSION_free(stored);
+	// Returning 1 keeps the reference OpenSSL passed in.
+	stored = _session;
+	return 1;
 }
 
-extern unsigned g_stopAfter;
+static void dropSession(string const& _key)
+{
+	Guard l(x_sessions);
+	auto it = s_sessions.find(_key);
+	if (it == s_sessions.end())
+		return;
+	SSL_SESSION_free(it->second);
+	s_sessions.erase(it);
+}
+
+static boost::asio::ssl::context& sslContext()
+{
+	// Built once, loading the certificate store on every connect costs more than the handshake.
+	// TLS 1.2 only connections are restricted per connection.
+	static std::mutex x_ctx;
+	static std::unique_ptr<boost::asio::ssl::context> s_ctx;
+
+	Guard l(x_ctx);
+	if (s_ctx)
+		return *s_ctx;
+	s_ctx.reset(new boost::asio::ssl::context(boost::asio::ssl::context::tls));
+	s_sessionKeyIdx = SSL_get_ex_new_index(0, nullptr, nullptr, nullptr, nullptr);
+	SSL_CTX_set_session_cache_mode(s_ctx->native_handle(), SSL_SESS_CACHE_CLIENT | SSL_SESS_CACHE_NO_INTERNAL_STORE);
+	SSL_CTX_sess_set_new_cb(s_ctx->native_handle(), storeSession);
+	s_ctx->set_verify_mode(boost::asio::ssl::verify_peer);
+	char* certPath = getenv("SSL_CERT_FILE");
+	try {
+		s_ctx->load_verify_file(certPath ? certPath : "/etc/ssl/certs/ca-certificates.crt");
+	}
+	catch (std::exception const& e) {
+		logerror(e.what());
+		logwarn("Failed to load ca certificates. Either the file '/etc/ssl/certs/ca-certificates.crt' does not exist");
+		logwarn("or the environment variable SSL_CERT_FILE is set to an invalid or inaccessable file.");
+		logwarn("It is possible that certificate verification can fail.");
+	}
+	return *s_ctx;
+}
+
+static void tuneSocket(tcp::socket& _socket)
+{
+	// Shares are small and late ones go stale, don't let Nagle hold them back.
+	boost::system::error_code ec;
+	_socket.set_option(tcp::no_delay(true), ec);
+	_socket.set_option(boost::asio::socket_base::keep_alive(true), ec);
+#ifdef TCP_KEEPIDLE
+	_socket.set_option(boost::asio::detail::socket_option::integer<IPPROTO_TCP, TCP_KEEPIDLE>(c_keepAliveIdle), ec);
+	_socket.set_option(boost::asio::detail::socket_option::integer<IPPROTO_TCP, TCP_KEEPINTVL>(c_keepAliveInterval), ec);
+	_socket.set_option(boost::asio::detail::socket_option::integer<IPPROTO_TCP, TCP_KEEPCNT>(c_keepAliveCount), ec);
+#endif
+}
 
 EthStratumClient::EthStratumClient() : PoolClient(),
+	m_captureId(s_clients++),
+	m_work(m_io_service),
 	m_socket(nullptr),
 	m_securesocket(nullptr),
 	m_worktimer(m_io_service),
 	m_responsetimer(m_io_service),
 	m_stoptimer(m_io_service),
 	m_hrtimer(m_io_service),
+	m_reconnecttimer(m_io_service),
+	m_attempttimer(m_io_service),
 	m_resolver(m_io_service)
 {
 	m_authorized = false;
@@ -58,16 +146,23 @@ EthStratumClient::EthStratumClient() : PoolClient(),
 EthStratumClient::~EthStratumClient()
 {
 	m_io_service.stop();
-	m_serviceThread.join();
+	if (m_serviceThread.joinable())
+		m_serviceThread.join();
+	deleteSocket();
+}
 
-	if (m_connection.SecLevel() != SecureLevel::NONE) {
-		if (m_securesocket)
-			delete m_securesocket;
-	}
-	else {
-		if (m_socket)
-			delete m_socket;
+void EthStratumClient::deleteSocket()
+{
+	if (m_securesocket) {
+		// Links mostly drop without a close_notify, OpenSSL would then mark the session we
+		// cached as not resumable.
+		SSL_set_shutdown(m_securesocket->native_handle(), SSL_SENT_SHUTDOWN | SSL_RECEIVED_SHUTDOWN);
+		delete m_securesocket;
 	}
+	else if (m_socket)
+		delete m_socket;
+	m_securesocket = nullptr;
+	m_socket = nullptr;
 }
 
 void EthStratumClient::connect()
@@ -76,57 +171,83 @@ void EthStratumClient::connect()
 
 	m_authorized = false;
 	m_connected = false;
-
-	stringstream ssPort;
-	ssPort << m_connection.Port();
-	tcp::resolver::query q(m_connection.Host(), ssPort.str());
+	m_linkdown = false;
+	m_framer.reset();
+	cancelAttempts();
+	deleteSocket();
 
 	if (m_connection.SecLevel() != SecureLevel::NONE) {
-
-		boost::asio::ssl::context::method method = boost::asio::ssl::context::tls;
-		if (m_connection.SecLevel() == SecureLevel::TLS12)
-			method = boost::asio::ssl::context::tlsv12;
-
-		boost::asio::ssl::context ctx(method);
-		m_securesocket = new boost::asio::ssl::stream<boost::asio::ip::tcp::socket>(m_io_service, ctx);
+		m_securesocket = new boost::asio::ssl::stream<boost::asio::ip::tcp::socket>(m_io_service, sslContext());
 		m_socket = &m_securesocket->next_layer();
-
-		m_securesocket->set_verify_mode(boost::asio::ssl::verify_peer);
-
-		char* certPath = getenv("SSL_CERT_FILE");
-		try {
-			ctx.load_verify_file(certPath ? certPath : "/etc/ssl/certs/ca-certificates.crt");
-		}
-		catch (std::exception const& e) {
-			logerror(e.what());
-			logwarn("Failed to load ca certificates. Either the file '/etc/ssl/certs/ca-certificates.crt' does not exist");
-			logwarn("or the environment variable SSL_CERT_FILE is set to an invalid or inaccessable file.");
-			logwarn("It is possible that certificate verification can fail.");
-		}
 	}
 	else
 		m_socket = new boost::asio::ip::tcp::socket(m_io_service);
 
-	// Activate keep alive to detect disconnects
-	unsigned int keepAlive = 10000;
-
-	struct timeval tv;
-	tv.tv_sec = keepAlive / 1000;
-	tv.tv_usec = keepAlive % 1000;
-	setsockopt(m_socket->native_handle(), SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
-	setsockopt(m_socket->native_handle(), SOL_SOCKET, SO_SNDTIMEO, &tv, sizeof(tv));
-
-	m_resolver.async_resolve(q, boost::bind(&EthStratumClient::resolve_handler, this,
-	                                        boost::asio::placeholders::error, boost::asio::placeholders::iterator));
-
-	if (m_serviceThread.joinable()) {
-		// If the service thread have been created try to reset the service.
-		m_io_service.reset();
+	bool cached = false;
+	{
+		Guard l(x_resolved);
+		auto it = s_resolved.find(resolveKey(m_connection));
+		if (it != s_resolved.end() && it->second.expires > std::chrono::steady_clock::now()) {
+			m_endpoints = it->second.endpoints;
+			cached = true;
+		}
 	}
+	if (cached)
+		m_io_service.post(boost::bind(&EthStratumClient::startConnects, this));
 	else {
-		// Otherwise, if the first time here, create new thread.
+		stringstream ssPort;
+		ssPort << m_connection.Port();
+		tcp::resolver::query q(m_connection.Host(), ssPort.str());
+		m_resolver.async_resolve(q, boost::bind(&EthStratumClient::resolve_handler, this,
+		                                        boost::asio::placeholders::error, boost::asio::placeholders::iterator));
+	}
+
+	// The service is kept busy by m_work, so the thread serves every later connection too.
+	if (!m_serviceThread.joinable())
 		m_serviceThread = std::thread{boost::bind(&boost::asio::io_service::run, &m_io_service)};
+}
+
+void EthStratumClient::reconnect(unsigned _delayMs)
+{
+	m_reconnecttimer.expires_from_now(boost::posix_time::milliseconds(_delayMs));
+	m_reconnecttimer.async_wait([this](const boost::system::error_code & ec) {
+		if (!ec)
+			connect();
+	});
+	if (!m_serviceThread.joinable())
+		m_serviceThread = std::thread{boost::bind(&boost::asio::io_service::run, &m_io_service)};
+}
+
+void EthStratumClient::disconnect()
+{
+	if (m_linkdown)
+		return;
+	m_linkdown = true;
+	m_connected = false;
+	m_authorized = false;
+
+	m_worktimer.cancel();
+	m_responsetimer.cancel();
+	m_hrtimer.cancel();
+	boost::system::error_code ec;
+	if (m_socket)
+		m_socket->close(ec);
+
+	// Whatever was in flight won't be answered on this connection.
+	std::map<unsigned, Submission> lost;
+	{
+		Guard l(x_submits);
+		lost.swap(m_submits);
 	}
+	using namespace std::chrono;
+	auto now = steady_clock::now();
+	for (auto const& submission : lost)
+		if (m_onSolutionRejected)
+			m_onSolutionRejected(submission.second.stale,
+			                     duration_cast<milliseconds>(now - submission.second.sent).count(), "Connection lost");
+
+	if (m_onDisconnected)
+		m_onDisconnected();
 }
 
 #define BOOST_ASIO_ENABLE_CANCELIO
@@ -135,17 +256,121 @@ void EthStratumClient::resolve_handler(const boost::system::error_code& ec, tcp:
 {
 	//dev::setThreadName("stratum");
 	if (!ec) {
-		tcp::resolver::iterator end;
-		async_connect(*m_socket, i, end, boost::bind(&EthStratumClient::connect_handler, this,
-		              boost::asio::placeholders::error, boost::asio::placeholders::iterator));
+		m_endpoints.assign(i, tcp::resolver::iterator());
+		{
+			Guard l(x_resolved);
+			s_resolved[resolveKey(m_connection)] = ResolvedHost{m_endpoints, std::chrono::steady_clock::now() + c_resolveTtl};
+		}
+		startConnects();
 	}
 	else {
 		stringstream ss;
 		logwarn("Could not resolve host " << m_connection.Host() << ':' << m_connection.Port() << ", " << ec.message());
-		exit(-1);
+		disconnect();
 	}
 }
 
+void EthStratumClient::startConnects()
+{
+	if (m_endpoints.empty()) {
+		logwarn("No addresses for " << m_connection.Host() << ':' << m_connection.Port());
+		disconnect();
+		return;
+	}
+
+	// Try the addresses that connected fastest before first.
+	if (m_latency)
+		m_latency->rank(m_endpoints);
+	// Then alternate between IPv6 and IPv4, a broken family only costs one attempt delay.
+	std::vector<tcp::endpoint> first, other;
+	for (auto const& ep : m_endpoints)
+		(ep.protocol() == m_endpoints.front().protocol() ? first : other).push_back(ep);
+	m_endpoints.clear();
+	for (size_t i = 0; i < first.size() || i < other.size(); i++) {
+		if (i < first.size())
+			m_endpoints.push_back(first[i]);
+		if (i < other.size())
+			m_endpoints.push_back(other[i]);
+	}
+
+	m_attempts.clear();
+	m_attempts.reserve(m_endpoints.size());
+	m_failedAttempts = 0;
+	startAttempt();
+}
+
+void EthStratumClient::startAttempt()
+{
+	size_t idx = m_attempts.size();
+	if (idx == m_endpoints.size())
+		return;
+	m_attempts.push_back(Attempt{std::unique_ptr<tcp::socket>(new tcp::socket(m_io_service)),
+	                             std::chrono::steady_clock::now()});
+	m_attempts[idx].socket->async_connect(m_endpoints[idx], boost::bind(&EthStratumClient::attempt_handler, this,
+	                                      boost::asio::placeholders::error, m_connectGen, idx));
+
+	bool last = idx + 1 == m_endpoints.size();
+	m_attempttimer.expires_from_now(boost::posix_time::milliseconds(last ? c_connectTimeoutMs : c_attemptDelayMs));
+	unsigned gen = m_connectGen;
+	m_attempttimer.async_wait([this, gen, last](const boost::system::error_code & ec) {
+		if (ec || gen != m_connectGen)
+			return;
+		if (last)
+			connectFailed(boost::asio::error::timed_out);
+		else
+			startAttempt();
+	});
+}
+
+void EthStratumClient::attempt_handler(const boost::system::error_code& ec, unsigned _gen, size_t _idx)
+{
+	if (_gen != m_connectGen)
+		return;
+
+	if (ec) {
+		m_attempts[_idx].socket.reset();
+		if (++m_failedAttempts < m_endpoints.size()) {
+			// Don't wait out the delay for a connect that has already failed.
+			if (m_attempts.size() < m_endpoints.size()) {
+				m_attempttimer.cancel();
+				startAttempt();
+			}
+			return;
+		}
+		connectFailed(ec);
+		return;
+	}
+
+	Attempt winner = std::move(m_attempts[_idx]);
+	cancelAttempts();
+	*m_socket = std::move(*winner.socket);
+	tuneSocket(*m_socket);
+	if (m_latency)
+		m_latency->connected(m_connection, m_endpoints[_idx], std::chrono::duration_cast<std::chrono::milliseconds>
+		                     (std::chrono::steady_clock::now() - winner.start).count());
+	connect_handler(m_endpoints[_idx]);
+}
+
+void EthStratumClient::connectFailed(const boost::system::error_code& ec)
+{
+	cancelAttempts();
+	{
+		// The pool may have moved, look it up again next time.
+		Guard l(x_resolved);
+		s_resolved.erase(resolveKey(m_connection));
+	}
+	logerror("Could not connect to stratum server " << m_connection.Host() << ':' << m_connection.Port() << ", " <<
+	         ec.message());
+	disconnect();
+}
+
+void EthStratumClient::cancelAttempts()
+{
+	m_connectGen++;
+	m_attempttimer.cancel();
+	m_attempts.clear();
+}
+
 void EthStratumClient::reset_work_timeout()
 {
 	m_worktimer.cancel();
@@ -161,118 +386,174 @@ static void logJson(string json)
 	loginfo("JSON TX" << endl << txObject);
 }
 
-void EthStratumClient::async_write_with_response(boost::asio::streambuf& buf)
+void EthStratumClient::send(std::vector<char>& _buf)
 {
+	if (!m_connected) {
+		m_tx.release(_buf);
+		return;
+	}
+	if (g_logJson)
+		logJson(string(_buf.begin(), _buf.end()));
+	if (g_capture.active())
+		g_capture.sent(m_captureId, _buf.data(), _buf.size() && _buf.back() == '\n' ? _buf.size() - 1 : _buf.size());
+	// Writes are started on the io thread, one at a time, so messages never interleave.
+	if (m_tx.push(_buf))
+		m_io_service.post(boost::bind(&EthStratumClient::writeNext, this));
+}
+
+void EthStratumClient::writeNext()
+{
+	std::vector<char>* buf = m_tx.front();
+	if (m_writing || !buf)
+		return;
+	m_writing = true;
 	if (m_connection.SecLevel() != SecureLevel::NONE)
-		async_write(*m_securesocket, buf,
-		            boost::bind(&EthStratumClient::handleResponse, this, boost::asio::placeholders::error));
+		async_write(*m_securesocket, boost::asio::buffer(buf->data(), buf->size()),
+		            boost::bind(&EthStratumClient::handleWrite, this, boost::asio::placeholders::error));
 	else
-		async_write(*m_socket, buf,
-		            boost::bind(&EthStratumClient::handleResponse, this, boost::asio::placeholders::error));
+		async_write(*m_socket, boost::asio::buffer(buf->data(), buf->size()),
+		            boost::bind(&EthStratumClient::handleWrite, this, boost::asio::placeholders::error));
+}
+
+void EthStratumClient::handleWrite(const boost::system::error_code& ec)
+{
+	m_writing = false;
+	if (ec) {
+		// The connection is gone, drop what was queued for it.
+		m_tx.clear();
+		if (ec != boost::asio::error::operation_aborted) {
+			logerror("Handle response failed: " + ec.message());
+			disconnect();
+		}
+		return;
+	}
+	readline();
+	if (m_tx.pop())
+		writeNext();
 }
 
-void EthStratumClient::connect_handler(const boost::system::error_code& ec, tcp::resolver::iterator i)
+void EthStratumClient::connect_handler(tcp::endpoint const& _ep)
 {
-	(void)i;
+	if (m_connection.SecLevel() == SecureLevel::NONE) {
+		login(_ep);
+		return;
+	}
 
-	if (!ec) {
-		m_connected = true;
-		m_linkdown = false;
-
-		if (m_onConnected)
-			m_onConnected(m_socket->remote_endpoint().address());
-
-		if (m_connection.SecLevel() != SecureLevel::NONE) {
-			boost::system::error_code hec;
-			m_securesocket->handshake(boost::asio::ssl::stream_base::client, hec);
-			if (hec) {
-				logerror("SSL/TLS Handshake failed: " << hec.message());
-				if (hec.value() == 337047686) // certificate verification failed
-					loginfo("secure handshake failed.");
-				throw runtime_error("No CA");
-			}
+	SSL* ssl = m_securesocket->native_handle();
+	SSL_set_tlsext_host_name(ssl, m_connection.Host().c_str());
+	if (m_connection.SecLevel() == SecureLevel::TLS12) {
+		SSL_set_min_proto_version(ssl, TLS1_2_VERSION);
+		SSL_set_max_proto_version(ssl, TLS1_2_VERSION);
+	}
+	// Offer the session of the last connection to this pool, the server can skip the full handshake.
+	m_sessionKey = resolveKey(m_connection) + (m_connection.SecLevel() == SecureLevel::TLS12 ? "/tls12" : "");
+	SSL_set_ex_data(ssl, s_sessionKeyIdx, &m_sessionKey);
+	{
+		Guard l(x_sessions);
+		auto it = s_sessions.find(m_sessionKey);
+		if (it != s_sessions.end())
+			SSL_set_session(ssl, it->second);
+	}
+
+	// A server that never answers closes the socket, which fails the handshake.
+	unsigned gen = m_connectGen;
+	m_attempttimer.expires_from_now(boost::posix_time::milliseconds(c_connectTimeoutMs));
+	m_attempttimer.async_wait([this, gen](const boost::system::error_code & ec) {
+		if (!ec && gen == m_connectGen) {
+			boost::system::error_code cec;
+			m_socket->close(cec);
 		}
+	});
+	m_securesocket->async_handshake(boost::asio::ssl::stream_base::client,
+	                                boost::bind(&EthStratumClient::handshake_handler, this, boost::asio::placeholders::error, _ep));
+}
 
-		// Successfully connected so we start our work timeout timer
-		reset_work_timeout();
+void EthStratumClient::handshake_handler(const boost::system::error_code& ec, tcp::endpoint const& _ep)
+{
+	m_connectGen++;
+	m_attempttimer.cancel();
+	if (ec) {
+		// The offered session may be the reason, start over without it.
+		dropSession(m_sessionKey);
+		logerror("SSL/TLS Handshake failed: " << ec.message());
+		if (ec.value() == 337047686) // certificate verification failed
+			loginfo("secure handshake failed.");
+		disconnect();
+		return;
+	}
+	login(_ep);
+}
 
-		std::stringstream json;
+void EthStratumClient::login(tcp::endpoint const& _ep)
+{
+	m_connected = true;
+	if (g_capture.active())
+		g_capture.connected(m_captureId, m_connection.Version());
 
-		string user;
-		size_t p;
+	if (m_onConnected)
+		m_onConnected(_ep.address());
 
-		switch (m_connection.Version()) {
-		case EthStratumClient::STRATUM:
-			m_authorized = true;
-			json << "{\"id\": 1, \"method\": \"mining.subscribe\", \"params\": []}\n";
-			break;
-		case EthStratumClient::ETHPROXY:
-			p = m_connection.User().find_first_of(".");
-			user = m_connection.User().substr(0, p);
-			if (p + 1 <= m_connection.User().length())
-				m_worker = m_connection.User().substr(p + 1);
-			else
-				m_worker = "";
+	// Successfully connected so we start our work timeout timer
+	reset_work_timeout();
+	// and look for unanswered shares
+	m_responsetimer.expires_from_now(boost::posix_time::seconds(1));
+	m_responsetimer.async_wait(boost::bind(&EthStratumClient::response_timeout_handler, this,
+	                                       boost::asio::placeholders::error));
 
-			if (m_connection.Path().empty())
-				json << "{\"id\": 1, \"worker\":\"" << m_worker << "\", \"method\": \"eth_submitLogin\", \"params\": [\"" << user <<
-				     "\"]}\n";
-			else
-				json << "{\"id\": 1, \"worker\":\"" << m_worker << "\", \"method\": \"eth_submitLogin\", \"params\": [\"" << user <<
-				     "\", \"" << m_connection.Path().substr(1) << "\"]}\n";
-			break;
-		case EthStratumClient::ETHEREUMSTRATUM:
-			m_authorized = true;
-			json << "{\"id\": 1, \"method\": \"mining.subscribe\", \"params\": [\"miner/" <<
-			     miner_get_buildinfo()->project_version << "\",\"EthereumStratum/1.0.0\"]}\n";
-			break;
+	std::vector<char>& buf = m_tx.acquire();
+	StratumWriter json(buf);
+
+	string user;
+	size_t p;
+
+	switch (m_connection.Version()) {
+	case EthStratumClient::STRATUM:
+		m_authorized = true;
+		json << "{\"id\": 1, \"method\": \"mining.subscribe\", \"params\": []}\n";
+		break;
+	case EthStratumClient::ETHPROXY:
+		p = m_connection.User().find_first_of(".");
+		user = m_connection.User().substr(0, p);
+		if (p + 1 <= m_connection.User().length())
+			m_worker = m_connection.User().substr(p + 1);
+		else
+			m_worker = "";
+
+		json << "{\"id\": 1, \"worker\":";
+		json.quoted(m_worker) << ", \"method\": \"eth_submitLogin\", \"params\": [";
+		json.quoted(user);
+		if (!m_connection.Path().empty()) {
+			json << ", ";
+			json.quoted(m_connection.Path().substr(1));
 		}
-		std::ostream os(&m_requestBuffer);
-		os << json.str();
-		async_write_with_response(m_requestBuffer);
-		if (g_logJson)
-			logJson(json.str());
-	}
-	else {
-		logerror("Could not connect to stratum server " << m_connection.Host() << ':' << m_connection.Port() << ", " <<
-		         ec.message());
-		exit(-1);
+		json << "]}\n";
+		break;
+	case EthStratumClient::ETHEREUMSTRATUM:
+		m_authorized = true;
+		json << "{\"id\": 1, \"method\": \"mining.subscribe\", \"params\": [\"miner/" <<
+		     miner_get_buildinfo()->project_version << "\",\"EthereumStratum/1.0.0\"]}\n";
+		break;
 	}
-
+	send(buf);
 }
 
 void EthStratumClient::readline()
 {
 	Guard l(x_pending);
 	if (m_pending == 0) {
+		auto space = m_framer.writable();
 		if (m_connection.SecLevel() != SecureLevel::NONE)
-			m_securesocket->async_read_some(boost::asio::buffer(m_responseBuffer, sizeof(m_responseBuffer) - 1),
+			m_securesocket->async_read_some(boost::asio::buffer(space.first, space.second),
 			                                boost::bind(&EthStratumClient::readResponse, this,
 			                                        boost::asio::placeholders::error, boost::asio::placeholders::bytes_transferred));
 		else
-			m_socket->async_read_some(boost::asio::buffer(m_responseBuffer, sizeof(m_responseBuffer) - 1),
+			m_socket->async_read_some(boost::asio::buffer(space.first, space.second),
 			                          boost::bind(&EthStratumClient::readResponse, this,
 			                                      boost::asio::placeholders::error, boost::asio::placeholders::bytes_transferred));
 		m_pending++;
 	}
 }
 
-void EthStratumClient::handleResponse(const boost::system::error_code& ec)
-{
-	if (!ec)
-		readline();
-	else {
-		logerror("Handle response failed: " + ec.message());
-		exit(-1);
-	}
-}
-
-void EthStratumClient::handleSubmitResponse(const boost::system::error_code& ec, void* buf)
-{
-	(void)buf;
-	handleResponse(ec);
-}
-
 void EthStratumClient::readResponse(const boost::system::error_code& ec, std::size_t bytes_transferred)
 {
 	{
@@ -281,36 +562,45 @@ void EthStratumClient::readResponse(const boost::system::error_code& ec, std::si
 	}
 
 	if (!ec) {
-		if (bytes_transferred) {
-			char* cp = m_responseBuffer;
-			char* const cp_end = cp + bytes_transferred;
-			*cp_end = 0;
-			while (cp < cp_end) {
-				char* const cp2 = ::strchr(cp, '\n');
-				if (cp2)
-					*cp2 = 0;
-				if (::strlen(cp)) {
-					Json::Value responseObject;
-					Json::Reader reader;
-					if (reader.parse(cp, responseObject))
-						processReponse(responseObject);
-					else
-						logerror("Parse response failed: " + reader.getFormattedErrorMessages());
-				}
-				else if (m_connection.Version() != EthStratumClient::ETHPROXY)
-					logerror("Discarding incomplete response");
-				if (cp2 == NULL)
-					break;
-				cp = cp2 + 1;
-			}
+		// Lines may span reads, the framer keeps partial ones until their newline arrives.
+		m_framer.commit(bytes_transferred);
+		char* line;
+		size_t size;
+		while (m_framer.next(line, size))
+			processLine(line, size);
+		if (m_framer.discarded() != m_discarded) {
+			logerror("Discarded " << m_framer.discarded() - m_discarded << " bytes of an oversized message");
+			m_discarded = m_framer.discarded();
 		}
 		if (m_connected)
 			readline();
 	}
-	else if (m_connected) {
+	else if (m_connected && ec != boost::asio::error::operation_aborted) {
 		logerror("Read response failed: " + ec.message());
-		exit(-1);
+		disconnect();
+	}
+}
+
+void EthStratumClient::processLine(char* _line, size_t _size)
+{
+	if (!_size)
+		return;
+	if (g_capture.active())
+		g_capture.received(m_captureId, _line, _size);
+
+	StratumMessage msg;
+	if (msg.parse(_line, _size) && processMessage(msg)) {
+		if (g_logJson)
+			loginfo("JSON RX" << endl << _line);
+		return;
 	}
+
+	Json::Value responseObject;
+	Json::Reader reader;
+	if (reader.parse(_line, _line + _size, responseObject))
+		processReponse(responseObject);
+	else
+		logerror("Parse response failed: " + reader.getFormattedErrorMessages());
 }
 
 void EthStratumClient::processExtranonce(std::string& enonce)
@@ -343,17 +633,155 @@ std::string ErrorResponse(Json::Value& responseObject)
 	return retVar;
 }
 
+bool EthStratumClient::processMessage(StratumMessage const& _msg)
+{
+	static const StratumSpan c_none;
+	int id = _msg.intId();
+
+	// Accepted shares. Rejects go the slow way to collect the error text.
+	if (id >= (int)c_firstSubmitId && _msg.method.empty()) {
+		if (_msg.result.type != StratumSpan::True)
+			return false;
+		solutionResponse(id, true, "");
+		return true;
+	}
+	// The login sequence and anything with a payload we don't parse here.
+	if ((id >= 1 && id <= 3) || _msg.id.type == StratumSpan::String)
+		return false;
+
+	StratumSpan const* items;
+	unsigned count;
+	if (m_connection.Version() == EthStratumClient::ETHPROXY) {
+		if (_msg.result.type != StratumSpan::Array)
+			return false;
+		items = _msg.resultItems;
+		count = _msg.resultCount;
+	}
+	else if (_msg.method == "mining.notify" && _msg.params.type == StratumSpan::Array) {
+		items = _msg.paramItems;
+		count = _msg.paramCount;
+	}
+	else if (_msg.method == "mining.set_difficulty" && m_connection.Version() == EthStratumClient::ETHEREUMSTRATUM) {
+		if (_msg.params.type != StratumSpan::Array || (_msg.paramCount && _msg.paramItems[0].type != StratumSpan::Number))
+			return false;
+		setDifficulty(_msg.paramCount ? strtod(_msg.paramItems[0].data, nullptr) : 1);
+		return true;
+	}
+	else
+		return false;
+
+	for (unsigned i = 0; i < count; i++)
+		if (items[i].escaped)
+			return false;
+	auto item = [&](unsigned i) -> StratumSpan const& {
+		return i < count && items[i].type == StratumSpan::String ? items[i] : c_none;
+	};
+
+	if (m_connection.Version() == EthStratumClient::ETHEREUMSTRATUM)
+		workReceived(item(0), item(2), item(1), c_none, c_none);
+	else {
+		// Block numbers come as hex strings or plain numbers.
+		unsigned b = m_connection.Version() == EthStratumClient::ETHPROXY ? 3 : 4;
+		workReceived(item(0), item(b - 3), item(b - 2), item(b - 1), b < count ? items[b] : c_none);
+	}
+	return true;
+}
+
+void EthStratumClient::workReceived(StratumSpan const& _job, StratumSpan const& _header, StratumSpan const& _seed,
+                                    StratumSpan const& _target, StratumSpan const& _block)
+{
+	bool nicehash = m_connection.Version() == EthStratumClient::ETHEREUMSTRATUM;
+	h256 headerHash;
+	if (_header.empty() || _seed.empty() || (!nicehash && _target.empty()))
+		return;
+	if (!hexToHash(_header, headerHash)) {
+		logerror("Bad header hash in notification: " << _header.str());
+		return;
+	}
+	if (headerHash == m_current.header)
+		return;
+
+	{
+		// Shares still waiting for their answer were found on the previous job.
+		Guard l(x_submits);
+		for (auto& submission : m_submits)
+			submission.second.stale = true;
+	}
+
+	reset_work_timeout();
+
+	m_current.header = headerHash;
+	hexToHash(_seed, m_current.seed);
+	if (nicehash) {
+		m_current.boundary = m_nextWorkBoundary;
+		m_current.startNonce = ethash_swap_u64(*((uint64_t*)m_extraNonce.data()));
+		m_current.exSizeBits = m_extraNonceHexSize * 4;
+		m_current.job_len = _job.size;
+		hexToHash(_job, m_current.job, HexAlign::Left);
+	}
+	else {
+		// coinmine.pl fix, short targets lack their leading zeros
+		hexToHash(_target, m_current.boundary, HexAlign::Right);
+		if (!hexToHash(_job, m_current.job))
+			m_current.job = h256();
+		// eth_getWork from recent nodes appends the block number.
+		if (_block.type == StratumSpan::String && !_block.empty())
+			m_current.block = strtoll(_block.data, nullptr, 16);
+		else if (_block.type == StratumSpan::Number)
+			m_current.block = strtoll(_block.data, nullptr, 10);
+		else
+			m_current.block = -1;
+	}
+
+	if (m_onWorkReceived)
+		m_onWorkReceived(m_current);
+}
+
+void EthStratumClient::setDifficulty(double _difficulty)
+{
+	if (_difficulty <= 0.0001)
+		_difficulty = 0.0001;
+	logwarn("Difficulty: "  << fgYellow << _difficulty << fgReset << " (nicehash)");
+	diffToTarget((uint32_t*)m_nextWorkBoundary.data(), _difficulty);
+}
+
+void EthStratumClient::solutionResponse(unsigned _id, bool _accepted, std::string const& _error)
+{
+	Submission submission;
+	{
+		Guard l(x_submits);
+		auto it = m_submits.find(_id);
+		if (it == m_submits.end()) {
+			logwarn("Late response to share #" << _id << ", " << (_accepted ? "accepted" : "rejected"));
+			return;
+		}
+		submission = it->second;
+		m_submits.erase(it);
+	}
+
+	using namespace std::chrono;
+	unsigned ms = duration_cast<milliseconds>(steady_clock::now() - submission.sent).count();
+	if (_accepted) {
+		if (m_onSolutionAccepted)
+			m_onSolutionAccepted(submission.stale, ms);
+	}
+	else {
+		if (m_onSolutionRejected)
+			m_onSolutionRejected(submission.stale, ms, _error);
+	}
+}
+
 void EthStratumClient::processReponse(Json::Value& responseObject)
 {
 	if (g_logJson)
 		loginfo("JSON RX" << endl << responseObject);
 	Json::Value error = responseObject.get("error", {});
-	std::stringstream json;
-	std::ostream os(&m_requestBuffer);
 	Json::Value params;
 	int id = responseObject.get("id", Json::Value::null).asInt();
 	switch (id) {
-	case 1:
+	case 1: {
+		std::vector<char>& buf = m_tx.acquire();
+		StratumWriter json(buf);
 		if (m_connection.Version() == EthStratumClient::ETHEREUMSTRATUM) {
 			params = responseObject.get("result", Json::Value::null);
 			if (params.isArray()) {
@@ -365,21 +793,17 @@ void EthStratumClient::processReponse(Json::Value& responseObject)
 		}
 		if (m_connection.Version() != EthStratumClient::ETHPROXY) {
 			loginfo("Subscribed to stratum server");
-			json << "{\"id\": 3, \"method\": \"mining.authorize\", \"params\": [\"" << m_connection.User() + m_connection.Path() <<
-			     "\",\"" <<
-			     m_connection.Pass() << "\"]}\n";
+			json << "{\"id\": 3, \"method\": \"mining.authorize\", \"params\": [";
+			json.quoted(m_connection.User() + m_connection.Path()) << ",";
+			json.quoted(m_connection.Pass()) << "]}\n";
 		}
 		else {
 			m_authorized = true;
 			json << "{\"id\": 5, \"method\": \"eth_getWork\", \"params\": []}\n"; // not strictly required but it does speed up initialization
 		}
-		os << json.str();
-
-		async_write_with_response(m_requestBuffer);
-		if (g_logJson)
-			logJson(json.str());
-
+		send(buf);
 		break;
+	}
 	case 2:
 		// nothing to do...
 		break;
@@ -387,23 +811,18 @@ void EthStratumClient::processReponse(Json::Value& responseObject)
 		m_authorized = responseObject.get("result", Json::Value::null).asBool();
 		if (!m_authorized) {
 			logerror("Worker not authorized:" + m_connection.User());
-			throw runtime_error("Not authorized");
+			disconnect();
+			return;
 		}
 		loginfo("Authorized worker " + m_connection.User());
 		break;
-	case 4:
-		m_responsetimer.cancel();
-		m_response_pending = false;
-		if (responseObject.get("result", false).asBool()) {
-			if (m_onSolutionAccepted)
-				m_onSolutionAccepted(m_stale);
-		}
-		else {
-			if (m_onSolutionRejected)
-				m_onSolutionRejected(m_stale, ErrorResponse(responseObject));
-		}
-		break;
 	default:
+		if (id >= (int)c_firstSubmitId && !responseObject.isMember("method")) {
+			bool accepted = responseObject.get("result", false).asBool();
+			solutionResponse(id, accepted, accepted ? "" : ErrorResponse(responseObject));
+			break;
+		}
+
 		string method, workattr;
 		unsigned index;
 		if (m_connection.Version() != EthStratumClient::ETHPROXY) {
@@ -420,68 +839,28 @@ void EthStratumClient::processReponse(Json::Value& responseObject)
 		if (method == "mining.notify") {
 			params = responseObject.get(workattr.c_str(), Json::Value::null);
 			if (params.isArray()) {
-				string job = params.get((Json::Value::ArrayIndex)0, "").asString();
-				if (m_response_pending)
-					m_stale = true;
-				if (m_connection.Version() == EthStratumClient::ETHEREUMSTRATUM) {
-					string sSeedHash = params.get((Json::Value::ArrayIndex)1, "").asString();
-					string sHeaderHash = params.get((Json::Value::ArrayIndex)2, "").asString();
-					h256 headerHash(sHeaderHash);
-
-					if (sHeaderHash != "" && sSeedHash != "" && headerHash != m_current.header) {
-						reset_work_timeout();
-
-						m_current.header = headerHash;
-						m_current.seed = h256(sSeedHash);
-						m_current.boundary = m_nextWorkBoundary;
-						m_current.startNonce = ethash_swap_u64(*((uint64_t*)m_extraNonce.data()));
-						m_current.exSizeBits = m_extraNonceHexSize * 4;
-						m_current.job_len = job.size();
-						if (m_connection.Version() == EthStratumClient::ETHEREUMSTRATUM)
-							job.resize(64, '0');
-						m_current.job = h256(job);
-
-						if (m_onWorkReceived)
-							m_onWorkReceived(m_current);
-					}
-				}
-				else {
-					string sHeaderHash = params.get((Json::Value::ArrayIndex)index++, "").asString();
-					string sSeedHash = params.get((Json::Value::ArrayIndex)index++, "").asString();
-					string sShareTarget = params.get((Json::Value::ArrayIndex)index++, "").asString();
-
-					// coinmine.pl fix
-					int l = sShareTarget.length();
-					if (l < 66)
-						sShareTarget = "0x" + string(66 - l, '0') + sShareTarget.substr(2);
-
-
-					if (sHeaderHash != "" && sSeedHash != "" && sShareTarget != "") {
-						h256 headerHash = h256(sHeaderHash);
-
-						if (headerHash != m_current.header) {
-							reset_work_timeout();
-
-							m_current.header = h256(sHeaderHash);
-							m_current.seed = h256(sSeedHash);
-							m_current.boundary = h256(sShareTarget);
-							m_current.job = h256(job);
-
-							if (m_onWorkReceived)
-								m_onWorkReceived(m_current);
-						}
-					}
+				// Messages the scanner passed on, e.g. with escaped strings.
+				string fields[5];
+				StratumSpan spans[5];
+				for (unsigned i = 0; i < 5; i++) {
+					Json::Value v = params.get((Json::Value::ArrayIndex)i, Json::Value::null);
+					if (v.isNull() || (!v.isString() && !v.isIntegral()))
+						continue;
+					fields[i] = v.asString();
+					spans[i].data = fields[i].data();
+					spans[i].size = fields[i].size();
+					spans[i].type = v.isString() ? StratumSpan::String : StratumSpan::Number;
 				}
+				if (m_connection.Version() == EthStratumClient::ETHEREUMSTRATUM)
+					workReceived(spans[0], spans[2], spans[1], StratumSpan(), StratumSpan());
+				else
+					workReceived(spans[0], spans[index], spans[index + 1], spans[index + 2], spans[index + 3]);
 			}
 		}
 		else if (method == "mining.set_difficulty" && m_connection.Version() == EthStratumClient::ETHEREUMSTRATUM) {
 			params = responseObject.get("params", Json::Value::null);
-			if (params.isArray()) {
-				double nextWorkDifficulty = params.get((Json::Value::ArrayIndex)0, 1).asDouble();
-				if (nextWorkDifficulty <= 0.0001) nextWorkDifficulty = 0.0001;
-				logwarn("Difficulty: "  << fgYellow << nextWorkDifficulty << fgReset << " (nicehash)");
-				diffToTarget((uint32_t*)m_nextWorkBoundary.data(), nextWorkDifficulty);
-			}
+			if (params.isArray())
+				setDifficulty(params.get((Json::Value::ArrayIndex)0, 1).asDouble());
 		}
 		else if (method == "mining.set_extranonce" && m_connection.Version() == EthStratumClient::ETHEREUMSTRATUM) {
 			params = responseObject.get("params", Json::Value::null);
@@ -491,13 +870,11 @@ void EthStratumClient::processReponse(Json::Value& responseObject)
 			}
 		}
 		else if (method == "client.get_version") {
-			json << "{\"error\": null, \"id\" : " << id << ", \"result\" : \"" << miner_get_buildinfo()->project_version <<
-			     "\"}\n";
-			os << json.str();
-
-			async_write_with_response(m_requestBuffer);
-			if (g_logJson)
-				logJson(json.str());
+			std::vector<char>& buf = m_tx.acquire();
+			StratumWriter json(buf);
+			json << "{\"error\": null, \"id\" : " << (unsigned)id << ", \"result\" : \"" <<
+			     miner_get_buildinfo()->project_version << "\"}\n";
+			send(buf);
 		}
 		break;
 	}
@@ -516,38 +893,50 @@ void EthStratumClient::work_timeout_handler(const boost::system::error_code& ec)
 {
 	if (!ec) {
 		logerror("No new work received in " << g_worktimeout << " seconds.");
-		cerr << m_connected << "***\n";
-		if (m_connected)
-			exit(-1);
+		disconnect();
 	}
 }
 
 void EthStratumClient::response_timeout_handler(const boost::system::error_code& ec)
 {
-	if (!ec) {
-		logerror("No response received in 2 seconds.");
-		exit(-1);
+	if (ec)
+		return;
+
+	// Shares without an answer count as rejected, the connection itself is watched by the work timeout.
+	using namespace std::chrono;
+	auto now = steady_clock::now();
+	std::vector<std::pair<unsigned, Submission>> expired;
+	{
+		Guard l(x_submits);
+		for (auto it = m_submits.begin(); it != m_submits.end();)
+			if (now - it->second.sent >= seconds(c_responseTimeout)) {
+				expired.push_back(*it);
+				it = m_submits.erase(it);
+			}
+			else
+				++it;
 	}
+	for (auto const& e : expired) {
+		unsigned ms = duration_cast<milliseconds>(now - e.second.sent).count();
+		logwarn("No response to share #" << e.first << " in " << ms << " ms.");
+		if (m_onSolutionRejected)
+			m_onSolutionRejected(e.second.stale, ms, "No response");
+	}
+
+	m_responsetimer.expires_from_now(boost::posix_time::seconds(1));
+	m_responsetimer.async_wait(boost::bind(&EthStratumClient::response_timeout_handler, this,
+	                                       boost::asio::placeholders::error));
 }
 
 void EthStratumClient::hr_timeout_handler(const boost::system::error_code& ec)
 {
 	if (!ec) {
-		stringstream ss;
-		ss << "0x" << hex << std::setw(64) << std::setfill('0') << m_rate;
 		// There is no stratum method to submit the hashrate so we use the rpc variant.
-		string json = "{\"id\": 6, \"jsonrpc\":\"2.0\", \"method\": \"eth_submitHashrate\", \"params\": [\"" +
-		              ss.str() + "\",\"0x" + m_submit_hashrate_id + "\"]}\n";
-		std::ostream os(&m_hrBuffer);
-		os << json;
-		if (m_connection.SecLevel() != SecureLevel::NONE)
-			async_write(*m_securesocket, m_hrBuffer,
-			            boost::bind(&EthStratumClient::handleHashrateResponse, this, boost::asio::placeholders::error));
-		else
-			async_write(*m_socket, m_hrBuffer,
-			            boost::bind(&EthStratumClient::handleHashrateResponse, this, boost::asio::placeholders::error));
-		if (g_logJson)
-			logJson(json);
+		std::vector<char>& buf = m_tx.acquire();
+		StratumWriter json(buf);
+		json << "{\"id\": 6, \"jsonrpc\":\"2.0\", \"method\": \"eth_submitHashrate\", \"params\": [\"0x";
+		json.hex(m_rate, 64) << "\",\"0x" << m_submit_hashrate_id << "\"]}\n";
+		send(buf);
 	}
 }
 
@@ -562,50 +951,49 @@ void EthStratumClient::submitHashrate(uint64_t rate)
 
 void EthStratumClient::submitSolution(Solution solution)
 {
+	if (!m_connected) {
+		if (m_onSolutionRejected)
+			m_onSolutionRejected(solution.stale, 0, "Not connected");
+		return;
+	}
 
-	string nonceHex = toHex(solution.nonce);
-	string json;
+	unsigned id;
+	{
+		Guard l(x_submits);
+		id = m_nextSubmitId++;
+		if (m_nextSubmitId == 1u << 30)
+			m_nextSubmitId = c_firstSubmitId;
+		m_submits[id] = Submission{std::chrono::steady_clock::now(), solution.stale};
+	}
 
-	m_responsetimer.cancel();
+	std::vector<char>& buf = m_tx.acquire();
+	StratumWriter json(buf);
 
 	switch (m_connection.Version()) {
 	case EthStratumClient::STRATUM:
-		json = "{\"id\": 4, \"method\": \"mining.submit\", \"params\": [\"" +
-		       m_connection.User() + "\",\"" + solution.work.job.hex() + "\",\"0x" +
-		       nonceHex + "\",\"0x" + solution.work.header.hex() + "\",\"0x" +
-		       solution.mixHash.hex() + "\"]}\n";
+		json << "{\"id\": " << id << ", \"method\": \"mining.submit\", \"params\": [";
+		json.quoted(m_connection.User()) << ",\"";
+		json.hex(solution.work.job.data(), h256::size) << "\",\"0x";
+		json.hex(solution.nonce) << "\",\"0x";
+		json.hex(solution.work.header.data(), h256::size) << "\",\"0x";
+		json.hex(solution.mixHash.data(), h256::size) << "\"]}\n";
 		break;
 	case EthStratumClient::ETHPROXY:
-		json = "{\"id\": 4, \"worker\":\"" +
-		       m_worker + "\", \"method\": \"eth_submitWork\", \"params\": [\"0x" +
-		       nonceHex + "\",\"0x" + solution.work.header.hex() + "\",\"0x" +
-		       solution.mixHash.hex() + "\"]}\n";
+		json << "{\"id\": " << id << ", \"worker\":";
+		json.quoted(m_worker) << ", \"method\": \"eth_submitWork\", \"params\": [\"0x";
+		json.hex(solution.nonce) << "\",\"0x";
+		json.hex(solution.work.header.data(), h256::size) << "\",\"0x";
+		json.hex(solution.mixHash.data(), h256::size) << "\"]}\n";
 		break;
 	case EthStratumClient::ETHEREUMSTRATUM:
-		json = "{\"id\": 4, \"method\": \"mining.submit\", \"params\": [\"" +
-		       m_connection.User() + "\",\"" + solution.work.job.hex().substr(0, solution.work.job_len) + "\",\"" +
-		       nonceHex.substr(m_extraNonceHexSize, 16 - m_extraNonceHexSize) + "\"]}\n";
+		json << "{\"id\": " << id << ", \"method\": \"mining.submit\", \"params\": [";
+		json.quoted(m_connection.User()) << ",\"";
+		json.hex(solution.work.job.data(), h256::size);
+		buf.resize(buf.size() - (64 - min(solution.work.job_len, 64)));
+		json << "\",\"";
+		json.hex(solution.nonce, 16 - m_extraNonceHexSize) << "\"]}\n";
 		break;
 	}
 
-	boost::asio::streambuf buf;
-	std::ostream os(&buf);
-	os << json;
-	m_stale = solution.stale;
-
-	if (m_connection.SecLevel() != SecureLevel::NONE)
-		async_write(*m_securesocket, buf,
-		            boost::bind(&EthStratumClient::handleSubmitResponse, this, boost::asio::placeholders::error, &buf));
-	else
-		async_write(*m_socket, buf,
-		            boost::bind(&EthStratumClient::handleSubmitResponse, this, boost::asio::placeholders::error, &buf));
-
-	if (g_logJson)
-		logJson(json);
-
-	m_response_pending = true;
-	m_responsetimer.expires_from_now(boost::posix_time::seconds(2));
-	m_responsetimer.async_wait(boost::bind(&EthStratumClient::response_timeout_handler, this,
-	                                       boost::asio::placeholders::error));
+	send(buf);
 }
-
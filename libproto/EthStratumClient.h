@@ -4,7 +4,10 @@
 
 #pragma once
 
+#include <chrono>
 #include <iostream>
+#include <map>
+#include <memory>
 #include <boost/array.hpp>
 #include <boost/asio.hpp>
 #include <boost/asio/ssl.hpp>
@@ -17,6 +20,7 @@
 #include <libethcore/EthashAux.h>
 #include <libethcore/Miner.h>
 #include "PoolClient.h"
+#include "StratumCodec.h"
 
 
 using namespace std;
@@ -33,13 +37,21 @@ public:
 	~EthStratumClient();
 
 	void connect();
+	void reconnect(unsigned _delayMs);
 	bool isConnected()
 	{
 		return m_connected && m_authorized;
 	}
 
+	/// Close the connection and report it through onDisconnected. Call on the io thread.
+	void disconnect();
+
 	void submitHashrate(uint64_t rate);
 	void submitSolution(Solution solution);
+	void post(std::function<void()> const& _f)
+	{
+		m_io_service.post(_f);
+	}
 
 	h256 currentHeaderHash()
 	{
@@ -52,8 +64,18 @@ public:
 
 private:
 
+	void deleteSocket();
 	void resolve_handler(const boost::system::error_code& ec, boost::asio::ip::tcp::resolver::iterator i);
-	void connect_handler(const boost::system::error_code& ec, boost::asio::ip::tcp::resolver::iterator i);
+	/// Race connects to m_endpoints, starting the next one whenever the last is slow or failed.
+	void startConnects();
+	void startAttempt();
+	void attempt_handler(const boost::system::error_code& ec, unsigned _gen, size_t _idx);
+	void connectFailed(const boost::system::error_code& ec);
+	void cancelAttempts();
+	/// Start the TLS handshake if the pool wants one, then login().
+	void connect_handler(boost::asio::ip::tcp::endpoint const& _ep);
+	void handshake_handler(const boost::system::error_code& ec, boost::asio::ip::tcp::endpoint const& _ep);
+	void login(boost::asio::ip::tcp::endpoint const& _ep);
 	void work_timeout_handler(const boost::system::error_code& ec);
 	void response_timeout_handler(const boost::system::error_code& ec);
 	void stop_timeout_handler(const boost::system::error_code& ec);
@@ -61,14 +83,24 @@ private:
 	void reset_work_timeout();
 
 	void readline();
-	void handleResponse(const boost::system::error_code& ec);
-	void handleHashrateResponse(const boost::system::error_code&) {};
-	void handleSubmitResponse(const boost::system::error_code& ec, void* buf);
 	void readResponse(const boost::system::error_code& ec, std::size_t bytes_transferred);
+	void processLine(char* _line, size_t _size);
+	/// Handle the frequent messages straight from the scanned line. False leaves it to processReponse().
+	bool processMessage(StratumMessage const& _msg);
 	void processReponse(Json::Value& responseObject);
-	void async_write_with_response(boost::asio::streambuf& buff);
+	void workReceived(StratumSpan const& _job, StratumSpan const& _header, StratumSpan const& _seed,
+	                  StratumSpan const& _target, StratumSpan const& _block);
+	void setDifficulty(double _difficulty);
+	/// Settle the share submitted with request @a _id.
+	void solutionResponse(unsigned _id, bool _accepted, std::string const& _error);
+
+	/// Queue a message filled in from m_tx.acquire(), from any thread.
+	void send(std::vector<char>& _buf);
+	void writeNext();
+	void handleWrite(const boost::system::error_code& ec);
 
 	PoolConnection m_connection;
+	unsigned m_captureId;    ///< tells this client's lines apart in a capture
 
 	string m_worker; // eth-proxy only;
 
@@ -80,24 +112,47 @@ private:
 
 	WorkPackage m_current;
 
-	bool m_stale = false;
+	/// Submits get request ids from here on, the lower ones are fixed for the other calls.
+	static const unsigned c_firstSubmitId = 10;
+
+	struct Submission {
+		std::chrono::steady_clock::time_point sent;
+		bool stale;
+	};
+
+	std::mutex x_submits;
+	std::map<unsigned, Submission> m_submits;    ///< shares awaiting the pool's answer, by request id
+	unsigned m_nextSubmitId = c_firstSubmitId;
 
 	std::thread m_serviceThread;  ///< The IO service thread.
 	boost::asio::io_service m_io_service;
+	boost::asio::io_service::work m_work;    ///< keeps the service thread alive between connections
 	boost::asio::ip::tcp::socket* m_socket;
 	boost::asio::ssl::stream<boost::asio::ip::tcp::socket>* m_securesocket;
 
-	boost::asio::streambuf m_requestBuffer;
-	char m_responseBuffer[1024];
-	boost::asio::streambuf m_hrBuffer;
+	StratumFramer m_framer;
+	uint64_t m_discarded = 0;
+	StratumTxQueue m_tx;
+	bool m_writing = false;    ///< a write of m_tx.front() is in progress, io thread only
 
 	boost::asio::deadline_timer m_worktimer;
 	boost::asio::deadline_timer m_responsetimer;
 	boost::asio::deadline_timer m_stoptimer;
 	boost::asio::deadline_timer m_hrtimer;
-	bool m_response_pending = false;
+	boost::asio::deadline_timer m_reconnecttimer;
+	boost::asio::deadline_timer m_attempttimer;
 
 	boost::asio::ip::tcp::resolver m_resolver;
+	std::vector<boost::asio::ip::tcp::endpoint> m_endpoints;    ///< resolved addresses, in the order tried
+
+	struct Attempt {
+		std::unique_ptr<boost::asio::ip::tcp::socket> socket;
+		std::chrono::steady_clock::time_point start;
+	};
+	std::vector<Attempt> m_attempts;    ///< connects racing for m_endpoints, by index
+	size_t m_failedAttempts = 0;
+	unsigned m_connectGen = 0;    ///< bumped when a race is over, its late handlers see a stale value
+	std::string m_sessionKey;    ///< the TLS session cache entry of this connection
 
 	h256 m_nextWorkBoundary;
 
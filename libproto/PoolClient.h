@@ -72,6 +72,8 @@ private:
 	boost::asio::ip::address m_address;
 };
 
+class PoolLatency;
+
 class PoolClient
 {
 public:
@@ -82,13 +84,18 @@ public:
 	}
 
 	virtual void connect() = 0;
+	/// connect() after @a _delayMs, without blocking the caller.
+	virtual void reconnect(unsigned _delayMs) = 0;
 
 	virtual void submitHashrate(uint64_t rate) = 0;
 	virtual void submitSolution(Solution solution) = 0;
 	virtual bool isConnected() = 0;
+	/// Run @a _f on the client's network thread.
+	virtual void post(std::function<void()> const& _f) = 0;
 
-	using SolutionAccepted = std::function<void(bool const&)>;
-	using SolutionRejected = std::function<void(bool const&, std::string const&)>;
+	/// Share results carry the stale flag and the pool's response time in milliseconds.
+	using SolutionAccepted = std::function<void(bool const&, unsigned const&)>;
+	using SolutionRejected = std::function<void(bool const&, unsigned const&, std::string const&)>;
 	using Disconnected = std::function<void()>;
 	using Connected = std::function<void(boost::asio::ip::address address)>;
 	using WorkReceived = std::function<void(WorkPackage const&)>;
@@ -113,6 +120,11 @@ public:
 	{
 		m_onWorkReceived = _handler;
 	}
+	/// Where connect round trips are reported and resolved addresses ranked, may be null.
+	void setLatencyMonitor(PoolLatency* _latency)
+	{
+		m_latency = _latency;
+	}
 
 protected:
 	bool m_authorized = false;
@@ -124,6 +136,7 @@ protected:
 	Disconnected m_onDisconnected;
 	Connected m_onConnected;
 	WorkReceived m_onWorkReceived;
+	PoolLatency* m_latency = nullptr;
 };
 }
 }
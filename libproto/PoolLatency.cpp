@@ -0,0 +1,228 @@
+/*  Blah, blah, blah.. all this pedantic nonsense to say that this
+    source code is made available under the terms and conditions
+    of the accompanying GNU General Public License */
+
+#include <algorithm>
+#include <iomanip>
+#include <sstream>
+#include <boost/bind.hpp>
+
+#include "PoolLatency.h"
+
+using namespace std;
+using namespace dev;
+using namespace dev::eth;
+using boost::asio::ip::tcp;
+
+// Weight of a new sample in the moving averages.
+static const double c_alpha = 0.2;
+// Jobs from different pools this close together are taken to be for the same block.
+static const chrono::milliseconds c_skewWindow(2000);
+// Addresses of one pool probed per round.
+static const unsigned c_maxProbeAddresses = 4;
+static const size_t c_keepJobs = 16;
+
+static void average(double& _avg, double _sample)
+{
+	_avg = _avg < 0 ? _sample : _avg + c_alpha * (_sample - _avg);
+}
+
+PoolLatency::PoolLatency() :
+	m_probetimer(m_io_service)
+{
+}
+
+PoolLatency::~PoolLatency()
+{
+	m_io_service.stop();
+	if (m_serviceThread.joinable())
+		m_serviceThread.join();
+}
+
+string PoolLatency::key(PoolConnection const& _conn)
+{
+	stringstream ss;
+	ss << _conn.Host() << ':' << _conn.Port();
+	return ss.str();
+}
+
+void PoolLatency::addPool(PoolConnection const& _conn)
+{
+	Guard l(x_latency);
+	m_pools[key(_conn)].conn = _conn;
+}
+
+void PoolLatency::startProbing(unsigned _seconds)
+{
+	if (!_seconds || m_serviceThread.joinable())
+		return;
+	m_probeSeconds = _seconds;
+	m_probetimer.expires_from_now(boost::posix_time::seconds(0));
+	m_probetimer.async_wait(boost::bind(&PoolLatency::probe, this, boost::asio::placeholders::error));
+	m_serviceThread = std::thread{boost::bind(&boost::asio::io_service::run, &m_io_service)};
+}
+
+void PoolLatency::probe(const boost::system::error_code& ec)
+{
+	if (ec)
+		return;
+
+	boost::system::error_code cec;
+	for (auto& s : m_probes)
+		s->close(cec);
+	m_probes.clear();
+
+	vector<PoolConnection> conns;
+	{
+		Guard l(x_latency);
+		for (auto const& p : m_pools)
+			conns.push_back(p.second.conn);
+	}
+	for (auto const& conn : conns) {
+		// Resolved again each round, pools move their addresses around.
+		auto resolver = make_shared<tcp::resolver>(m_io_service);
+		tcp::resolver::query q(conn.Host(), to_string(conn.Port()));
+		resolver->async_resolve(q, boost::bind(&PoolLatency::probeResolved, this, boost::asio::placeholders::error,
+		                                       boost::asio::placeholders::iterator, resolver, key(conn)));
+	}
+
+	m_probetimer.expires_from_now(boost::posix_time::seconds(m_probeSeconds));
+	m_probetimer.async_wait(boost::bind(&PoolLatency::probe, this, boost::asio::placeholders::error));
+}
+
+void PoolLatency::probeResolved(const boost::system::error_code& ec, tcp::resolver::iterator i,
+                                shared_ptr<tcp::resolver> _resolver, string const& _pool)
+{
+	(void)_resolver;
+	if (ec)
+		return;
+	for (unsigned n = 0; i != tcp::resolver::iterator() && n < c_maxProbeAddresses; ++i, ++n) {
+		auto socket = make_shared<tcp::socket>(m_io_service);
+		tcp::endpoint ep = *i;
+		auto start = chrono::steady_clock::now();
+		m_probes.push_back(socket);
+		socket->async_connect(ep, [this, socket, ep, start, _pool](const boost::system::error_code & cec) {
+			if (cec)
+				return;
+			sampleAddress(_pool, ep, chrono::duration_cast<chrono::milliseconds>(chrono::steady_clock::now() - start).count());
+			boost::system::error_code sec;
+			socket->close(sec);
+		});
+	}
+}
+
+void PoolLatency::sampleAddress(string const& _pool, tcp::endpoint const& _ep, unsigned _ms)
+{
+	Guard l(x_latency);
+	m_pools[_pool].addresses.insert(_ep);
+	auto it = m_addresses.find(_ep);
+	if (it == m_addresses.end())
+		m_addresses[_ep] = _ms;
+	else
+		average(it->second, _ms);
+}
+
+void PoolLatency::connected(PoolConnection const& _conn, tcp::endpoint const& _ep, unsigned _ms)
+{
+	sampleAddress(key(_conn), _ep, _ms);
+}
+
+void PoolLatency::workReceived(PoolConnection const& _conn, WorkPackage const& _wp)
+{
+	auto now = chrono::steady_clock::now();
+	string k = key(_conn);
+	Guard l(x_latency);
+	Pool& pool = m_pools[k];
+	if (_wp.header == pool.header)
+		return;
+	pool.header = _wp.header;
+	pool.stats.jobs++;
+
+	for (auto job = m_jobs.rbegin(); job != m_jobs.rend(); ++job) {
+		bool same = _wp.block >= 0 && job->block >= 0 ? _wp.block == job->block : now - job->first < c_skewWindow;
+		if (!same || job->pools.count(k))
+			continue;
+		job->pools.insert(k);
+		average(pool.stats.skew, chrono::duration_cast<chrono::milliseconds>(now - job->first).count());
+		return;
+	}
+	// Nobody sent this one yet.
+	m_jobs.push_back(Job{_wp.block, now, {k}});
+	if (m_jobs.size() > c_keepJobs)
+		m_jobs.pop_front();
+	average(pool.stats.skew, 0);
+}
+
+void PoolLatency::accepted(PoolConnection const& _conn, unsigned _ms)
+{
+	Guard l(x_latency);
+	Stats& stats = m_pools[key(_conn)].stats;
+	average(stats.accept, _ms);
+	stats.shares++;
+}
+
+double PoolLatency::rtt(Pool const& _pool) const
+{
+	double best = -1;
+	for (auto const& ep : _pool.addresses) {
+		auto it = m_addresses.find(ep);
+		if (it != m_addresses.end() && (best < 0 || it->second < best))
+			best = it->second;
+	}
+	return best;
+}
+
+void PoolLatency::rank(vector<tcp::endpoint>& _eps) const
+{
+	Guard l(x_latency);
+	stable_sort(_eps.begin(), _eps.end(), [this](tcp::endpoint const & a, tcp::endpoint const & b) {
+		auto ia = m_addresses.find(a);
+		auto ib = m_addresses.find(b);
+		if (ib == m_addresses.end())
+			return ia != m_addresses.end();
+		return ia != m_addresses.end() && ia->second < ib->second;
+	});
+}
+
+PoolLatency::Stats PoolLatency::stats(PoolConnection const& _conn) const
+{
+	Guard l(x_latency);
+	auto it = m_pools.find(key(_conn));
+	if (it == m_pools.end())
+		return Stats();
+	Stats s = it->second.stats;
+	s.rtt = rtt(it->second);
+	return s;
+}
+
+double PoolLatency::risk(PoolConnection const& _conn) const
+{
+	Stats s = stats(_conn);
+	if (s.rtt < 0)
+		return -1;
+	// A pool we never submitted to is assumed to add nothing to the round trip.
+	return s.rtt + s.skew + (s.accept > s.rtt ? s.accept - s.rtt : 0);
+}
+
+string PoolLatency::report(vector<PoolConnection> const& _conns) const
+{
+	stringstream ss;
+	ss << fixed << setprecision(0);
+	for (auto const& conn : _conns) {
+		Stats s = stats(conn);
+		if (ss.tellp() > 0)
+			ss << ", ";
+		ss << key(conn) << " rtt ";
+		if (s.rtt < 0)
+			ss << '-';
+		else
+			ss << s.rtt;
+		ss << " skew " << s.skew << " accept ";
+		if (s.accept < 0)
+			ss << '-';
+		else
+			ss << s.accept;
+		ss << " ms";
+	}
+	return ss.str();
+}
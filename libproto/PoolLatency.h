@@ -0,0 +1,96 @@
+/*  Blah, blah, blah.. all this pedantic nonsense to say that this
+    source code is made available under the terms and conditions
+    of the accompanying GNU General Public License */
+
+#pragma once
+
+#include <chrono>
+#include <deque>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <set>
+#include <thread>
+#include <vector>
+#include <boost/asio.hpp>
+#include "PoolClient.h"
+
+namespace dev
+{
+namespace eth
+{
+
+/// Measures how fast each pool connects, delivers new jobs and accepts shares, and
+/// ranks pools and their resolved addresses by the risk of shares going stale.
+///
+/// Connect round trips come from the clients' own connects and from probes: every
+/// probe interval a TCP connection is opened to each resolved address of each pool
+/// and closed again. The notify skew of a pool is how much later than the fastest
+/// pool it delivers the job for a new block. Jobs are matched by block number when
+/// the pools report one, otherwise jobs arriving within c_skewWindow of each other
+/// are taken to be the same block. All figures are moving averages in milliseconds.
+class PoolLatency
+{
+public:
+	struct Stats {
+		double rtt = -1;       ///< TCP connect round trip, -1 until measured
+		double skew = 0;       ///< delay behind the first pool to send a new job
+		double accept = -1;    ///< submit to accept, -1 until a share was accepted
+		unsigned jobs = 0;
+		unsigned shares = 0;
+	};
+
+	PoolLatency();
+	~PoolLatency();
+
+	void addPool(PoolConnection const& _conn);
+	/// Probe every pool each @a _seconds on a thread of our own.
+	void startProbing(unsigned _seconds);
+
+	void connected(PoolConnection const& _conn, boost::asio::ip::tcp::endpoint const& _ep, unsigned _ms);
+	void workReceived(PoolConnection const& _conn, WorkPackage const& _wp);
+	void accepted(PoolConnection const& _conn, unsigned _ms);
+
+	/// Move the addresses that connected fastest to the front. Unmeasured ones keep their order behind them.
+	void rank(std::vector<boost::asio::ip::tcp::endpoint>& _eps) const;
+	/// Expected delay in ms before a share found on this pool's work counts, -1 while the round trip is unknown.
+	/// The round trip plus the notify skew, plus whatever the pool adds to the round trip when accepting.
+	double risk(PoolConnection const& _conn) const;
+	Stats stats(PoolConnection const& _conn) const;
+	std::string report(std::vector<PoolConnection> const& _conns) const;
+
+private:
+	struct Pool {
+		PoolConnection conn;
+		Stats stats;
+		std::set<boost::asio::ip::tcp::endpoint> addresses;
+		h256 header;
+	};
+
+	struct Job {
+		int64_t block;
+		std::chrono::steady_clock::time_point first;
+		std::set<std::string> pools;
+	};
+
+	static std::string key(PoolConnection const& _conn);
+	double rtt(Pool const& _pool) const;
+	void sampleAddress(std::string const& _pool, boost::asio::ip::tcp::endpoint const& _ep, unsigned _ms);
+	void probe(const boost::system::error_code& ec);
+	void probeResolved(const boost::system::error_code& ec, boost::asio::ip::tcp::resolver::iterator i,
+	                   std::shared_ptr<boost::asio::ip::tcp::resolver> _resolver, std::string const& _pool);
+
+	mutable std::mutex x_latency;
+	std::map<std::string, Pool> m_pools;
+	std::map<boost::asio::ip::tcp::endpoint, double> m_addresses;    ///< connect round trip per address
+	std::deque<Job> m_jobs;    ///< recent new jobs, newest last
+
+	unsigned m_probeSeconds = 0;
+	boost::asio::io_service m_io_service;    ///< probes only
+	boost::asio::deadline_timer m_probetimer;
+	std::vector<std::shared_ptr<boost::asio::ip::tcp::socket>> m_probes;    ///< this round's, closed by the next
+	std::thread m_serviceThread;
+};
+
+}
+}
@@ -5,6 +5,7 @@
 #include "PoolManager.h"
 #include "libdevcore/Log.h"
 #include <chrono>
+#include <random>
 #include <sstream>
 #include <boost/multiprecision/cpp_int.hpp>
 
@@ -28,42 +29,212 @@ static string hashToString(double diff, bool rate)
 
 extern bool g_display_effective;
 
+// A standby this much less likely to produce stale shares takes over from the active pool.
+static const double c_switchRatio = 0.75;
+static const double c_switchMinMs = 10;
+// Never switch for latency more often than this.
+static const chrono::minutes c_switchHold(10);
+// Reconnect delays double from the first to the last.
+static const unsigned c_firstBackoffMs = 1000;
+static const unsigned c_maxBackoffMs = 64000;
+// Shares found while disconnected, sent once the pool is back if not older than this.
+static const chrono::seconds c_pendingAge(30);
+static const size_t c_maxPending = 64;
+
 PoolManager::PoolManager(PoolClient& client, Farm& farm, MinerType const& minerType) :
-	Worker("main"), m_client(client), m_farm(farm), m_minerType(minerType), m_effStartTime(farm.farmLaunched())
+	Worker("main"), m_client(&client), m_farm(farm), m_minerType(minerType), m_effStartTime(farm.farmLaunched())
+{
+	bindClient(client);
+
+	// Solutions are submitted from the active client's network thread, not the miner's. The miner
+	// must not wait for x_clients, it is held while switching pools and publishing their work.
+	m_farm.onSolutionsQueued([this]() {
+		m_client.load()->post([this]() {
+			m_farm.drainSolutions();
+		});
+	});
+
+	m_farm.onSolutionFound([&](Solution sol) {
+		PoolClient* client;
+		{
+			Guard l(x_clients);
+			client = m_client;
+			if (sol.work.connection != m_activeConnectionIdx) {
+				// Found on work of a pool we have switched away from, this one would reject it.
+				logwarn(sol.gpu << " 0x" + toHex(sol.nonce) + " dropped, the work is from another pool");
+				m_farm.rejectedSolution();
+				return false;
+			}
+			if (!client->isConnected()) {
+				if (m_pending.size() == c_maxPending) {
+					m_pending.pop_front();
+					m_farm.rejectedSolution();
+				}
+				m_pending.push_back(PendingSolution{sol, chrono::steady_clock::now()});
+				loginfo(fgYellow << sol.gpu << " 0x" + toHex(sol.nonce) + " held until reconnected" << fgReset);
+				return false;
+			}
+		}
+		client->submitSolution(sol);
+		loginfo(string(sol.stale ? fgYellow : fgWhite) << sol.gpu << (sol.stale ? " (stale)" : "") << " 0x" + toHex(
+		            sol.nonce) + " submitted" << fgReset);
+		return false;
+	});
+}
+
+void PoolManager::setStandbyClient(PoolClient& client)
+{
+	m_standby = &client;
+	bindClient(client);
+}
+
+PoolClient& PoolManager::activeClient()
+{
+	Guard l(x_clients);
+	return *m_client.load();
+}
+
+void PoolManager::startFarm()
+{
+	if (m_farm.isMining())
+		return;
+	loginfo("Spinning up miners...");
+	m_farm.start(m_minerType);
+	m_farmStarted = true;
+}
+
+void PoolManager::switchToStandby()
+{
+	PoolClient* previous = m_client;
+	m_client = m_standby;
+	m_standby = previous;
+	swap(m_activeConnectionIdx, m_standbyConnectionIdx);
+	swap(m_activeWork, m_standbyWork);
+	PoolConnection const& next = m_connections[m_activeConnectionIdx];
+	m_farm.set_pool_addresses(next.Host(), next.Port());
+	m_farm.setWork(m_activeWork);
+	m_failures[m_client.load()] = 0;
+	m_lastSwitch = chrono::steady_clock::now();
+}
+
+void PoolManager::checkLatency()
 {
+	Guard l(x_clients);
+	if (m_connections.size() < 2)
+		return;
+	loginfo("Latency " << m_latency.report(m_connections));
+	if (!m_standby || !m_standby->isConnected() || !m_standbyWork || !m_client.load()->isConnected())
+		return;
+	if (chrono::steady_clock::now() - m_lastSwitch < c_switchHold)
+		return;
+	double active = m_latency.risk(m_connections[m_activeConnectionIdx]);
+	double standby = m_latency.risk(m_connections[m_standbyConnectionIdx]);
+	if (active < 0 || standby < 0 || standby > active * c_switchRatio || active - standby < c_switchMinMs)
+		return;
+	// Both stay connected, the slower pool becomes the standby.
+	switchToStandby();
+	PoolConnection const& next = m_connections[m_activeConnectionIdx];
+	loginfo("Switched to " << next.Host() << ':' << next.Port() << ", expected share delay " << fixed <<
+	        setprecision(0) << standby << " ms instead of " << active << " ms");
+}
 
-	m_client.onConnected([&](boost::asio::ip::address address) {
-		m_connection.Address(address);
+vector<Solution> PoolManager::takePending(WorkPackage const& wp)
+{
+	// Only shares for this pool and epoch, and on nicehash the same extranonce, can still count.
+	vector<Solution> valid;
+	auto now = chrono::steady_clock::now();
+	for (auto const& p : m_pending) {
+		WorkPackage const& w = p.solution.work;
+		if (w.connection == m_activeConnectionIdx && now - p.found < c_pendingAge && w.seed == wp.seed &&
+		        w.exSizeBits == wp.exSizeBits && (wp.exSizeBits <= 0 || w.startNonce == wp.startNonce))
+			valid.push_back(p.solution);
+		else {
+			logwarn(p.solution.gpu << " 0x" + toHex(p.solution.nonce) + " dropped, no longer valid");
+			m_farm.rejectedSolution();
+		}
+	}
+	m_pending.clear();
+	return valid;
+}
+
+void PoolManager::bindClient(PoolClient& client)
+{
+	PoolClient* c = &client;
+	client.setLatencyMonitor(&m_latency);
+
+	client.onConnected([this, c](boost::asio::ip::address address) {
+		bool active;
+		PoolConnection conn;
+		{
+			Guard l(x_clients);
+			active = c == m_client;
+			m_connections[active ? m_activeConnectionIdx : m_standbyConnectionIdx].Address(address);
+			conn = m_connections[active ? m_activeConnectionIdx : m_standbyConnectionIdx];
+		}
 		stringstream saddr;
 		const boost::asio::ip::address nulladdr;
 		if (address != nulladdr)
 			saddr << '(' << address << ')';
 		stringstream sport;
-		sport << m_connection.Port();
-		loginfo("Connected to " << m_connection.Host() << saddr.str() << ':' << sport.str());
-		if (!m_farm.isMining()) {
-			loginfo("Spinning up miners...");
-			if (m_minerType == MinerType::CL)
-				m_farm.start("opencl", false);
-			else if (m_minerType == MinerType::CUDA)
-				m_farm.start("cuda", false);
-			else if (m_minerType == MinerType::Mixed) {
-				m_farm.start("cuda", false);
-				m_farm.start("opencl", true);
-			}
-			m_farmStarted = true;
-		}
+		sport << conn.Port();
+		loginfo("Connected to " << conn.Host() << saddr.str() << ':' << sport.str() << (active ? "" : " (standby)"));
+		if (active)
+			startFarm();
 	});
 
-	m_client.onDisconnected([&]() {
-		logwarn("Disconnected from " + m_connection.Host());
+	client.onDisconnected([this, c]() {
+		bool active;
+		bool switched = false;
+		PoolConnection conn;
+		{
+			Guard l(x_clients);
+			active = c == m_client;
+			conn = m_connections[active ? m_activeConnectionIdx : m_standbyConnectionIdx];
+			if (active && m_standby && m_standby->isConnected() && m_standbyWork) {
+				// Hot standby: mine its work right away, the failed client becomes the standby.
+				switchToStandby();
+				m_standbyWork = WorkPackage();
+				switched = true;
+				PoolConnection const& next = m_connections[m_activeConnectionIdx];
+				logwarn("Disconnected from " << conn.Host() << ", switched to " << next.Host() << ':' << next.Port());
+			}
+			else if (!active)
+				// It may come back on another pool, its old work can't be switched to.
+				m_standbyWork = WorkPackage();
+		}
+		if (switched)
+			startFarm();
+		else
+			logwarn("Disconnected from " << conn.Host() << (active ? "" : " (standby)"));
 
-		tryReconnect();
+		tryReconnect(*c);
 	});
 
-	m_client.onWorkReceived([&](WorkPackage const & wp) {
-		m_reconnectTry = 0;
-		m_farm.setWork(wp);
+	client.onWorkReceived([this, c](WorkPackage const & _wp) {
+		WorkPackage wp = _wp;
+		vector<Solution> resubmit;
+		{
+			Guard l(x_clients);
+			bool active = c == m_client;
+			m_failures[c] = 0;
+			// Solutions carry the index back, so those for another pool's work are never sent here.
+			wp.connection = active ? m_activeConnectionIdx : m_standbyConnectionIdx;
+			m_latency.workReceived(m_connections[wp.connection], wp);
+			if (!active) {
+				m_standbyWork = wp;
+				return;
+			}
+			m_activeWork = wp;
+			if (!m_pending.empty())
+				resubmit = takePending(wp);
+			// Published under the lock, as switchToStandby() does, so work from a pool switched
+			// away from meanwhile can't overwrite the new active pool's.
+			m_farm.setWork(wp);
+		}
+		for (auto const& sol : resubmit) {
+			c->submitSolution(sol);
+			loginfo(fgYellow << sol.gpu << " 0x" + toHex(sol.nonce) + " resubmitted" << fgReset);
+		}
 		if (wp.boundary != m_lastBoundary) {
 			using namespace boost::multiprecision;
 
@@ -85,11 +256,14 @@ PoolManager::PoolManager(PoolClient& client, Farm& farm, MinerType const& minerT
 		loginfo("Header: " fgWhite "0x" << wp.header.hex().substr(0, 15) << ".." fgReset);
 	});
 
-	m_client.onSolutionAccepted([&](bool stale) {
+	client.onSolutionAccepted([this, c](bool stale, unsigned ms) {
 		using namespace std::chrono;
+		{
+			Guard l(x_clients);
+			m_latency.accepted(m_connections[c == m_client ? m_activeConnectionIdx : m_standbyConnectionIdx], ms);
+		}
 		m_farm.acceptedSolution(stale);
 		steady_clock::time_point now = steady_clock::now();
-		auto ms = duration_cast<milliseconds>(now - m_submit_time);
 		if (!stale && g_display_effective) {
 			stringstream effRate;
 			{
@@ -99,24 +273,14 @@ PoolManager::PoolManager(PoolClient& client, Farm& farm, MinerType const& minerT
 			}
 			loginfo(effRate.str());
 		}
-		loginfo(string(stale ? fgYellow : fgLime) << "Accepted" << (stale ? " (stale)" : "") << " in " << ms.count() <<
+		loginfo(string(stale ? fgYellow : fgLime) << "Accepted" << (stale ? " (stale)" : "") << " in " << ms <<
 		        " ms. " << fgReset);
 	});
 
-	m_client.onSolutionRejected([&](bool stale, string const & msg) {
-		using namespace std::chrono;
-		auto ms = duration_cast<milliseconds>(steady_clock::now() - m_submit_time);
-		loginfo(fgRed "Rejected" << (stale ? " (stale)" : "") << " in " << ms.count() << " ms." << fgReset << " " << msg);
+	client.onSolutionRejected([&](bool stale, unsigned ms, string const & msg) {
+		loginfo(fgRed "Rejected" << (stale ? " (stale)" : "") << " in " << ms << " ms." << fgReset << " " << msg);
 		m_farm.rejectedSolution();
 	});
-
-	m_farm.onSolutionFound([&](Solution sol) {
-		m_submit_time = std::chrono::steady_clock::now();
-		m_client.submitSolution(sol);
-		loginfo(string(sol.stale ? fgYellow : fgWhite) << sol.gpu << (sol.stale ? " (stale)" : "") << " 0x" + toHex(
-		            sol.nonce) + " submitted" << fgReset);
-		return false;
-	});
 }
 
 void PoolManager::effectiveHR(stringstream& ss)
@@ -170,11 +334,13 @@ void PoolManager::workLoop()
 {
 	while (true) {
 		this_thread::sleep_for(chrono::minutes(2));
+		checkLatency();
 		// Hashrate reporting
 		if (m_farmStarted) {
-			auto mp = m_farm.miningProgress();
+			// The last whole minute, steadier than the 10 second samples.
+			auto mp = m_farm.miningProgress(HashrateSampler::Minute);
 			if (g_report_stratum_hashrate)
-				m_client.submitHashrate(mp.rate());
+				activeClient().submitHashrate(mp.rate());
 		}
 	}
 }
@@ -184,40 +350,71 @@ void PoolManager::addConnection(PoolConnection& conn)
 	if (conn.Empty())
 		return;
 
-	m_connection = conn;
-
-	m_client.setConnection(conn);
-	m_farm.set_pool_addresses(conn.Host(), conn.Port());
-}
-
-void PoolManager::start()
-{
-	if (!m_connection.Empty()) {
-		startWorking();
-		// Try to connect to pool
-		m_client.connect();
+	Guard l(x_clients);
+	m_connections.push_back(conn);
+	m_latency.addPool(conn);
+	if (m_connections.size() == 1) {
+		m_client.load()->setConnection(conn);
+		m_farm.set_pool_addresses(conn.Host(), conn.Port());
 	}
-	else
-		logerror("Manager has no connections defined!");
 }
 
-void PoolManager::tryReconnect()
+void PoolManager::start()
 {
-	// No connections available, so why bother trying to reconnect
-	if (m_connection.Empty()) {
+	if (m_connections.empty()) {
 		logerror("Manager has no connections defined!");
 		return;
 	}
-	logwarn("Retrying in 3 seconds.");
 
-	this_thread::sleep_for(chrono::seconds(3));
+	startWorking();
+	// A single pool has nothing to be ranked against, don't connect to it every interval.
+	if (m_connections.size() > 1)
+		m_latency.startProbing(m_probeInterval);
+	if (m_standby && m_connections.size() > 1) {
+		m_standbyConnectionIdx = 1;
+		m_standby->setConnection(m_connections[1]);
+		m_standby->connect();
+	}
+	// Try to connect to pool
+	m_client.load()->connect();
+}
 
-	if (m_reconnectTries >= m_reconnectTry) {
-		m_reconnectTry++;
-		m_client.connect();
-		return;
+void PoolManager::tryReconnect(PoolClient& client)
+{
+	Guard l(x_clients);
+	unsigned& failures = m_failures[&client];
+	unsigned ms = min(c_firstBackoffMs << min(failures, 16u), c_maxBackoffMs);
+	failures++;
+
+	if (&client == m_standby) {
+		// Keep the standby on the next pool in the list that isn't the active one.
+		unsigned idx = m_standbyConnectionIdx;
+		do
+			idx = (idx + 1) % m_connections.size();
+		while (idx == m_activeConnectionIdx);
+		m_standbyConnectionIdx = idx;
+		client.setConnection(m_connections[idx]);
+	}
+	else if (failures > m_reconnectTries) {
+		// Retries are used up, fail over to the next pool the standby isn't holding. With
+		// nowhere else to go keep trying the same one, the miners go on with the last job.
+		unsigned idx = m_activeConnectionIdx;
+		do
+			idx = (idx + 1) % m_connections.size();
+		while (m_standby && idx == m_standbyConnectionIdx && m_connections.size() > 2);
+		if (idx != m_activeConnectionIdx && !(m_standby && idx == m_standbyConnectionIdx)) {
+			m_activeConnectionIdx = idx;
+			failures = 0;
+			ms = c_firstBackoffMs;
+			logwarn("Switching to " << m_connections[idx].Host());
+			m_farm.set_pool_addresses(m_connections[idx].Host(), m_connections[idx].Port());
+			client.setConnection(m_connections[idx]);
+		}
 	}
 
-	logerror("Could not connect.");
-	throw runtime_error("Connect fail");
+	// Spread out the miners of a pool coming back.
+	static mt19937 s_rng{random_device{}()};
+	ms = uniform_int_distribution<unsigned>(ms * 3 / 4, ms)(s_rng);
+	logwarn("Retrying in " << fixed << setprecision(1) << ms / 1000.0 << " seconds.");
+	client.reconnect(ms);
 }
@@ -4,14 +4,19 @@
 
 #pragma once
 
+#include <atomic>
 #include <iostream>
+#include <deque>
 #include <list>
+#include <map>
 #include <mutex>
+#include <vector>
 #include <libdevcore/Worker.h>
 #include <libethcore/Farm.h>
 #include <libethcore/Miner.h>
 
 #include "PoolClient.h"
+#include "PoolLatency.h"
 
 using namespace std;
 
@@ -23,15 +28,24 @@ class PoolManager : public Worker
 {
 public:
 	PoolManager(PoolClient& client, Farm& farm, MinerType const& minerType);
+	/// A second client kept connected to the next pool in the list. When the active
+	/// connection drops the farm switches to the standby's work without waiting.
+	void setStandbyClient(PoolClient& client);
+	/// Pools in order of preference, the first one is mined first.
 	void addConnection(PoolConnection& conn);
 	void start();
 	void setReconnectTries(unsigned const& reconnectTries)
 	{
 		m_reconnectTries = reconnectTries;
 	};
+	/// Seconds between connect probes of every pool, 0 to only measure real connections.
+	void setProbeInterval(unsigned const& probeInterval)
+	{
+		m_probeInterval = probeInterval;
+	};
 	bool isConnected()
 	{
-		return m_client.isConnected();
+		return activeClient().isConnected();
 	};
 	bool difficulty()
 	{
@@ -40,18 +54,37 @@ public:
 	void effectiveHR(std::stringstream& ss);
 
 private:
-	void tryReconnect();
+	void bindClient(PoolClient& client);
+	PoolClient& activeClient();
+	void startFarm();
+	void switchToStandby();
+	void checkLatency();
+	void tryReconnect(PoolClient& client);
+	std::vector<Solution> takePending(WorkPackage const& wp);
 	void workLoop() override;
 
-	PoolClient& m_client;
+	std::atomic<PoolClient*> m_client;     ///< the connection being mined, set under x_clients, miners read it without
+	PoolClient* m_standby = nullptr;
+	WorkPackage m_activeWork;
+	WorkPackage m_standbyWork;             ///< latest work of the standby, ready to switch to
+	std::mutex x_clients;
 	unsigned m_reconnectTries = 3;
-	unsigned m_reconnectTry = 0;
+	std::map<PoolClient*, unsigned> m_failures;    ///< connects in a row that failed, sets the backoff
+	std::vector<PoolConnection> m_connections;
 	unsigned m_activeConnectionIdx = 0;
-	PoolConnection m_connection;
+	unsigned m_standbyConnectionIdx = 0;
+	PoolLatency m_latency;
+	unsigned m_probeInterval = 0;
+	std::chrono::steady_clock::time_point m_lastSwitch;
+
+	struct PendingSolution {
+		Solution solution;
+		std::chrono::steady_clock::time_point found;
+	};
+	std::deque<PendingSolution> m_pending;    ///< found while disconnected
 	h256 m_lastBoundary = h256();
 	Farm& m_farm;
 	MinerType m_minerType;
-	std::chrono::steady_clock::time_point m_submit_time;
 	std::list<std::chrono::steady_clock::time_point> m_10_accepts;
 	std::list<std::chrono::steady_clock::time_point> m_60_accepts;
 	std::list<std::chrono::steady_clock::time_point> m_360_accepts;
@@ -0,0 +1,122 @@
+/*  Blah, blah, blah.. all this pedantic nonsense to say that this
+    source code is made available under the terms and conditions
+    of the accompanying GNU General Public License */
+
+#include <stdexcept>
+#include <libdevcore/Common.h>
+#include "StratumCapture.h"
+
+using namespace std;
+using namespace dev;
+using namespace dev::eth;
+
+static const char c_captureMagic[8] = {'S', 'T', 'R', 'C', 'A', 'P', '1', '\n'};
+
+static const unsigned c_sent = 1;
+static const unsigned c_connect = 2;
+static const unsigned c_clientShift = 2;
+
+StratumCapture dev::eth::g_capture;
+
+bool StratumCapture::open(string const& _path)
+{
+	Guard l(x_capture);
+	m_file.open(_path, ios::binary | ios::trunc);
+	if (!m_file)
+		return false;
+	m_file.write(c_captureMagic, sizeof(c_captureMagic));
+	m_last = chrono::steady_clock::now();
+	m_active = true;
+	return true;
+}
+
+void StratumCapture::connected(unsigned _client, unsigned _dialect)
+{
+	char dialect = _dialect;
+	record(c_connect | _client << c_clientShift, &dialect, 1);
+}
+
+void StratumCapture::received(unsigned _client, char const* _line, size_t _size)
+{
+	record(_client << c_clientShift, _line, _size);
+}
+
+void StratumCapture::sent(unsigned _client, char const* _line, size_t _size)
+{
+	record(c_sent | _client << c_clientShift, _line, _size);
+}
+
+void StratumCapture::record(unsigned _flags, char const* _data, size_t _size)
+{
+	if (!active())
+		return;
+
+	char buf[24];
+	size_t n = 0;
+	auto varint = [&](uint64_t v) {
+		while (v >= 0x80) {
+			buf[n++] = (char)(v | 0x80);
+			v >>= 7;
+		}
+		buf[n++] = (char)v;
+	};
+
+	Guard l(x_capture);
+	auto now = chrono::steady_clock::now();
+	varint(chrono::duration_cast<chrono::microseconds>(now - m_last).count());
+	m_last = now;
+	buf[n++] = (char)_flags;
+	varint(_size);
+	m_file.write(buf, n);
+	m_file.write(_data, _size);
+	// Keep what was captured so far when the miner gets killed.
+	m_file.flush();
+}
+
+StratumCaptureReader::StratumCaptureReader(string const& _path):
+	m_file(_path, ios::binary)
+{
+	char magic[sizeof(c_captureMagic)];
+	if (!m_file.read(magic, sizeof(magic)))
+		throw runtime_error("Can't read capture " + _path);
+	if (!equal(magic, magic + sizeof(magic), c_captureMagic))
+		throw runtime_error(_path + " is not a stratum capture");
+}
+
+bool StratumCaptureReader::varint(uint64_t& o_v)
+{
+	o_v = 0;
+	for (unsigned shift = 0; shift < 64; shift += 7) {
+		char c;
+		if (!m_file.get(c))
+			return false;
+		o_v |= (uint64_t)(c & 0x7f) << shift;
+		if (!(c & 0x80))
+			return true;
+	}
+	return false;
+}
+
+bool StratumCaptureReader::next(Record& o_record)
+{
+	uint64_t delta;
+	uint64_t size;
+	char flags;
+	if (!varint(delta) || !m_file.get(flags) || !varint(size))
+		return false;
+	m_us += delta;
+
+	o_record.us = m_us;
+	o_record.sent = flags & c_sent;
+	o_record.connect = flags & c_connect;
+	o_record.client = (unsigned char)flags >> c_clientShift;
+	o_record.line.resize(size);
+	if (size && !m_file.read(&o_record.line[0], size))
+		return false;
+	o_record.dialect = 0;
+	if (o_record.connect) {
+		o_record.dialect = size ? (unsigned char)o_record.line[0] : 0;
+		o_record.line.clear();
+	}
+	return true;
+}
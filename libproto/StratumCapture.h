@@ -0,0 +1,79 @@
+/*  Blah, blah, blah.. all this pedantic nonsense to say that this
+    source code is made available under the terms and conditions
+    of the accompanying GNU General Public License */
+
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <fstream>
+#include <mutex>
+#include <string>
+
+namespace dev
+{
+namespace eth
+{
+
+/// Raw stratum lines with their timing, written by the pool clients for replaying later.
+///
+/// The file starts with c_captureMagic, followed by records of
+///   varint  microseconds since the previous record
+///   byte    bit 0 set for lines sent to the pool, bit 1 set for a connect mark,
+///           the other bits the client the line belongs to
+///   varint  length
+///   bytes   the line without its line ending, or for a connect mark the stratum dialect
+/// Varints are little endian base 128.
+class StratumCapture
+{
+public:
+	bool open(std::string const& _path);
+	bool active() const
+	{
+		return m_active.load(std::memory_order_relaxed);
+	}
+
+	void connected(unsigned _client, unsigned _dialect);
+	void received(unsigned _client, char const* _line, size_t _size);
+	void sent(unsigned _client, char const* _line, size_t _size);
+
+private:
+	void record(unsigned _flags, char const* _data, size_t _size);
+
+	std::mutex x_capture;
+	std::ofstream m_file;
+	std::chrono::steady_clock::time_point m_last;
+	std::atomic<bool> m_active = {false};
+};
+
+/// Reads back what StratumCapture wrote.
+class StratumCaptureReader
+{
+public:
+	struct Record {
+		uint64_t us = 0;    ///< since the start of the capture
+		bool sent = false;
+		bool connect = false;
+		unsigned client = 0;
+		std::string line;    ///< empty for a connect mark
+		unsigned dialect = 0;    ///< connect marks only
+	};
+
+	/// Throws runtime_error if the file can't be read or isn't a capture.
+	explicit StratumCaptureReader(std::string const& _path);
+
+	/// False at the end of the file or on a truncated record.
+	bool next(Record& o_record);
+
+private:
+	bool varint(uint64_t& o_v);
+
+	std::ifstream m_file;
+	uint64_t m_us = 0;
+};
+
+extern StratumCapture g_capture;
+
+}
+}
@@ -0,0 +1,427 @@
+/*  Blah, blah, blah.. all this pedantic nonsense to say that this
+    source code is made available under the terms and conditions
+    of the accompanying GNU General Public License */
+
+#include <cstring>
+#include <libdevcore/Common.h>
+#include "StratumCodec.h"
+
+using namespace std;
+using namespace dev;
+using namespace dev::eth;
+
+namespace
+{
+
+int hexNibble(char _c)
+{
+	if (_c >= '0' && _c <= '9')
+		return _c - '0';
+	if (_c >= 'a' && _c <= 'f')
+		return _c - 'a' + 10;
+	if (_c >= 'A' && _c <= 'F')
+		return _c - 'A' + 10;
+	return -1;
+}
+
+bool isSpace(char _c)
+{
+	return _c == ' ' || _c == '\t' || _c == '\r' || _c == '\n';
+}
+
+struct Scanner {
+	char const* p;
+	char const* end;
+
+	void ws()
+	{
+		while (p < end && isSpace(*p))
+			p++;
+	}
+
+	bool at(char _c)
+	{
+		ws();
+		return p < end && *p == _c;
+	}
+
+	bool string(StratumSpan& o_s)
+	{
+		o_s.data = ++p;
+		o_s.escaped = false;
+		while (p < end && *p != '"') {
+			if (*p == '\\') {
+				o_s.escaped = true;
+				p++;
+			}
+			p++;
+		}
+		if (p >= end)
+			return false;
+		o_s.size = p++ - o_s.data;
+		o_s.type = StratumSpan::String;
+		return true;
+	}
+
+	// Step over a nested array or object.
+	bool skip()
+	{
+		int depth = 0;
+		while (p < end) {
+			char c = *p++;
+			if (c == '"') {
+				while (p < end && *p != '"')
+					p += *p == '\\' ? 2 : 1;
+				if (p++ >= end)
+					return false;
+			}
+			else if (c == '[' || c == '{')
+				depth++;
+			else if ((c == ']' || c == '}') && --depth == 0)
+				return true;
+		}
+		return false;
+	}
+
+	// A value. Arrays are split into @a o_items when given, anything nested is skipped.
+	bool value(StratumSpan& o_s, StratumSpan* o_items = nullptr, unsigned* o_count = nullptr)
+	{
+		ws();
+		if (p >= end)
+			return false;
+		char const* start = p;
+		if (*p == '"')
+			return string(o_s);
+		if (*p == '[' && o_items) {
+			p++;
+			*o_count = 0;
+			if (at(']'))
+				p++;
+			else
+				while (true) {
+					StratumSpan item;
+					if (!value(item))
+						return false;
+					if (*o_count < StratumMessage::c_maxItems)
+						o_items[(*o_count)++] = item;
+					if (at(','))
+						p++;
+					else if (at(']')) {
+						p++;
+						break;
+					}
+					else
+						return false;
+				}
+		}
+		else if (*p == '[' || *p == '{') {
+			if (!skip())
+				return false;
+		}
+		else {
+			while (p < end && *p != ',' && *p != ']' && *p != '}' && !isSpace(*p))
+				p++;
+			o_s.data = start;
+			o_s.size = p - start;
+			if (o_s == "true")
+				o_s.type = StratumSpan::True;
+			else if (o_s == "false")
+				o_s.type = StratumSpan::False;
+			else if (o_s == "null")
+				o_s.type = StratumSpan::Null;
+			else if (o_s.size && (*start == '-' || (*start >= '0' && *start <= '9')))
+				o_s.type = StratumSpan::Number;
+			else
+				return false;
+			return true;
+		}
+		o_s.data = start;
+		o_s.size = p - start;
+		o_s.type = (StratumSpan::Type)*start;
+		return true;
+	}
+};
+
+}
+
+bool StratumSpan::operator==(char const* _s) const
+{
+	size_t n = strlen(_s);
+	return n == size && !memcmp(data, _s, n);
+}
+
+bool dev::eth::hexToHash(StratumSpan const& _s, h256& o_hash, HexAlign _align)
+{
+	char const* p = _s.data;
+	size_t n = _s.size;
+	if (n >= 2 && p[0] == '0' && (p[1] == 'x' || p[1] == 'X')) {
+		p += 2;
+		n -= 2;
+	}
+	if (n > 64 || (_align == HexAlign::Exact && n != 64))
+		return false;
+
+	byte* out = o_hash.data();
+	memset(out, 0, h256::size);
+	size_t offset = _align == HexAlign::Right ? 64 - n : 0;
+	for (size_t i = 0; i < n; i++) {
+		int v = hexNibble(p[i]);
+		if (v < 0)
+			return false;
+		size_t nibble = offset + i;
+		out[nibble / 2] |= nibble & 1 ? v : v << 4;
+	}
+	return true;
+}
+
+bool StratumMessage::parse(char const* _line, size_t _size)
+{
+	*this = StratumMessage();
+	Scanner s{_line, _line + _size};
+	if (!s.at('{'))
+		return false;
+	s.p++;
+	if (s.at('}'))
+		s.p++;
+	else
+		while (true) {
+			StratumSpan key;
+			StratumSpan skipped;
+			if (!s.at('"') || !s.string(key) || !s.at(':'))
+				return false;
+			s.p++;
+
+			bool ok;
+			if (key == "params")
+				ok = s.value(params, paramItems, &paramCount);
+			else if (key == "result")
+				ok = s.value(result, resultItems, &resultCount);
+			else if (key == "id")
+				ok = s.value(id);
+			else if (key == "method")
+				ok = s.value(method);
+			else if (key == "error")
+				ok = s.value(error);
+			else
+				ok = s.value(skipped);
+			if (!ok)
+				return false;
+
+			if (s.at(','))
+				s.p++;
+			else if (s.at('}')) {
+				s.p++;
+				break;
+			}
+			else
+				return false;
+		}
+	s.ws();
+	return s.p == s.end;
+}
+
+int StratumMessage::intId() const
+{
+	if (id.type != StratumSpan::Number)
+		return -1;
+	int v = 0;
+	for (size_t i = 0; i < id.size; i++) {
+		if (id.data[i] < '0' || id.data[i] > '9' || v > 100000000)
+			return -1;
+		v = v * 10 + id.data[i] - '0';
+	}
+	return v;
+}
+
+StratumFramer::StratumFramer(size_t _capacity)
+{
+	size_t capacity = 1;
+	while (capacity < _capacity)
+		capacity <<= 1;
+	m_ring.resize(capacity);
+	m_line.resize(capacity + 1);
+	m_mask = capacity - 1;
+}
+
+pair<char*, size_t> StratumFramer::writable()
+{
+	size_t pos = m_tail & m_mask;
+	size_t room = m_ring.size() - (m_tail - m_head);
+	return {m_ring.data() + pos, min(room, m_ring.size() - pos)};
+}
+
+void StratumFramer::commit(size_t _bytes)
+{
+	m_tail += _bytes;
+}
+
+bool StratumFramer::next(char*& o_line, size_t& o_size)
+{
+	while (true) {
+		while (m_scan < m_tail && m_ring[m_scan & m_mask] != '\n')
+			m_scan++;
+		if (m_scan == m_tail) {
+			if (m_tail - m_head == m_ring.size()) {
+				// A full ring without a newline, drop up to the end of this line.
+				m_discarded += m_tail - m_head;
+				m_head = m_tail;
+				m_discarding = true;
+			}
+			return false;
+		}
+
+		size_t start = m_head;
+		size_t size = m_scan - m_head;
+		m_head = ++m_scan;
+		if (m_discarding) {
+			m_discarded += size + 1;
+			m_discarding = false;
+			continue;
+		}
+		if (size && m_ring[(start + size - 1) & m_mask] == '\r')
+			size--;
+
+		size_t pos = start & m_mask;
+		if (pos + size < m_ring.size())
+			o_line = m_ring.data() + pos;
+		else {
+			size_t first = m_ring.size() - pos;
+			memcpy(m_line.data(), m_ring.data() + pos, first);
+			memcpy(m_line.data() + first, m_ring.data(), size - first);
+			o_line = m_line.data();
+		}
+		// Overwrites the consumed line ending.
+		o_line[size] = 0;
+		o_size = size;
+		return true;
+	}
+}
+
+void StratumFramer::reset()
+{
+	m_head = m_scan = m_tail = 0;
+	m_discarding = false;
+}
+
+StratumWriter& StratumWriter::operator<<(char const* _s)
+{
+	return raw(_s, strlen(_s));
+}
+
+StratumWriter& StratumWriter::operator<<(unsigned _v)
+{
+	char digits[10];
+	unsigned n = 0;
+	do
+		digits[n++] = '0' + _v % 10;
+	while (_v /= 10);
+	while (n)
+		m_buf.push_back(digits[--n]);
+	return *this;
+}
+
+StratumWriter& StratumWriter::quoted(string const& _s)
+{
+	static char const c_hex[] = "0123456789abcdef";
+	m_buf.push_back('"');
+	for (char c : _s) {
+		if (c == '"' || c == '\\') {
+			m_buf.push_back('\\');
+			m_buf.push_back(c);
+		}
+		else if ((unsigned char)c < 0x20) {
+			raw("\\u00", 4);
+			m_buf.push_back(c_hex[(c >> 4) & 0xf]);
+			m_buf.push_back(c_hex[c & 0xf]);
+		}
+		else
+			m_buf.push_back(c);
+	}
+	m_buf.push_back('"');
+	return *this;
+}
+
+StratumWriter& StratumWriter::hex(byte const* _data, size_t _size)
+{
+	static char const c_hex[] = "0123456789abcdef";
+	for (size_t i = 0; i < _size; i++) {
+		m_buf.push_back(c_hex[_data[i] >> 4]);
+		m_buf.push_back(c_hex[_data[i] & 0xf]);
+	}
+	return *this;
+}
+
+StratumWriter& StratumWriter::hex(uint64_t _v, unsigned _digits)
+{
+	static char const c_hex[] = "0123456789abcdef";
+	for (; _digits > 16; _digits--)
+		m_buf.push_back('0');
+	while (_digits--)
+		m_buf.push_back(c_hex[(_v >> (_digits * 4)) & 0xf]);
+	return *this;
+}
+
+StratumWriter& StratumWriter::raw(char const* _s, size_t _size)
+{
+	m_buf.insert(m_buf.end(), _s, _s + _size);
+	return *this;
+}
+
+StratumTxQueue::StratumTxQueue(unsigned _slots, size_t _reserve):
+	m_reserve(_reserve)
+{
+	for (unsigned i = 0; i < _slots; i++) {
+		m_buffers.emplace_back();
+		m_buffers.back().reserve(_reserve);
+		m_free.push_back(&m_buffers.back());
+	}
+}
+
+vector<char>& StratumTxQueue::acquire()
+{
+	Guard l(x_tx);
+	if (m_free.empty()) {
+		// All in flight, grow. The buffer stays in the pool afterwards.
+		m_buffers.emplace_back();
+		m_buffers.back().reserve(m_reserve);
+		return m_buffers.back();
+	}
+	vector<char>* buf = m_free.back();
+	m_free.pop_back();
+	buf->clear();
+	return *buf;
+}
+
+bool StratumTxQueue::push(vector<char>& _buf)
+{
+	Guard l(x_tx);
+	m_queue.push_back(&_buf);
+	return m_queue.size() == 1;
+}
+
+void StratumTxQueue::release(vector<char>& _buf)
+{
+	Guard l(x_tx);
+	m_free.push_back(&_buf);
+}
+
+vector<char>* StratumTxQueue::front()
+{
+	Guard l(x_tx);
+	return m_queue.empty() ? nullptr : m_queue.front();
+}
+
+bool StratumTxQueue::pop()
+{
+	Guard l(x_tx);
+	m_free.push_back(m_queue.front());
+	m_queue.pop_front();
+	return !m_queue.empty();
+}
+
+void StratumTxQueue::clear()
+{
+	Guard l(x_tx);
+	m_free.insert(m_free.end(), m_queue.begin(), m_queue.end());
+	m_queue.clear();
+}
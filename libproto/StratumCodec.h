@@ -0,0 +1,154 @@
+/*  Blah, blah, blah.. all this pedantic nonsense to say that this
+    source code is made available under the terms and conditions
+    of the accompanying GNU General Public License */
+
+#pragma once
+
+#include <deque>
+#include <mutex>
+#include <string>
+#include <vector>
+#include <libdevcore/FixedHash.h>
+
+namespace dev
+{
+namespace eth
+{
+
+/// Characters of a json value inside a received line. Strings exclude their quotes.
+struct StratumSpan {
+	enum Type : char { None = 0, String = 's', Number = 'n', True = 't', False = 'f', Null = 'z', Array = '[', Object = '{' };
+
+	char const* data = nullptr;
+	size_t size = 0;
+	Type type = None;
+	bool escaped = false;    ///< a string holding backslash escapes
+
+	bool empty() const
+	{
+		return !size;
+	}
+	bool operator==(char const* _s) const;
+	bool operator!=(char const* _s) const
+	{
+		return !(*this == _s);
+	}
+	std::string str() const
+	{
+		return std::string(data, size);
+	}
+};
+
+enum class HexAlign { Exact, Left, Right };
+
+/// Parse the hex string in @a _s into @a o_hash without allocating. An optional 0x prefix is skipped.
+/// Exact requires all 64 digits, Left pads shorter input with trailing zeros and Right with leading
+/// zeros. Returns false on bad or too long input.
+bool hexToHash(StratumSpan const& _s, h256& o_hash, HexAlign _align = HexAlign::Exact);
+
+/// Top level fields of a stratum json-rpc line, found without building a json tree.
+/// Up to c_maxItems scalar elements of "params" and "result" arrays are split out,
+/// nested values are kept as raw spans.
+struct StratumMessage {
+	static const unsigned c_maxItems = 8;
+
+	StratumSpan id;
+	StratumSpan method;
+	StratumSpan result;
+	StratumSpan error;
+	StratumSpan params;
+	StratumSpan paramItems[c_maxItems];
+	unsigned paramCount = 0;
+	StratumSpan resultItems[c_maxItems];
+	unsigned resultCount = 0;
+
+	/// Scan one line. Returns false if it isn't a well formed json object.
+	bool parse(char const* _line, size_t _size);
+	/// Numeric id, -1 when missing, null or not a number.
+	int intId() const;
+};
+
+/// Splits a byte stream into lines in a fixed ring buffer. Lines wrapping the end of the
+/// ring are copied to a scratch buffer, other lines are handed out in place.
+class StratumFramer
+{
+public:
+	explicit StratumFramer(size_t _capacity = 64 * 1024);
+
+	/// Contiguous free space to receive into. Empty only while a full ring holds no newline.
+	std::pair<char*, size_t> writable();
+	void commit(size_t _bytes);
+	/// Next complete line, without its line ending and NUL terminated. Valid until the next commit().
+	bool next(char*& o_line, size_t& o_size);
+	/// Bytes dropped because a single line did not fit the ring.
+	uint64_t discarded() const
+	{
+		return m_discarded;
+	}
+	void reset();
+
+private:
+	std::vector<char> m_ring;
+	std::vector<char> m_line;
+	size_t m_mask;
+	size_t m_head = 0;    ///< first unconsumed byte
+	size_t m_scan = 0;    ///< bytes before this were searched for a newline
+	size_t m_tail = 0;    ///< end of received data
+	bool m_discarding = false;
+	uint64_t m_discarded = 0;
+};
+
+/// Appends json text to a reused buffer.
+class StratumWriter
+{
+public:
+	explicit StratumWriter(std::vector<char>& _buf): m_buf(_buf) {}
+
+	StratumWriter& operator<<(char const* _s);
+	StratumWriter& operator<<(std::string const& _s)
+	{
+		return raw(_s.data(), _s.size());
+	}
+	StratumWriter& operator<<(unsigned _v);
+	/// A json string, quoted and escaped.
+	StratumWriter& quoted(std::string const& _s);
+	/// Lower case hex digits of @a _data without prefix.
+	StratumWriter& hex(byte const* _data, size_t _size);
+	/// @a _v as @a _digits hex digits, zero padded or truncated to the least significant ones.
+	StratumWriter& hex(uint64_t _v, unsigned _digits = 16);
+	StratumWriter& raw(char const* _s, size_t _size);
+
+private:
+	std::vector<char>& m_buf;
+};
+
+/// Outbound messages waiting for the socket, in preallocated buffers that are reused.
+/// Any thread may queue, the io thread writes them out one at a time in queue order.
+class StratumTxQueue
+{
+public:
+	explicit StratumTxQueue(unsigned _slots = 16, size_t _reserve = 512);
+
+	/// A cleared buffer to fill, pass it to push() afterwards.
+	std::vector<char>& acquire();
+	/// Queue an acquired buffer. Returns true if the queue was idle and the caller has to start writing.
+	bool push(std::vector<char>& _buf);
+	/// Return an acquired buffer without sending it.
+	void release(std::vector<char>& _buf);
+	/// The buffer to write next, nullptr if none.
+	std::vector<char>* front();
+	/// Release the written front buffer. Returns true if another one is waiting.
+	bool pop();
+	/// Drop everything queued. Only while no write is in progress.
+	void clear();
+
+private:
+	std::mutex x_tx;
+	std::deque<std::vector<char>> m_buffers;    ///< deque, so buffers never move
+	std::vector<std::vector<char>*> m_free;
+	std::deque<std::vector<char>*> m_queue;
+	size_t m_reserve;
+};
+
+}
+}
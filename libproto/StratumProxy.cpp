@@ -0,0 +1,354 @@
+/*  Blah, blah, blah.. all this pedantic nonsense to say that this
+    source code is made available under the terms and conditions
+    of the accompanying GNU General Public License */
+
+#include <iomanip>
+#include <sstream>
+
+#include <libdevcore/Log.h>
+#include <libethcore/Difficulty.h>
+#include "StratumProxy.h"
+
+using namespace std;
+using namespace dev;
+using namespace dev::eth;
+
+// Jobs a share may still refer to.
+static const size_t c_keepJobs = 8;
+// Longest upstream extranonce we can still split, leaves the miners 16 bits of their own.
+static const int c_maxPrefixBits = 40;
+
+static string jsonHex(Json::Value const& _v)
+{
+	string s = _v.asString();
+	if (s.size() > 1 && s[0] == '0' && (s[1] == 'x' || s[1] == 'X'))
+		s = s.substr(2);
+	return s;
+}
+
+StratumProxy::StratumProxy(PoolClient& _upstream, unsigned short _port) :
+	m_upstream(_upstream),
+	m_server(_port)
+{
+	m_upstream.onConnected([](boost::asio::ip::address address) {
+		loginfo("Upstream connected to " << address);
+	});
+
+	m_upstream.onDisconnected([this]() {
+		logwarn("Upstream disconnected, retrying in 3 seconds.");
+		m_upstream.reconnect(3000);
+	});
+
+	m_upstream.onWorkReceived([this](WorkPackage const & wp) {
+		// Called on the client's io thread, the job state belongs to the server's.
+		m_server.post([this, wp]() {
+			newWork(wp);
+		});
+	});
+
+	m_upstream.onSolutionAccepted([this](bool const & stale, unsigned const & ms) {
+		m_accepted++;
+		loginfo(string(stale ? fgYellow : fgLime) << "Accepted upstream" << (stale ? " (stale)" : "") << " in " << ms << " ms." <<
+		        fgReset);
+	});
+
+	m_upstream.onSolutionRejected([this](bool const & stale, unsigned const & ms, string const & msg) {
+		m_rejected++;
+		loginfo(fgRed "Rejected upstream" << (stale ? " (stale)" : "") << " in " << ms << " ms." << fgReset << " " << msg);
+	});
+
+	m_server.onMessage([this](StratumSessionPtr const & s, Json::Value & msg) {
+		onMessage(s, msg);
+	});
+
+	m_server.onConnected([](StratumSessionPtr const & s) {
+		loginfo("Miner " << s->peer() << " connected");
+	});
+
+	m_server.onDisconnected([this](StratumSessionPtr const & s) {
+		loginfo("Miner " << s->peer() << " disconnected");
+		auto it = m_sessions.find(s->id());
+		if (it == m_sessions.end())
+			return;
+		m_slots.reset(it->second.slot);
+		m_hashrate -= it->second.rate;
+		m_sessions.erase(it);
+		m_miners = m_sessions.size();
+	});
+}
+
+StratumProxy::~StratumProxy()
+{
+	{
+		unique_lock<mutex> l(x_verify);
+		m_stop = true;
+	}
+	m_verifyReady.notify_all();
+	if (m_verifier.joinable())
+		m_verifier.join();
+}
+
+void StratumProxy::start()
+{
+	m_server.start();
+	m_verifier = thread(&StratumProxy::verifyLoop, this);
+}
+
+string StratumProxy::status() const
+{
+	stringstream ss;
+	ss << miners() << " miners, " << m_shares << " shares, " << m_invalid << " invalid, upstream " << m_accepted <<
+	   " accepted, " << m_rejected << " rejected";
+	return ss.str();
+}
+
+string StratumProxy::extraNonce(WorkPackage const& _wp, unsigned _slot) const
+{
+	int bits = _wp.exSizeBits > 0 ? _wp.exSizeBits : 0;
+	uint64_t prefix = bits ? _wp.startNonce : 0;
+	stringstream ss;
+	ss << hex << setw(16) << setfill('0') << (prefix | (uint64_t)_slot << (56 - bits));
+	return ss.str().substr(0, bits / 4 + 2);
+}
+
+void StratumProxy::reply(StratumSessionPtr const& _s, Json::Value const& _id, Json::Value const& _result,
+                         string const& _error)
+{
+	Json::Value msg;
+	msg["id"] = _id;
+	msg["result"] = _result;
+	msg["error"] = _error.empty() ? Json::Value::null : Json::Value(_error);
+	_s->send(msg);
+}
+
+void StratumProxy::notify(StratumSessionPtr const& _s, Job const& _job, bool _clean)
+{
+	Json::Value msg;
+	msg["id"] = Json::Value::null;
+	msg["method"] = "mining.notify";
+	msg["params"].append(_job.id);
+	msg["params"].append(_job.work.seed.hex());
+	msg["params"].append(_job.work.header.hex());
+	msg["params"].append(_clean);
+	_s->send(msg);
+}
+
+void StratumProxy::newWork(WorkPackage const& _wp)
+{
+	if (_wp.exSizeBits > c_maxPrefixBits) {
+		logerror("Upstream extranonce of " << _wp.exSizeBits << " bits leaves too little nonce space to share");
+		return;
+	}
+
+	bool prefixChanged = _wp.exSizeBits != m_prefixBits || (_wp.exSizeBits > 0 && _wp.startNonce != m_prefix);
+	m_prefix = _wp.exSizeBits > 0 ? _wp.startNonce : 0;
+	m_prefixBits = _wp.exSizeBits;
+
+	double diff = boundaryToDiff(_wp.boundary.data());
+	bool diffChanged = diff != m_difficulty;
+	m_difficulty = diff;
+
+	stringstream ss;
+	ss << hex << setw(8) << setfill('0') << ++m_jobCounter;
+	m_jobs.push_back(Job{ss.str(), _wp, {}});
+	if (m_jobs.size() > c_keepJobs)
+		m_jobs.pop_front();
+
+	EthashAux::lookahead(_wp.seed, _wp.block);
+
+	Json::Value setDiff;
+	setDiff["id"] = Json::Value::null;
+	setDiff["method"] = "mining.set_difficulty";
+	setDiff["params"].append(m_difficulty);
+
+	for (auto const& i : m_server.sessions()) {
+		auto it = m_sessions.find(i.first);
+		if (it == m_sessions.end())
+			continue;
+		if (prefixChanged) {
+			Json::Value msg;
+			msg["id"] = Json::Value::null;
+			msg["method"] = "mining.set_extranonce";
+			msg["params"].append(extraNonce(_wp, it->second.slot));
+			i.second->send(msg);
+		}
+		if (!it->second.authorized)
+			continue;
+		if (diffChanged)
+			i.second->send(setDiff);
+		notify(i.second, m_jobs.back(), true);
+	}
+}
+
+void StratumProxy::onMessage(StratumSessionPtr const& _s, Json::Value& _msg)
+{
+	Json::Value id = _msg.get("id", Json::Value::null);
+	string method = _msg.get("method", "").asString();
+	Json::Value params = _msg.get("params", Json::Value(Json::arrayValue));
+	auto it = m_sessions.find(_s->id());
+
+	if (method == "mining.subscribe") {
+		if (it != m_sessions.end()) {
+			reply(_s, id, false, "Already subscribed");
+			return;
+		}
+		unsigned slot = 0;
+		while (slot < m_slots.size() && m_slots.test(slot))
+			slot++;
+		if (slot == m_slots.size()) {
+			logwarn("Refusing miner " << _s->peer() << ", all " << m_slots.size() << " extranonce slots are in use");
+			reply(_s, id, Json::Value::null, "Proxy is full");
+			_s->close();
+			return;
+		}
+		m_slots.set(slot);
+		m_sessions[_s->id()].slot = slot;
+		m_miners = m_sessions.size();
+
+		WorkPackage prefix;
+		prefix.startNonce = m_prefix;
+		prefix.exSizeBits = m_prefixBits;
+		stringstream ss;
+		ss << hex << setw(8) << setfill('0') << _s->id();
+		Json::Value subscription;
+		subscription.append("mining.notify");
+		subscription.append(ss.str());
+		subscription.append("EthereumStratum/1.0.0");
+		Json::Value result;
+		result.append(subscription);
+		result.append(extraNonce(prefix, slot));
+		reply(_s, id, result);
+		return;
+	}
+
+	if (it == m_sessions.end()) {
+		reply(_s, id, Json::Value::null, "Not subscribed");
+		return;
+	}
+	Session& session = it->second;
+
+	if (method == "mining.extranonce.subscribe")
+		reply(_s, id, true);
+	else if (method == "mining.authorize") {
+		bool first = !session.authorized;
+		session.authorized = true;
+		reply(_s, id, true);
+		loginfo("Miner " << _s->peer() << " authorized as " << params.get((Json::Value::ArrayIndex)0, "").asString());
+		if (first && !m_jobs.empty()) {
+			Json::Value msg;
+			msg["id"] = Json::Value::null;
+			msg["method"] = "mining.set_difficulty";
+			msg["params"].append(m_difficulty);
+			_s->send(msg);
+			notify(_s, m_jobs.back(), true);
+		}
+	}
+	else if (method == "mining.submit") {
+		if (!session.authorized)
+			reply(_s, id, false, "Not authorized");
+		else
+			submit(_s, session, id, params);
+	}
+	else if (method == "eth_submitHashrate") {
+		uint64_t rate = strtoull(jsonHex(params.get((Json::Value::ArrayIndex)0, "0")).c_str(), nullptr, 16);
+		m_hashrate += rate - session.rate;
+		session.rate = rate;
+		reply(_s, id, true);
+	}
+	else if (!id.isNull())
+		reply(_s, id, Json::Value::null, "Unsupported method " + method);
+}
+
+void StratumProxy::submit(StratumSessionPtr const& _s, Session& _session, Json::Value const& _id,
+                          Json::Value const& _params)
+{
+	m_shares++;
+	string jobId = _params.get((Json::Value::ArrayIndex)1, "").asString();
+	string suffix = jsonHex(_params.get((Json::Value::ArrayIndex)2, ""));
+
+	auto job = m_jobs.rbegin();
+	while (job != m_jobs.rend() && job->id != jobId)
+		job++;
+	if (job == m_jobs.rend()) {
+		m_invalid++;
+		reply(_s, _id, false, "Job not found");
+		return;
+	}
+
+	// The miner searched below the extranonce it held when the job was sent.
+	string nonceHex = extraNonce(job->work, _session.slot) + suffix;
+	if (nonceHex.size() != 16 || nonceHex.find_first_not_of("0123456789abcdefABCDEF") != string::npos) {
+		m_invalid++;
+		reply(_s, _id, false, "Malformed nonce");
+		return;
+	}
+	uint64_t nonce = strtoull(nonceHex.c_str(), nullptr, 16);
+	if (!job->nonces.insert(nonce).second) {
+		m_invalid++;
+		reply(_s, _id, false, "Duplicate share");
+		return;
+	}
+
+	Share share{_s, _id, nonce, nonceHex, job->work, job != m_jobs.rbegin()};
+	{
+		unique_lock<mutex> l(x_verify);
+		m_verifyQueue.push_back(share);
+	}
+	m_verifyReady.notify_one();
+}
+
+void StratumProxy::verifyLoop()
+{
+	while (true) {
+		deque<Share> shares;
+		{
+			unique_lock<mutex> l(x_verify);
+			m_verifyReady.wait(l, [this]() { return m_stop || !m_verifyQueue.empty(); });
+			if (m_stop)
+				return;
+			shares.swap(m_verifyQueue);
+		}
+
+		// Shares of the same work are evaluated together.
+		vector<bool> done(shares.size());
+		for (size_t i = 0; i < shares.size(); i++) {
+			if (done[i])
+				continue;
+			vector<size_t> group;
+			vector<uint64_t> nonces;
+			for (size_t j = i; j < shares.size(); j++)
+				if (!done[j] && shares[j].work.seed == shares[i].work.seed && shares[j].work.header == shares[i].work.header) {
+					done[j] = true;
+					group.push_back(j);
+					nonces.push_back(shares[j].nonce);
+				}
+			vector<Result> results = EthashAux::evalBatch(shares[i].work.seed, shares[i].work.header,
+			                         vector_ref<uint64_t const>(nonces.data(), nonces.size()));
+			for (size_t k = 0; k < group.size(); k++) {
+				Share share = shares[group[k]];
+				Result r = results[k];
+				m_server.post([this, share, r]() {
+					verified(share, r);
+				});
+			}
+		}
+	}
+}
+
+void StratumProxy::verified(Share const& _share, Result const& _r)
+{
+	if (_r.value > _share.work.boundary) {
+		m_invalid++;
+		logwarn("Miner " << _share.session->peer() << " sent an invalid share 0x" << _share.nonceHex);
+		reply(_share.session, _share.id, false, "Low difficulty share");
+		return;
+	}
+
+	Solution solution{"proxy", _share.nonce, _r.mixHash, _share.work, _share.stale};
+	m_upstream.post([this, solution]() {
+		m_upstream.submitSolution(solution);
+	});
+	reply(_share.session, _share.id, true);
+	loginfo(string(_share.stale ? fgYellow : fgWhite) << "Miner " << _share.session->peer() << (_share.stale ? " (stale)" : "")
+	        << " 0x" << _share.nonceHex << " submitted" << fgReset);
+}
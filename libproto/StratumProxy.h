@@ -0,0 +1,110 @@
+/*  Blah, blah, blah.. all this pedantic nonsense to say that this
+    source code is made available under the terms and conditions
+    of the accompanying GNU General Public License */
+
+#pragma once
+
+#include <atomic>
+#include <bitset>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <set>
+#include <thread>
+#include <libethcore/EthashAux.h>
+#include "PoolClient.h"
+#include "StratumServer.h"
+
+namespace dev
+{
+namespace eth
+{
+
+/// Shares one upstream pool connection between many local miners.
+///
+/// Downstream miners speak EthereumStratum/1.0.0 (nicehash). Each session gets the
+/// upstream extranonce (empty for getwork style pools) extended by one byte of its
+/// own, so miners search disjoint nonce ranges. Shares are verified on the host and
+/// only those meeting the upstream boundary are forwarded.
+class StratumProxy
+{
+public:
+	StratumProxy(PoolClient& _upstream, unsigned short _port);
+	~StratumProxy();
+
+	/// Start listening. Call before connecting the upstream client.
+	void start();
+
+	unsigned miners() const
+	{
+		return m_miners.load(std::memory_order_relaxed);
+	}
+	/// Sum of the hashrates the miners reported.
+	uint64_t hashrate() const
+	{
+		return m_hashrate.load(std::memory_order_relaxed);
+	}
+	std::string status() const;
+
+private:
+	struct Job {
+		std::string id;
+		WorkPackage work;
+		std::set<uint64_t> nonces;    ///< Shares already seen for this job.
+	};
+
+	/// A share waiting for the verifier thread.
+	struct Share {
+		StratumSessionPtr session;
+		Json::Value id;
+		uint64_t nonce;
+		std::string nonceHex;
+		WorkPackage work;
+		bool stale;
+	};
+
+	struct Session {
+		bool authorized = false;
+		unsigned slot = 0;    ///< Extranonce byte appended to the upstream one.
+		uint64_t rate = 0;
+	};
+
+	void newWork(WorkPackage const& _wp);
+	void onMessage(StratumSessionPtr const& _s, Json::Value& _msg);
+	void submit(StratumSessionPtr const& _s, Session& _session, Json::Value const& _id, Json::Value const& _params);
+	void notify(StratumSessionPtr const& _s, Job const& _job, bool _clean);
+	void reply(StratumSessionPtr const& _s, Json::Value const& _id, Json::Value const& _result,
+	           std::string const& _error = std::string());
+	std::string extraNonce(WorkPackage const& _wp, unsigned _slot) const;
+	void verifyLoop();
+	void verified(Share const& _share, Result const& _r);
+
+	PoolClient& m_upstream;
+	StratumServer m_server;
+
+	// Owned by the server's io thread.
+	std::map<unsigned, Session> m_sessions;
+	std::bitset<256> m_slots;
+	std::deque<Job> m_jobs;    ///< Most recent last.
+	unsigned m_jobCounter = 0;
+	double m_difficulty = 0;
+	uint64_t m_prefix = 0;
+	int m_prefixBits = -1;
+
+	// Shares are checked on their own thread, building the light cache of a new epoch takes seconds.
+	std::mutex x_verify;
+	std::condition_variable m_verifyReady;
+	std::deque<Share> m_verifyQueue;
+	bool m_stop = false;
+	std::thread m_verifier;
+
+	std::atomic<unsigned> m_miners = {0};
+	std::atomic<uint64_t> m_hashrate = {0};
+	std::atomic<unsigned> m_shares = {0};
+	std::atomic<unsigned> m_invalid = {0};
+	std::atomic<unsigned> m_accepted = {0};
+	std::atomic<unsigned> m_rejected = {0};
+};
+
+}
+}
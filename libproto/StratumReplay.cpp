@@ -0,0 +1,216 @@
+/*  Blah, blah, blah.. all this pedantic nonsense to say that this
+    source code is made available under the terms and conditions
+    of the accompanying GNU General Public License */
+
+#include <sstream>
+#include <stdexcept>
+#include <boost/bind.hpp>
+
+#include <libdevcore/Log.h>
+#include "StratumCapture.h"
+#include "StratumCodec.h"
+#include "StratumReplay.h"
+
+using namespace std;
+using namespace dev;
+using namespace dev::eth;
+using boost::asio::ip::tcp;
+
+// Requests the pool has to see before it answers, anything else the miner sends is ignored.
+static bool isGate(StratumSpan const& _method)
+{
+	return _method == "mining.subscribe" || _method == "mining.authorize" || _method == "mining.extranonce.subscribe" ||
+	       _method == "eth_submitLogin";
+}
+
+static bool isGate(string const& _line)
+{
+	StratumMessage msg;
+	return msg.parse(_line.data(), _line.size()) && isGate(msg.method);
+}
+
+StratumReplay::StratumReplay(string const& _path, double _speed) :
+	m_speed(_speed > 0 ? _speed : 1),
+	m_acceptor(m_io_service),
+	m_timer(m_io_service)
+{
+	StratumCaptureReader reader(_path);
+	StratumCaptureReader::Record r;
+	bool found = false;
+	unsigned client = 0;
+	while (reader.next(r)) {
+		if (!found) {
+			found = true;
+			client = r.client;
+			m_startUs = r.us;
+		}
+		if (r.client != client)
+			continue;
+		if (r.connect) {
+			// A reconnect, the session we play ends here.
+			if (!m_lines.empty())
+				break;
+			m_dialect = r.dialect;
+			continue;
+		}
+		m_lines.push_back(Line{r.us - m_startUs, r.sent, r.sent && isGate(r.line), r.line});
+	}
+	if (m_lines.empty())
+		throw runtime_error(_path + " holds no stratum lines");
+}
+
+StratumReplay::~StratumReplay()
+{
+	m_io_service.stop();
+	if (m_serviceThread.joinable())
+		m_serviceThread.join();
+}
+
+unsigned short StratumReplay::start(unsigned short _port)
+{
+	tcp::endpoint ep(boost::asio::ip::address_v4::loopback(), _port);
+	m_acceptor.open(ep.protocol());
+	m_acceptor.set_option(tcp::acceptor::reuse_address(true));
+	m_acceptor.bind(ep);
+	m_acceptor.listen();
+	accept();
+	m_serviceThread = std::thread{boost::bind(&boost::asio::io_service::run, &m_io_service)};
+	return m_acceptor.local_endpoint().port();
+}
+
+void StratumReplay::accept()
+{
+	auto socket = make_shared<tcp::socket>(m_io_service);
+	m_acceptor.async_accept(*socket, boost::bind(&StratumReplay::handleAccept, this, socket,
+	                        boost::asio::placeholders::error));
+}
+
+void StratumReplay::handleAccept(shared_ptr<tcp::socket> _socket, const boost::system::error_code& ec)
+{
+	if (ec) {
+		if (ec == boost::asio::error::operation_aborted)
+			return;
+		logwarn("Replay accept failed: " << ec.message());
+		accept();
+		return;
+	}
+	if (m_socket)
+		loginfo("Replay restarting for the new connection");
+	close();
+
+	m_socket = _socket;
+	boost::system::error_code oec;
+	m_socket->set_option(tcp::no_delay(true), oec);
+	m_pos = 0;
+	m_expected = 0;
+	m_seen = 0;
+	m_base = chrono::steady_clock::now();
+	readline();
+	play();
+	accept();
+}
+
+void StratumReplay::readline()
+{
+	async_read_until(*m_socket, m_rxBuffer, '\n', boost::bind(&StratumReplay::readResponse, this, m_socket,
+	                 boost::asio::placeholders::error, boost::asio::placeholders::bytes_transferred));
+}
+
+void StratumReplay::readResponse(shared_ptr<tcp::socket> _socket, const boost::system::error_code& ec,
+                                 std::size_t bytes_transferred)
+{
+	if (_socket != m_socket)
+		return;
+	if (ec) {
+		if (ec != boost::asio::error::operation_aborted) {
+			loginfo("Replay connection closed after " << m_pos << " of " << m_lines.size() << " lines");
+			close();
+		}
+		return;
+	}
+
+	string line(boost::asio::buffers_begin(m_rxBuffer.data()),
+	            boost::asio::buffers_begin(m_rxBuffer.data()) + bytes_transferred);
+	m_rxBuffer.consume(bytes_transferred);
+	if (isGate(line)) {
+		m_seen++;
+		if (!m_waiting && m_seen >= m_expected && m_pos < m_lines.size()) {
+			// The answer was held back, everything after it moves by the same amount.
+			auto due = m_base + chrono::microseconds((uint64_t)(m_lines[m_pos].us / m_speed));
+			auto now = chrono::steady_clock::now();
+			if (now > due)
+				m_base += now - due;
+			play();
+		}
+	}
+	readline();
+}
+
+void StratumReplay::play()
+{
+	m_waiting = false;
+	while (m_pos < m_lines.size()) {
+		Line const& line = m_lines[m_pos];
+		if (line.sent) {
+			if (line.gate)
+				m_expected++;
+			m_pos++;
+			continue;
+		}
+		if (m_seen < m_expected)
+			return;
+
+		auto due = m_base + chrono::microseconds((uint64_t)(line.us / m_speed));
+		if (chrono::steady_clock::now() < due) {
+			m_waiting = true;
+			m_timer.expires_from_now(boost::posix_time::microseconds(
+			                             chrono::duration_cast<chrono::microseconds>(due - chrono::steady_clock::now()).count()));
+			shared_ptr<tcp::socket> socket = m_socket;
+			m_timer.async_wait([this, socket](const boost::system::error_code & ec) {
+				if (!ec && socket == m_socket)
+					play();
+			});
+			return;
+		}
+
+		m_txQueue.push_back(line.text + '\n');
+		if (m_txQueue.size() == 1)
+			writeNext();
+		m_pos++;
+	}
+	m_played++;
+	loginfo("Replay finished, " << m_lines.size() << " lines");
+}
+
+void StratumReplay::writeNext()
+{
+	async_write(*m_socket, boost::asio::buffer(m_txQueue.front()),
+	            boost::bind(&StratumReplay::handleWrite, this, m_socket, boost::asio::placeholders::error));
+}
+
+void StratumReplay::handleWrite(shared_ptr<tcp::socket> _socket, const boost::system::error_code& ec)
+{
+	if (_socket != m_socket)
+		return;
+	if (ec) {
+		if (ec != boost::asio::error::operation_aborted)
+			close();
+		return;
+	}
+	m_txQueue.pop_front();
+	if (!m_txQueue.empty())
+		writeNext();
+}
+
+void StratumReplay::close()
+{
+	m_timer.cancel();
+	m_waiting = false;
+	m_txQueue.clear();
+	m_rxBuffer.consume(m_rxBuffer.size());
+	if (m_socket) {
+		boost::system::error_code ec;
+		m_socket->close(ec);
+		m_socket.reset();
+	}
+}
@@ -0,0 +1,96 @@
+/*  Blah, blah, blah.. all this pedantic nonsense to say that this
+    source code is made available under the terms and conditions
+    of the accompanying GNU General Public License */
+
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <deque>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+#include <boost/asio.hpp>
+
+namespace dev
+{
+namespace eth
+{
+
+/// Plays the pool's side of a captured session back to a miner connecting on a local port.
+///
+/// Lines go out at their captured times, divided by the speed factor. Where the pool
+/// answered a subscribe, authorize or login in the capture, the answer waits until the
+/// miner has sent as many of those requests, and the rest of the timeline is shifted
+/// by the wait. Only the first connection of the first client in the capture is played,
+/// a miner reconnecting starts over from the beginning.
+class StratumReplay
+{
+public:
+	/// Throws runtime_error if @a _path isn't a readable capture.
+	StratumReplay(std::string const& _path, double _speed);
+	~StratumReplay();
+
+	/// Listen on localhost, a zero @a _port picks a free one. Returns the port listened on.
+	unsigned short start(unsigned short _port = 0);
+
+	/// Stratum dialect of the captured session.
+	unsigned dialect() const
+	{
+		return m_dialect;
+	}
+	size_t lines() const
+	{
+		return m_lines.size();
+	}
+	/// Times the whole capture has been played.
+	unsigned played() const
+	{
+		return m_played.load(std::memory_order_relaxed);
+	}
+
+private:
+	struct Line {
+		uint64_t us;
+		bool sent;    ///< sent by the miner in the capture, only counted
+		bool gate;    ///< a request the pool's next answer depends on
+		std::string text;
+	};
+
+	void accept();
+	void handleAccept(std::shared_ptr<boost::asio::ip::tcp::socket> _socket, const boost::system::error_code& ec);
+	void readline();
+	/// Completions carry their socket, those of a connection since replaced are ignored.
+	void readResponse(std::shared_ptr<boost::asio::ip::tcp::socket> _socket, const boost::system::error_code& ec,
+	                  std::size_t bytes_transferred);
+	void play();
+	void writeNext();
+	void handleWrite(std::shared_ptr<boost::asio::ip::tcp::socket> _socket, const boost::system::error_code& ec);
+	void close();
+
+	std::vector<Line> m_lines;
+	uint64_t m_startUs = 0;
+	unsigned m_dialect = 0;
+	double m_speed;
+
+	boost::asio::io_service m_io_service;
+	boost::asio::ip::tcp::acceptor m_acceptor;
+	boost::asio::deadline_timer m_timer;
+	std::thread m_serviceThread;
+
+	// The session being played, io thread only.
+	std::shared_ptr<boost::asio::ip::tcp::socket> m_socket;
+	boost::asio::streambuf m_rxBuffer;
+	std::deque<std::string> m_txQueue;
+	size_t m_pos = 0;
+	unsigned m_expected = 0;    ///< gating requests the capture had seen so far
+	unsigned m_seen = 0;        ///< gating requests the miner sent
+	bool m_waiting = false;     ///< on the timer
+	std::chrono::steady_clock::time_point m_base;    ///< when the capture's start is due
+
+	std::atomic<unsigned> m_played = {0};
+};
+
+}
+}
@@ -0,0 +1,176 @@
+/*  Blah, blah, blah.. all this pedantic nonsense to say that this
+    source code is made available under the terms and conditions
+    of the accompanying GNU General Public License */
+
+#include <sstream>
+#include <boost/bind.hpp>
+
+#include <libdevcore/Log.h>
+#include <libethcore/Miner.h>
+#include "StratumServer.h"
+
+using namespace std;
+using namespace dev;
+using namespace dev::eth;
+using boost::asio::ip::tcp;
+
+// Longest request line accepted from a miner, anything longer drops the session.
+static const size_t c_maxLine = 4096;
+
+StratumSession::StratumSession(StratumServer& _server, unsigned _id) :
+	m_server(_server),
+	m_id(_id),
+	m_socket(_server.m_io_service),
+	m_rxBuffer(c_maxLine)
+{
+}
+
+void StratumSession::start()
+{
+	boost::system::error_code ec;
+	auto ep = m_socket.remote_endpoint(ec);
+	if (!ec) {
+		stringstream ss;
+		ss << ep.address().to_string() << ':' << ep.port();
+		m_peer = ss.str();
+	}
+	m_socket.set_option(tcp::no_delay(true), ec);
+	readline();
+}
+
+void StratumSession::readline()
+{
+	async_read_until(m_socket, m_rxBuffer, '\n',
+	                 boost::bind(&StratumSession::readResponse, shared_from_this(),
+	                             boost::asio::placeholders::error, boost::asio::placeholders::bytes_transferred));
+}
+
+void StratumSession::readResponse(const boost::system::error_code& ec, std::size_t bytes_transferred)
+{
+	if (m_closed)
+		return;
+	if (ec) {
+		if (ec != boost::asio::error::eof && ec != boost::asio::error::operation_aborted)
+			logwarn("Miner " << m_peer << ": " << ec.message());
+		close();
+		return;
+	}
+
+	string line(boost::asio::buffers_begin(m_rxBuffer.data()),
+	            boost::asio::buffers_begin(m_rxBuffer.data()) + bytes_transferred);
+	m_rxBuffer.consume(bytes_transferred);
+
+	if (line.find_first_not_of(" \t\r\n") != string::npos) {
+		Json::Value msg;
+		Json::Reader reader;
+		if (reader.parse(line, msg) && msg.isObject()) {
+			if (g_logJson)
+				loginfo("JSON RX " << m_peer << endl << msg);
+			if (m_server.m_onMessage)
+				m_server.m_onMessage(shared_from_this(), msg);
+		}
+		else
+			logwarn("Miner " << m_peer << " sent malformed json: " << reader.getFormattedErrorMessages());
+	}
+
+	if (!m_closed)
+		readline();
+}
+
+void StratumSession::send(Json::Value const& _msg)
+{
+	if (m_closed)
+		return;
+	if (g_logJson)
+		loginfo("JSON TX " << m_peer << endl << _msg);
+
+	Json::FastWriter writer;
+	m_txQueue.push_back(writer.write(_msg));
+	if (m_txQueue.size() == 1)
+		writeNext();
+}
+
+void StratumSession::writeNext()
+{
+	async_write(m_socket, boost::asio::buffer(m_txQueue.front()),
+	            boost::bind(&StratumSession::handleWrite, shared_from_this(), boost::asio::placeholders::error));
+}
+
+void StratumSession::handleWrite(const boost::system::error_code& ec)
+{
+	if (m_closed)
+		return;
+	if (ec) {
+		logwarn("Miner " << m_peer << ": " << ec.message());
+		close();
+		return;
+	}
+	m_txQueue.pop_front();
+	if (!m_txQueue.empty())
+		writeNext();
+}
+
+void StratumSession::close()
+{
+	if (m_closed)
+		return;
+	m_closed = true;
+	boost::system::error_code ec;
+	m_socket.shutdown(tcp::socket::shutdown_both, ec);
+	m_socket.close(ec);
+	m_txQueue.clear();
+	m_server.closed(shared_from_this());
+}
+
+StratumServer::StratumServer(unsigned short _port) :
+	m_port(_port),
+	m_acceptor(m_io_service)
+{
+}
+
+StratumServer::~StratumServer()
+{
+	m_io_service.stop();
+	if (m_serviceThread.joinable())
+		m_serviceThread.join();
+}
+
+void StratumServer::start()
+{
+	tcp::endpoint ep(tcp::v4(), m_port);
+	m_acceptor.open(ep.protocol());
+	m_acceptor.set_option(tcp::acceptor::reuse_address(true));
+	m_acceptor.bind(ep);
+	m_acceptor.listen();
+	accept();
+	m_serviceThread = std::thread{boost::bind(&boost::asio::io_service::run, &m_io_service)};
+}
+
+void StratumServer::accept()
+{
+	auto session = make_shared<StratumSession>(*this, m_nextId++);
+	m_acceptor.async_accept(session->m_socket,
+	                        boost::bind(&StratumServer::handleAccept, this, session, boost::asio::placeholders::error));
+}
+
+void StratumServer::handleAccept(StratumSessionPtr _session, const boost::system::error_code& ec)
+{
+	if (ec) {
+		if (ec == boost::asio::error::operation_aborted)
+			return;
+		logwarn("Stratum accept failed: " << ec.message());
+	}
+	else {
+		m_sessions[_session->id()] = _session;
+		_session->start();
+		if (m_onConnected)
+			m_onConnected(_session);
+	}
+	accept();
+}
+
+void StratumServer::closed(StratumSessionPtr const& _session)
+{
+	if (m_sessions.erase(_session->id()) && m_onDisconnected)
+		m_onDisconnected(_session);
+}
@@ -0,0 +1,129 @@
+/*  Blah, blah, blah.. all this pedantic nonsense to say that this
+    source code is made available under the terms and conditions
+    of the accompanying GNU General Public License */
+
+#pragma once
+
+#include <deque>
+#include <functional>
+#include <map>
+#include <memory>
+#include <string>
+#include <thread>
+#include <boost/asio.hpp>
+#include <json/json.h>
+
+namespace dev
+{
+namespace eth
+{
+
+class StratumServer;
+
+/// One downstream connection of a StratumServer. Only used on the server's io thread.
+class StratumSession : public std::enable_shared_from_this<StratumSession>
+{
+public:
+	StratumSession(StratumServer& _server, unsigned _id);
+
+	unsigned id() const
+	{
+		return m_id;
+	}
+	std::string const& peer() const
+	{
+		return m_peer;
+	}
+	bool closed() const
+	{
+		return m_closed;
+	}
+
+	/// Queue a json-rpc message, written as a single line.
+	void send(Json::Value const& _msg);
+	void close();
+
+private:
+	friend class StratumServer;
+
+	void start();
+	void readline();
+	void readResponse(const boost::system::error_code& ec, std::size_t bytes_transferred);
+	void writeNext();
+	void handleWrite(const boost::system::error_code& ec);
+
+	StratumServer& m_server;
+	unsigned m_id;
+	std::string m_peer;
+	bool m_closed = false;
+
+	boost::asio::ip::tcp::socket m_socket;
+	boost::asio::streambuf m_rxBuffer;
+	std::deque<std::string> m_txQueue;
+};
+
+using StratumSessionPtr = std::shared_ptr<StratumSession>;
+
+/// Line based json-rpc listener for stratum miners, running its own io service thread.
+/// The callbacks and all session calls happen on that thread, use post() from elsewhere.
+class StratumServer
+{
+public:
+	using Connected = std::function<void(StratumSessionPtr const&)>;
+	using Message = std::function<void(StratumSessionPtr const&, Json::Value&)>;
+	using Disconnected = std::function<void(StratumSessionPtr const&)>;
+
+	StratumServer(unsigned short _port);
+	~StratumServer();
+
+	/// Bind the listening port and start the io thread. Throws if the port is unavailable.
+	void start();
+	void post(std::function<void()> const& _f)
+	{
+		m_io_service.post(_f);
+	}
+	boost::asio::io_service& service()
+	{
+		return m_io_service;
+	}
+
+	std::map<unsigned, StratumSessionPtr> const& sessions() const
+	{
+		return m_sessions;
+	}
+
+	void onConnected(Connected const& _handler)
+	{
+		m_onConnected = _handler;
+	}
+	void onMessage(Message const& _handler)
+	{
+		m_onMessage = _handler;
+	}
+	void onDisconnected(Disconnected const& _handler)
+	{
+		m_onDisconnected = _handler;
+	}
+
+private:
+	friend class StratumSession;
+
+	void accept();
+	void handleAccept(StratumSessionPtr _session, const boost::system::error_code& ec);
+	void closed(StratumSessionPtr const& _session);
+
+	unsigned short m_port;
+	unsigned m_nextId = 0;
+	std::map<unsigned, StratumSessionPtr> m_sessions;
+
+	std::thread m_serviceThread;  ///< The IO service thread.
+	boost::asio::io_service m_io_service;
+	boost::asio::ip::tcp::acceptor m_acceptor;
+
+	Connected m_onConnected;
+	Message m_onMessage;
+	Disconnected m_onDisconnected;
+};
+
+}
+}
@@ -15,6 +15,7 @@
 #include <boost/tokenizer.hpp>
 #include <boost/filesystem.hpp>
 
+#include <libethash/internal.h>
 #include <libethcore/MinerCommon.h>
 #include <libdevcore/SHA3.h>
 #include <libethcore/EthashAux.h>
@@ -25,8 +26,14 @@
 #if ETH_ETHASHCUDA
 #include <libcuda/CUDAMiner.h>
 #endif
+#if ETH_ETHASHCPU
+#include <libcpu/CPUMiner.h>
+#endif
 #include <libproto/PoolManager.h>
 #include <libproto/EthStratumClient.h>
+#include <libproto/StratumCapture.h>
+#include <libproto/StratumProxy.h>
+#include <libproto/StratumReplay.h>
 #include <libdevcore/Log.h>
 
 #if API_CORE
@@ -69,6 +76,8 @@ public:
 
 		poolDesc
 		        << "URL takes the form:\nscheme://[user[:password]@]hostname:port\n\n"
+		        << "Repeat -p to add failover pools, in order of preference. The second one is kept\n"
+		        << "connected as a hot standby.\n\n"
 		        << "unsecured schemes: " << URI::KnownSchemes(SecureLevel::NONE) << '\n'
 		        << "secured with any TLS: " << URI::KnownSchemes(SecureLevel::TLS) << '\n'
 		        << "secured with TLS 1.2: " << URI::KnownSchemes(SecureLevel::TLS12) << "\n\n"
@@ -85,15 +94,27 @@ public:
 		("list,l",    bool_switch()->default_value(false), "List devices.\n")
 		("version,v", bool_switch()->default_value(false), "list version.\n")
 		("retries,r", value<unsigned>(&m_maxFarmRetries)->default_value(3), "Connection retries.\n")
+		("probe",     value<unsigned>(&m_probeInterval)->default_value(60),
+		 "Seconds between connect probes ranking the pools by latency, only with more than one pool. 0 disables probing.\n")
 		("email",     value<string>(&g_email), "Stratum email.\n")
 		("timeout",   value<unsigned>(&g_worktimeout)->default_value(180), "Work timeout.\n")
 		("hash",      bool_switch()->default_value(false), "Report hashrate to pool.\n")
 		("intvl",     value<unsigned>(&m_displayInterval)->default_value(15), "statistics display interval.\n")
 		("level",     value<unsigned>(&m_show_level)->default_value(0),
 		 "Metrics collection level. 0 - HR only, 1 - + fan & temp, 2 - + power.\n")
-		("pool,p",    value<string>(), poolDesc.str().c_str())
+		("hwmon-intvl", value<unsigned>(&m_hwmonInterval)->default_value(5), "Seconds between fan, temp and power readings.\n")
+		("pool,p",    value<vector<string>>()->composing(), poolDesc.str().c_str())
 		("dag",       value<unsigned>(&m_dagLoadMode)->default_value(0),
-		 "DAG load mode. 0 - parallel, 1 - sequential, 2 - single.\n")
+		 "DAG load mode. 0 - parallel, 1 - sequential, 2 - single (built on host cores, uploaded to every GPU).\n")
+		("lookahead", value<unsigned>(&m_lookahead)->default_value(1000),
+		 "Build the next epoch's light cache this many blocks ahead. 0 - off.\n")
+		("light-max", value<unsigned>(&m_lightMax)->default_value(3), "Light caches kept in memory. 0 - no limit.\n")
+		("light-mb",  value<unsigned>(&m_lightMB)->default_value(0), "Memory budget of kept light caches in MB. 0 - no limit.\n")
+		("dag-dir",   value<string>(&m_dagDir), "Directory keeping light caches across restarts, older epochs are removed. Use one directory per chain.\n")
+		("dag-store", bool_switch(&m_dagStore)->default_value(false),
+		 "Also keep host built DAGs (--dag 2, --cpu) in --dag-dir.\n")
+		("host-kern", value<string>(&m_hostKernel),
+		 "Host kernel for light evaluation and host built DAGs: scalar, sse4.1, avx2 or avx512. Default sse4.1.\n")
 		("switch",    bool_switch()->default_value(false), "Log job switch time.\n")
 		("json",      bool_switch()->default_value(false), "Log formatted json messaging.\n")
 		("effective", bool_switch()->default_value(false), "Log effective hash rate.\n")
@@ -101,13 +122,14 @@ public:
 		("cu,U",      bool_switch()->default_value(false), "Cuda mode.\n") // set m_minerType = MinerType::CUDA;
 		("mix,X",     bool_switch()->default_value(false),
 		 "Mixed opencl and cuda mode. Use OpenCL + CUDA in a system with mixed AMD/Nvidia cards. May require setting --cl-plat 1 or 2.\n")
+		("cpu",       bool_switch()->default_value(false), "CPU mode.\n") // set m_minerType = MinerType::CPU;
 		("eval",      bool_switch()->default_value(false),
 		 "Enable software result evaluation. Use if you GPUs generate too many invalid shares.\n")
 #if API_CORE
 	        ("api",       value<unsigned>(&m_api_port)->default_value(0), "API server port number. 0 - disable, < 0 - read-only.\n")
         	("http",      value<unsigned>(&m_http_port)->default_value(0), "HTTP server port number. 0 - disable\n")
 	        ("rest",      value<unsigned>(&m_rest_port)->default_value(0),
-        	 "RESTFUL server port number. 0 - disable. Supported paths are /stats and /gpu/<n>\n")
+        	 "RESTFUL server port number. 0 - disable. Supported paths are /stats, /cache and /gpu/<n>\n")
 #endif
 
 #if ETH_ETHASHCL
@@ -123,8 +145,20 @@ public:
 		("cu-sch",    value<unsigned>(&m_cudaSchedule)->default_value(4),
 		 "Cuda schedule mode. 0 - auto, 1 - spin, 2 - yield, 4 - sync\n")
 		("cu-strm",   value<unsigned>(&m_numStreams)->default_value(2), "Cuda streams\n")
+#endif
+#if ETH_ETHASHCPU
+		("cpu-thrds", value<unsigned>(&m_cpuThreads)->default_value(0), "CPU mining threads. 0 - one per core.\n")
 #endif
 		("stop",      value<unsigned>(&g_stopAfter)->default_value(0), "Stop after minutes. 0 - never stop.\n")
+		("benchmark", value<unsigned>(&m_benchmarkBlock), "Benchmark offline on work for this block number, no pool.\n")
+		("bench-secs", value<unsigned>(&m_benchmarkSecs)->default_value(60), "Benchmark duration in seconds.\n")
+		("bench-job", value<unsigned>(&m_benchmarkJobMs)->default_value(2000),
+		 "Milliseconds between synthetic benchmark jobs.\n")
+		("proxy",     value<unsigned>(&m_proxyPort)->default_value(0),
+		 "Don't mine, share the pool connection with miners connecting to this port (nicehash stratum). 0 - off.\n")
+		("capture",   value<string>(), "Record every stratum line with its timing to this file, for --replay.\n")
+		("replay",    value<string>(), "Mine on a --capture file played back by a local pool instead of a real one.\n")
+		("replay-speed", value<double>(&m_replaySpeed)->default_value(1), "Replay this many times faster than captured.\n")
 		;
 
 		variables_map vm;
@@ -147,29 +181,73 @@ public:
 		if (m_shouldListDevices)
 			return;
 
-		if (vm.count("pool") != 1) {
-			cerr << "Specify a single pool URL\n";
+		m_benchmark = vm.count("benchmark") > 0;
+		bool replay = vm.count("replay") > 0;
+		if (replay && (m_benchmark || m_proxyPort || vm.count("pool"))) {
+			cerr << "Replay doesn't go with a pool, benchmark or proxy mode.\n";
 			exit(-1);
 		}
-
-		string url = vm["pool"].as<string>();
-		URI uri;
-		try {
-			uri = url;
+		if (replay && m_replaySpeed <= 0) {
+			cerr << "Replay speed must be greater than 0.\n";
+			exit(-1);
 		}
-		catch (std::exception const& e) {
-			cerr << "Bad endpoint address: " << url << " - " << e.what() << endl;
+		if (!m_benchmark && !replay && !vm.count("pool")) {
+			cerr << "Specify at least one pool URL\n";
+			exit(-1);
+		}
+		if (m_benchmark && m_proxyPort) {
+			cerr << "Benchmark and proxy modes are exclusive.\n";
 			exit(-1);
 		}
-		if (!uri.KnownScheme()) {
-			cerr << "Unknown URI scheme " << uri.Scheme() << endl;
+		if (m_proxyPort > 65535) {
+			cerr << "Bad proxy port " << m_proxyPort << "\n";
 			exit(-1);
 		}
-		if (uri.Port() == 0) {
-			cerr << "Missing port number\n";
+		if (m_benchmark && (!m_benchmarkSecs || !m_benchmarkJobMs)) {
+			cerr << "Benchmark duration and job interval must be greater than 0.\n";
 			exit(-1);
 		}
-		m_endpoint = PoolConnection(uri);
+
+		if (vm.count("capture") && !g_capture.open(vm["capture"].as<string>())) {
+			cerr << "Can't write capture " << vm["capture"].as<string>() << "\n";
+			exit(-1);
+		}
+
+		if (replay) {
+			static const char* schemes[] = {"stratum", "ethproxy", "nicehash"};
+			unsigned short port;
+			try {
+				m_replay.reset(new StratumReplay(vm["replay"].as<string>(), m_replaySpeed));
+				port = m_replay->start();
+			}
+			catch (std::exception const& e) {
+				cerr << "Can't replay " << vm["replay"].as<string>() << ": " << e.what() << endl;
+				exit(-1);
+			}
+			stringstream url;
+			url << schemes[m_replay->dialect() < 3 ? m_replay->dialect() : 0] << "+tcp://replay@127.0.0.1:" << port;
+			m_endpoints.push_back(PoolConnection(URI(url.str())));
+		}
+		else if (!m_benchmark)
+			for (auto const& url : vm["pool"].as<vector<string>>()) {
+				URI uri;
+				try {
+					uri = url;
+				}
+				catch (std::exception const& e) {
+					cerr << "Bad endpoint address: " << url << " - " << e.what() << endl;
+					exit(-1);
+				}
+				if (!uri.KnownScheme()) {
+					cerr << "Unknown URI scheme " << uri.Scheme() << endl;
+					exit(-1);
+				}
+				if (uri.Port() == 0) {
+					cerr << "Missing port number\n";
+					exit(-1);
+				}
+				m_endpoints.push_back(PoolConnection(uri));
+			}
 
 		m_eval = vm["eval"].as<bool>();
 
@@ -202,6 +280,22 @@ public:
 			exit(-1);
 		}
 
+		if (!m_hostKernel.empty()) {
+			bool found = false;
+			for (unsigned k = ETHASH_KERNEL_SCALAR; k <= ETHASH_KERNEL_AVX512; ++k)
+				if (m_hostKernel == ethash_kernel_name((ethash_kernel_t)k)) {
+					found = true;
+					if (!ethash_set_kernel((ethash_kernel_t)k)) {
+						cerr << "This CPU does not support the " << m_hostKernel << " host kernel.\n";
+						exit(-1);
+					}
+				}
+			if (!found) {
+				cerr << "Host kernel must be scalar, sse4.1, avx2 or avx512.\n";
+				exit(-1);
+			}
+		}
+
 		g_logSwitchTime = vm["switch"].as<bool>();
 
 		g_logJson = vm["json"].as<bool>();
@@ -215,7 +309,9 @@ public:
 			m_minerType = MinerType::CUDA;
 		else if (vm["mix"].as<bool>())
 			m_minerType = MinerType::Mixed;
-		else {
+		else if (vm["cpu"].as<bool>())
+			m_minerType = MinerType::CPU;
+		else if (!m_proxyPort) {
 			cerr << "Specify a miner type\n";
 			exit(-1);
 		}
@@ -235,6 +331,15 @@ public:
 			exit(0);
 		}
 
+		EthashStore::configure(m_dagDir, m_dagStore);
+		EthashAux::setLookahead(m_lookahead);
+		EthashAux::setLightLimits(m_lightMax, (uint64_t)m_lightMB * 1024 * 1024);
+
+		if (m_proxyPort)
+			doProxy();
+
+		// Every GPU uploads the same host DAG in single mode, whichever its sealer type.
+		unsigned hostDagLoaders = 0;
 		if (m_minerType == MinerType::CL || m_minerType == MinerType::Mixed) {
 #if ETH_ETHASHCL
 			if (m_openclDeviceCount > 0) {
@@ -247,11 +352,11 @@ public:
 			if (!CLMiner::configureGPU(
 			        m_openclPlatform,
 			        m_dagLoadMode,
-			        m_dagCreateDevice,
 			        m_eval
 			    ))
 				exit(1);
 			CLMiner::setNumInstances(m_miningThreads);
+			hostDagLoaders += CLMiner::instances();
 #else
 			cerr << "Selected GPU mining without having compiled with -DETHASHCL=1\n";
 			exit(1);
@@ -272,18 +377,30 @@ public:
 			        m_cudaSchedule,
 			        0,
 			        m_dagLoadMode,
-			        m_dagCreateDevice,
 			        m_eval
 			    ))
 				exit(1);
 
 			CUDAMiner::setParallelHash(m_parallelHash);
+			hostDagLoaders += CUDAMiner::instances();
 #else
 			cerr << "CUDA support disabled. Configure project build with -DETHASHCUDA=ON\n";
 			exit(1);
 #endif
 		}
 
+		EthashAux::setFullLoaders(hostDagLoaders);
+
+		if (m_minerType == MinerType::CPU) {
+#if ETH_ETHASHCPU
+			CPUMiner::setNumInstances(m_cpuThreads ? m_cpuThreads : UINT_MAX);
+			loginfo("Using " << CPUMiner::instances() << " CPU mining threads");
+#else
+			cerr << "CPU support disabled. Configure project build with -DETHASHCPU=ON\n";
+			exit(1);
+#endif
+		}
+
 		map<string, Farm::SealerDescriptor> sealers;
 #if ETH_ETHASHCL
 		sealers["opencl"] = Farm::SealerDescriptor {&CLMiner::instances, [](FarmFace & _farm, unsigned _index)
@@ -299,6 +416,16 @@ public:
 		}
 		                                         };
 #endif
+#if ETH_ETHASHCPU
+		sealers["cpu"] = Farm::SealerDescriptor {&CPUMiner::instances, [](FarmFace & _farm, unsigned _index)
+		{
+			return new CPUMiner(_farm, _index);
+		}
+		                                        };
+#endif
+
+		if (m_benchmark)
+			doBenchmark(sealers);
 
 		PoolClient* client = nullptr;
 
@@ -307,11 +434,19 @@ public:
 		//sealers, m_minerType
 		Farm f;
 		f.setSealers(sealers);
+		if (m_show_level)
+			f.startHwMonitor(m_show_level, m_hwmonInterval * 1000);
 
 		PoolManager mgr(*client, f, m_minerType);
 		mgr.setReconnectTries(m_maxFarmRetries);
+		mgr.setProbeInterval(m_probeInterval);
 
-		mgr.addConnection(m_endpoint);
+		// With more than one pool the next one is kept connected as a hot standby.
+		if (m_endpoints.size() > 1)
+			mgr.setStandbyClient(*new EthStratumClient());
+
+		for (auto& endpoint : m_endpoints)
+			mgr.addConnection(endpoint);
 
 #if API_CORE
         	Api api(m_api_port, f);
@@ -326,8 +461,7 @@ public:
 		// Run CLI in loop
 		while (true) {
 			if (mgr.isConnected()) {
-				f.collectProgress(m_show_level);
-				auto p = f.miningProgress();
+				auto p = f.collectProgress();
 				loginfo(p << '[' << f.getSolutionStats() << "] " << f.farmLaunchedFormatted());
 			}
 			this_thread::sleep_for(chrono::seconds(m_displayInterval));
@@ -336,6 +470,109 @@ public:
 
 private:
 
+	/// Share the pool connection with downstream miners instead of mining. Never returns.
+	[[noreturn]] void doProxy()
+	{
+		EthStratumClient client;
+		client.setConnection(m_endpoints.front());
+
+		StratumProxy proxy(client, m_proxyPort);
+		try {
+			proxy.start();
+		}
+		catch (std::exception const& e) {
+			logerror("Could not listen on port " << m_proxyPort << ": " << e.what());
+			exit(-1);
+		}
+		loginfo("Proxy listening on port " << m_proxyPort);
+
+		client.connect();
+
+		auto lastHashrate = chrono::steady_clock::now();
+		while (true) {
+			this_thread::sleep_for(chrono::seconds(m_displayInterval));
+			loginfo(proxy.status() << ", " << fixed << setprecision(2) << proxy.hashrate() / 1000000.0 << " MH/s");
+			if (g_report_stratum_hashrate && chrono::steady_clock::now() - lastHashrate >= chrono::minutes(2)) {
+				lastHashrate = chrono::steady_clock::now();
+				uint64_t rate = proxy.hashrate();
+				client.post([&client, rate]() {
+					client.submitHashrate(rate);
+				});
+			}
+		}
+	}
+
+	/// Mine synthetic work of one epoch for a fixed time, report rates and timings and exit.
+	[[noreturn]] void doBenchmark(map<string, Farm::SealerDescriptor> const& _sealers)
+	{
+		Farm f;
+		f.setSealers(_sealers);
+		if (m_show_level)
+			f.startHwMonitor(m_show_level, m_hwmonInterval * 1000);
+		atomic<unsigned> solutions = {0};
+		f.onSolutionFound([&](Solution const&) { ++solutions; });
+
+		WorkPackage wp;
+		wp.seed = EthashAux::seedHash(m_benchmarkBlock);
+		wp.block = m_benchmarkBlock;
+		// Difficulty 2^32, the odd solution shows the search path works without flooding the log.
+		wp.boundary = h256(u256(1) << 224);
+
+		loginfo("Benchmarking block " << m_benchmarkBlock << " (epoch " << m_benchmarkBlock / ETHASH_EPOCH_LENGTH << ") for " <<
+		        m_benchmarkSecs << " s");
+		f.start(m_minerType);
+
+		// Rates only count samples in which a miner hashed, so DAG generation doesn't drag them down.
+		vector<uint64_t> hashes, hashMs;
+		auto nextJob = chrono::steady_clock::now();
+		auto nextReport = nextJob + chrono::seconds(m_displayInterval);
+		auto end = nextJob + chrono::seconds(m_benchmarkSecs);
+		f.collectProgress();
+		while (chrono::steady_clock::now() < end) {
+			auto now = chrono::steady_clock::now();
+			if (now >= nextJob) {
+				wp.header = h256::random();
+				f.setWork(wp);
+				nextJob = now + chrono::milliseconds(m_benchmarkJobMs);
+			}
+			this_thread::sleep_for(chrono::milliseconds(100));
+
+			bool report = chrono::steady_clock::now() >= nextReport;
+			WorkingProgress p = f.collectProgress();
+			hashes.resize(p.minersHashes.size());
+			hashMs.resize(p.minersHashes.size());
+			for (size_t i = 0; i < p.minersHashes.size(); ++i)
+				if (p.minersHashes[i]) {
+					hashes[i] += p.minersHashes[i];
+					hashMs[i] += p.ms;
+				}
+			if (report) {
+				loginfo(p << "[solutions " << solutions << "]");
+				nextReport += chrono::seconds(m_displayInterval);
+			}
+		}
+
+		vector<MinerTimings> timings = f.minerTimings();
+		double total = 0;
+		stringstream report;
+		report << "Benchmark results, block " << m_benchmarkBlock << ", " << m_benchmarkSecs << " s, " << solutions <<
+		       " solutions\n";
+		report << "miner      Mh/s    DAG ms   switch ms p50/p90/p99/max (samples)\n";
+		for (size_t i = 0; i < timings.size(); ++i) {
+			double mh = i < hashes.size() && hashMs[i] ? hashes[i] / (hashMs[i] * 1000.0) : 0;
+			total += mh;
+			vector<float> const& sw = timings[i].switchMs;
+			report << "gpu" << setw(2) << left << i << right << fixed << setprecision(2) << setw(11) << mh << setw(10) <<
+			       timings[i].dagMs << "   " << setprecision(1) << percentile(sw, 0.5) << '/' << percentile(sw, 0.9) << '/' <<
+			       percentile(sw, 0.99) << '/' << percentile(sw, 1) << " (" << sw.size() << ")\n";
+		}
+		report << "total" << fixed << setprecision(2) << setw(11) << total << " Mh/s";
+		loginfo(report.str());
+
+		// Miner threads are never joined, leave without unwinding the farm.
+		exit(0);
+	}
+
 	/// Mining options
 	MinerType m_minerType = MinerType::Mixed;
 	unsigned m_openclPlatform = 0;
@@ -355,17 +592,34 @@ private:
 	unsigned m_cudaGridSize;
 	unsigned m_cudaBlockSize;
 	unsigned m_parallelHash    = 4;
+#endif
+#if ETH_ETHASHCPU
+	unsigned m_cpuThreads = 0;
 #endif
 	bool m_eval = false;
 	unsigned m_dagLoadMode = 0; // parallel
-	unsigned m_dagCreateDevice = 0;
+	string m_dagDir;
+	string m_hostKernel;
+	unsigned m_lookahead = 1000;
+	unsigned m_lightMax = 3;
+	unsigned m_lightMB = 0;
+	bool m_dagStore = false;
 	/// Benchmarking params
+	bool m_benchmark = false;
+	unsigned m_benchmarkBlock = 0;
+	unsigned m_benchmarkSecs = 60;
+	unsigned m_benchmarkJobMs = 2000;
+	unsigned m_proxyPort = 0;
 
-	PoolConnection m_endpoint;
+	vector<PoolConnection> m_endpoints;
 
 	unsigned m_maxFarmRetries = 3;
+	unsigned m_probeInterval = 60;
+	double m_replaySpeed = 1;
+	std::unique_ptr<StratumReplay> m_replay;
 	unsigned m_displayInterval = 5;
 	unsigned m_show_level = 0;
+	unsigned m_hwmonInterval = 5;
 
 #if API_CORE
 	unsigned m_api_port = 0;
@@ -0,0 +1,561 @@
+/*  Blah, blah, blah.. all this pedantic nonsense to say that this
+    source code is made available under the terms and conditions
+    of the accompanying GNU General Public License */
+
+// A local pool for exercising the stratum client, speaking any of the dialects of the
+// PoolURI scheme table. What it does is scripted, one command per line or separated by ';'.
+//
+// miner-mockpool [--port <port>] [--dialect stratum|ethproxy|nicehash] [--script <file>] [-e <commands>]
+//                [--stats <seconds>]
+//
+//   job [<ms>]         send a new job now, with <ms> keep sending one that often, 0 stops
+//   flood <n>          send <n> jobs back to back
+//   diff <d>           share difficulty, nicehash miners are told right away, others with the next job
+//   extranonce <hex>   nicehash extranonce, sent right away
+//   block <n>          block number the seed hash of the following jobs is for
+//   reject <n>         reject every n-th share, 0 accepts them all
+//   delay <ms>         answer shares after <ms>
+//   stall <ms>         hold everything sent to the miners for <ms>
+//   drop               close every connection
+//   verify on|off      check shares against the light cache and the share boundary
+//   wait <ms>          pause the script
+//   repeat             start the script over, needs a wait before it
+//   quit               print the counters and exit
+//
+// Lines starting with # are comments. Without a script jobs are sent every 5 seconds.
+
+#include <atomic>
+#include <chrono>
+#include <deque>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+#include <boost/algorithm/string.hpp>
+#include <boost/program_options.hpp>
+#include <json/json.h>
+#include <libdevcore/Log.h>
+#include <libethcore/Difficulty.h>
+#include <libethcore/EthashAux.h>
+#include <libproto/EthStratumClient.h>
+#include <libproto/StratumServer.h>
+
+using namespace std;
+using namespace dev;
+using namespace dev::eth;
+
+namespace
+{
+
+// Jobs a share may still be for.
+const size_t c_keepJobs = 8;
+
+struct Command {
+	string name;
+	string arg;
+};
+
+struct Job {
+	string id;
+	h256 header;
+	h256 seed;
+	h256 boundary;
+};
+
+struct Miner {
+	bool authorized = false;
+};
+
+string hex(uint64_t _v, unsigned _digits)
+{
+	stringstream ss;
+	ss << std::hex << setw(_digits) << setfill('0') << _v;
+	return ss.str();
+}
+
+string strip0x(string const& _s)
+{
+	return _s.size() > 1 && _s[0] == '0' && (_s[1] == 'x' || _s[1] == 'X') ? _s.substr(2) : _s;
+}
+
+class MockPool
+{
+public:
+	MockPool(unsigned short _port, unsigned _dialect, vector<Command> const& _script) :
+		m_dialect(_dialect),
+		m_script(_script),
+		m_server(_port),
+		m_jobTimer(m_server.service()),
+		m_stallTimer(m_server.service())
+	{
+		m_server.onConnected([this](StratumSessionPtr const & s) {
+			m_connections++;
+			m_miners[s->id()] = Miner();
+		});
+		m_server.onDisconnected([this](StratumSessionPtr const & s) {
+			m_miners.erase(s->id());
+		});
+		m_server.onMessage([this](StratumSessionPtr const & s, Json::Value & msg) {
+			onMessage(s, msg);
+		});
+		setDifficulty(1);
+	}
+
+	void start()
+	{
+		m_server.start();
+		// The first job is ready before anyone logs in.
+		m_server.post([this]() {
+			newJob(false);
+		});
+	}
+
+	/// Run the script on the calling thread. Returns after quit or at its end.
+	bool runScript()
+	{
+		size_t i = 0;
+		while (i < m_script.size()) {
+			Command const& c = m_script[i++];
+			if (c.name == "wait")
+				this_thread::sleep_for(chrono::milliseconds(stoul(c.arg)));
+			else if (c.name == "repeat")
+				i = 0;
+			else if (c.name == "quit")
+				return true;
+			else
+				m_server.post([this, c]() {
+				run(c);
+			});
+		}
+		return false;
+	}
+
+	string stats() const
+	{
+		stringstream ss;
+		ss << m_connections << " connections, " << m_jobs << " jobs, " << m_shares << " shares, " << m_accepted <<
+		   " accepted, " << m_rejected << " rejected, " << m_invalid << " invalid, " << m_hashrate / 1000000.0 << " MH/s reported";
+		return ss.str();
+	}
+
+private:
+	void run(Command const& _c)
+	{
+		if (_c.name == "job") {
+			if (!_c.arg.empty()) {
+				m_jobInterval = stoul(_c.arg);
+				m_jobTimer.cancel();
+				if (m_jobInterval)
+					scheduleJob();
+			}
+			newJob(true);
+		}
+		else if (_c.name == "flood")
+			for (unsigned n = stoul(_c.arg); n; n--)
+				newJob(true);
+		else if (_c.name == "diff") {
+			setDifficulty(stod(_c.arg));
+			if (m_dialect == EthStratumClient::ETHEREUMSTRATUM)
+				broadcast(difficultyMessage());
+		}
+		else if (_c.name == "extranonce") {
+			m_extraNonce = _c.arg;
+			Json::Value msg;
+			msg["id"] = Json::Value::null;
+			msg["method"] = "mining.set_extranonce";
+			msg["params"].append(m_extraNonce);
+			if (m_dialect == EthStratumClient::ETHEREUMSTRATUM)
+				broadcast(msg);
+		}
+		else if (_c.name == "block")
+			m_block = stoul(_c.arg);
+		else if (_c.name == "reject")
+			m_rejectEvery = stoul(_c.arg);
+		else if (_c.name == "delay")
+			m_delay = stoul(_c.arg);
+		else if (_c.name == "stall") {
+			m_stalled = true;
+			m_stallTimer.expires_from_now(boost::posix_time::milliseconds(stoul(_c.arg)));
+			m_stallTimer.async_wait([this](const boost::system::error_code & ec) {
+				if (ec)
+					return;
+				m_stalled = false;
+				auto held = move(m_held);
+				m_held.clear();
+				for (auto const& h : held)
+					if (auto s = h.first.lock())
+						s->send(h.second);
+			});
+		}
+		else if (_c.name == "drop") {
+			auto sessions = m_server.sessions();
+			for (auto const& s : sessions)
+				s.second->close();
+		}
+		else if (_c.name == "verify")
+			m_verify = _c.arg == "on";
+	}
+
+	void setDifficulty(double _diff)
+	{
+		m_difficulty = _diff;
+		diffToTarget((uint32_t*)m_boundary.data(), _diff);
+	}
+
+	void scheduleJob()
+	{
+		m_jobTimer.expires_from_now(boost::posix_time::milliseconds(m_jobInterval));
+		m_jobTimer.async_wait([this](const boost::system::error_code & ec) {
+			if (ec)
+				return;
+			newJob(true);
+			scheduleJob();
+		});
+	}
+
+	void newJob(bool _notify)
+	{
+		m_jobCounter++;
+		m_jobs++;
+		Job job{hex(m_jobCounter, 8), h256::random(), EthashAux::seedHash(m_block), m_boundary};
+		if (m_dialect == EthStratumClient::STRATUM)
+			job.id = h256::random().hex();
+		m_recent.push_back(job);
+		if (m_recent.size() > c_keepJobs)
+			m_recent.pop_front();
+		if (!_notify)
+			return;
+		for (auto const& s : m_server.sessions())
+			if (m_miners[s.first].authorized)
+				notify(s.second, m_recent.back());
+	}
+
+	Json::Value difficultyMessage() const
+	{
+		Json::Value msg;
+		msg["id"] = Json::Value::null;
+		msg["method"] = "mining.set_difficulty";
+		msg["params"].append(m_difficulty);
+		return msg;
+	}
+
+	void notify(StratumSessionPtr const& _s, Job const& _job, Json::Value const& _id = 0)
+	{
+		Json::Value msg;
+		switch (m_dialect) {
+		case EthStratumClient::STRATUM:
+			msg["id"] = Json::Value::null;
+			msg["method"] = "mining.notify";
+			msg["params"].append("0x" + _job.id);
+			msg["params"].append("0x" + _job.header.hex());
+			msg["params"].append("0x" + _job.seed.hex());
+			msg["params"].append("0x" + _job.boundary.hex());
+			break;
+		case EthStratumClient::ETHPROXY:
+			msg["id"] = _id;
+			msg["jsonrpc"] = "2.0";
+			msg["result"].append("0x" + _job.header.hex());
+			msg["result"].append("0x" + _job.seed.hex());
+			msg["result"].append("0x" + _job.boundary.hex());
+			break;
+		case EthStratumClient::ETHEREUMSTRATUM:
+			msg["id"] = Json::Value::null;
+			msg["method"] = "mining.notify";
+			msg["params"].append(_job.id);
+			msg["params"].append(_job.seed.hex());
+			msg["params"].append(_job.header.hex());
+			msg["params"].append(true);
+			break;
+		}
+		send(_s, msg);
+	}
+
+	void send(StratumSessionPtr const& _s, Json::Value const& _msg)
+	{
+		if (m_stalled)
+			m_held.emplace_back(_s, _msg);
+		else
+			_s->send(_msg);
+	}
+
+	void broadcast(Json::Value const& _msg)
+	{
+		for (auto const& s : m_server.sessions())
+			send(s.second, _msg);
+	}
+
+	void reply(StratumSessionPtr const& _s, Json::Value const& _id, Json::Value const& _result,
+	           string const& _error = string(), int _code = 20)
+	{
+		Json::Value msg;
+		msg["id"] = _id;
+		if (m_dialect == EthStratumClient::ETHPROXY)
+			msg["jsonrpc"] = "2.0";
+		msg["result"] = _result;
+		if (_error.empty())
+			msg["error"] = Json::Value::null;
+		else {
+			msg["error"].append(_code);
+			msg["error"].append(_error);
+			msg["error"].append(Json::Value::null);
+		}
+		send(_s, msg);
+	}
+
+	void onMessage(StratumSessionPtr const& _s, Json::Value& _msg)
+	{
+		Json::Value id = _msg.get("id", Json::Value::null);
+		string method = _msg.get("method", "").asString();
+		Json::Value params = _msg.get("params", Json::Value(Json::arrayValue));
+		Miner& miner = m_miners[_s->id()];
+
+		if (method == "mining.subscribe") {
+			if (m_dialect == EthStratumClient::ETHEREUMSTRATUM) {
+				Json::Value subscription;
+				subscription.append("mining.notify");
+				subscription.append(hex(_s->id(), 8));
+				subscription.append("EthereumStratum/1.0.0");
+				Json::Value result;
+				result.append(subscription);
+				result.append(m_extraNonce);
+				reply(_s, id, result);
+			}
+			else
+				reply(_s, id, true);
+		}
+		else if (method == "mining.extranonce.subscribe")
+			reply(_s, id, true);
+		else if (method == "mining.authorize" || method == "eth_submitLogin") {
+			miner.authorized = true;
+			reply(_s, id, true);
+			if (m_dialect == EthStratumClient::ETHEREUMSTRATUM)
+				send(_s, difficultyMessage());
+			if (m_dialect != EthStratumClient::ETHPROXY)
+				notify(_s, m_recent.back());
+		}
+		else if (method == "eth_getWork")
+			notify(_s, m_recent.back(), id);
+		else if (method == "eth_submitHashrate") {
+			m_hashrate = strtoull(strip0x(params.get((Json::Value::ArrayIndex)0, "0").asString()).c_str(), nullptr, 16);
+			reply(_s, id, true);
+		}
+		else if (method == "mining.submit" || method == "eth_submitWork")
+			share(_s, id, params);
+		else if (!id.isNull())
+			reply(_s, id, Json::Value::null, "Unsupported method " + method);
+	}
+
+	void share(StratumSessionPtr const& _s, Json::Value const& _id, Json::Value const& _params)
+	{
+		m_shares++;
+		auto param = [&](unsigned i) {
+			return strip0x(_params.get((Json::Value::ArrayIndex)i, "").asString());
+		};
+
+		// The job is named by its id, or by its header on eth-proxy.
+		string nonceHex;
+		auto job = m_recent.rbegin();
+		if (m_dialect == EthStratumClient::ETHPROXY) {
+			nonceHex = param(0);
+			while (job != m_recent.rend() && job->header.hex() != param(1))
+				job++;
+		}
+		else {
+			nonceHex = m_dialect == EthStratumClient::ETHEREUMSTRATUM ? m_extraNonce + param(2) : param(2);
+			while (job != m_recent.rend() && job->id != param(1))
+				job++;
+		}
+
+		string error;
+		if (job == m_recent.rend())
+			error = "Job not found";
+		else if (nonceHex.size() != 16 || nonceHex.find_first_not_of("0123456789abcdefABCDEF") != string::npos)
+			error = "Malformed nonce";
+		else if (m_verify) {
+			Result r = EthashAux::eval(job->seed, job->header, strtoull(nonceHex.c_str(), nullptr, 16));
+			if (r.value > job->boundary)
+				error = "Low difficulty share";
+		}
+		if (!error.empty())
+			m_invalid++;
+		else if (m_rejectEvery && m_shares % m_rejectEvery == 0)
+			error = "Rejected by script";
+
+		if (error.empty())
+			m_accepted++;
+		else
+			m_rejected++;
+
+		if (!m_delay) {
+			reply(_s, _id, error.empty(), error);
+			return;
+		}
+		auto timer = make_shared<boost::asio::deadline_timer>(m_server.service(), boost::posix_time::milliseconds(m_delay));
+		StratumSessionPtr s = _s;
+		Json::Value id = _id;
+		timer->async_wait([this, timer, s, id, error](const boost::system::error_code & ec) {
+			if (!ec && !s->closed())
+				reply(s, id, error.empty(), error);
+		});
+	}
+
+	unsigned m_dialect;
+	vector<Command> m_script;
+	StratumServer m_server;
+
+	// Owned by the server's io thread.
+	map<unsigned, Miner> m_miners;
+	deque<Job> m_recent;    ///< Most recent last.
+	uint64_t m_jobCounter = 0;
+	unsigned m_jobInterval = 0;
+	boost::asio::deadline_timer m_jobTimer;
+	double m_difficulty = 1;
+	h256 m_boundary;
+	string m_extraNonce = "a1b2";
+	uint64_t m_block = 0;
+	unsigned m_rejectEvery = 0;
+	unsigned m_delay = 0;
+	bool m_verify = false;
+	bool m_stalled = false;
+	boost::asio::deadline_timer m_stallTimer;
+	vector<pair<weak_ptr<StratumSession>, Json::Value>> m_held;
+
+	atomic<unsigned> m_connections = {0};
+	atomic<unsigned> m_jobs = {0};
+	atomic<unsigned> m_shares = {0};
+	atomic<unsigned> m_accepted = {0};
+	atomic<unsigned> m_rejected = {0};
+	atomic<unsigned> m_invalid = {0};
+	atomic<uint64_t> m_hashrate = {0};
+};
+
+vector<Command> parseScript(string const& _text)
+{
+	static const vector<string> c_commands = {"job", "flood", "diff", "extranonce", "block", "reject", "delay", "stall",
+	                                          "drop", "verify", "wait", "repeat", "quit"
+	                                         };
+	vector<Command> script;
+	bool waits = false;
+	vector<string> lines;
+	boost::split(lines, _text, boost::is_any_of("\n;"));
+	for (auto line : lines) {
+		boost::trim(line);
+		if (line.empty() || line[0] == '#')
+			continue;
+		Command c;
+		size_t sp = line.find_first_of(" \t");
+		c.name = line.substr(0, sp);
+		if (sp != string::npos)
+			c.arg = boost::trim_copy(line.substr(sp));
+		if (find(c_commands.begin(), c_commands.end(), c.name) == c_commands.end())
+			throw runtime_error("Unknown command '" + c.name + "'");
+		bool needsArg = c.name != "job" && c.name != "drop" && c.name != "repeat" && c.name != "quit";
+		if (needsArg && c.arg.empty())
+			throw runtime_error("'" + c.name + "' needs an argument");
+		if (c.name != "extranonce" && c.name != "verify" && !c.arg.empty() &&
+		        c.arg.find_first_not_of(c.name == "diff" ? "0123456789." : "0123456789") != string::npos)
+			throw runtime_error("Bad argument for '" + c.name + "': " + c.arg);
+		if (c.name == "extranonce" && (c.arg.size() > 8 || c.arg.find_first_not_of("0123456789abcdef") != string::npos))
+			throw runtime_error("The extranonce takes up to 8 lower case hex digits: " + c.arg);
+		// Without a pause the loop would queue commands for the server as fast as it can.
+		if (c.name == "wait" && stoul(c.arg) > 0)
+			waits = true;
+		if (c.name == "repeat" && !waits)
+			throw runtime_error("'repeat' needs a 'wait' of more than 0 ms before it");
+		script.push_back(c);
+	}
+	return script;
+}
+
+}
+
+int main(int argc, char** argv)
+{
+	using namespace boost::program_options;
+
+	unsigned port;
+	string dialectName;
+	unsigned statsSecs;
+	options_description desc("Options");
+	desc.add_options()
+	("help,h", bool_switch()->default_value(false), "produce help message.\n")
+	("port", value<unsigned>(&port)->default_value(3333), "Listening port.\n")
+	("dialect", value<string>(&dialectName)->default_value("stratum"), "stratum, ethproxy or nicehash.\n")
+	("script", value<string>(), "File of commands to run.\n")
+	(",e", value<string>(), "Commands to run, separated by ';'.\n")
+	("stats", value<unsigned>(&statsSecs)->default_value(10), "Seconds between printing the counters, 0 - never.\n")
+	;
+
+	variables_map vm;
+	try {
+		store(parse_command_line(argc, argv, desc), vm);
+		notify(vm);
+	}
+	catch (std::exception const& e) {
+		cerr << e.what() << "\n" << desc << "\n";
+		return 1;
+	}
+	if (vm["help"].as<bool>()) {
+		cout << desc << "\n";
+		return 0;
+	}
+
+	static const vector<string> c_dialects = {"stratum", "ethproxy", "nicehash"};
+	auto dialect = find(c_dialects.begin(), c_dialects.end(), dialectName);
+	if (dialect == c_dialects.end() || port == 0 || port > 65535) {
+		cerr << desc << "\n";
+		return 1;
+	}
+
+	string text = "job 5000";
+	if (vm.count("script")) {
+		ifstream f(vm["script"].as<string>());
+		if (!f) {
+			cerr << "Can't read " << vm["script"].as<string>() << "\n";
+			return 1;
+		}
+		stringstream ss;
+		ss << f.rdbuf();
+		text = ss.str();
+	}
+	else if (vm.count("-e"))
+		text = vm["-e"].as<string>();
+
+	vector<Command> script;
+	try {
+		script = parseScript(text);
+	}
+	catch (std::exception const& e) {
+		cerr << e.what() << "\n";
+		return 1;
+	}
+
+	MockPool pool(port, dialect - c_dialects.begin(), script);
+	try {
+		pool.start();
+	}
+	catch (std::exception const& e) {
+		cerr << "Could not listen on port " << port << ": " << e.what() << "\n";
+		return 1;
+	}
+	loginfo("Mock " << dialectName << " pool listening on port " << port);
+
+	atomic<bool> quit = {false};
+	thread runner([&]() {
+		quit = pool.runScript();
+	});
+	auto lastStats = chrono::steady_clock::now();
+	while (!quit) {
+		this_thread::sleep_for(chrono::milliseconds(100));
+		if (statsSecs && chrono::steady_clock::now() - lastStats >= chrono::seconds(statsSecs)) {
+			lastStats = chrono::steady_clock::now();
+			loginfo(pool.stats());
+		}
+	}
+	runner.join();
+	loginfo(pool.stats());
+	_exit(0);
+}